@@ -0,0 +1,42 @@
+# bubble_sort -- bubble_sort.c: sorts {5,3,6,8,9,1,4,7,2,10} in place at 0x10010000.
+# Short dependent load/compare/store chains; stresses load-use stalls and taken branches.
+        lui   $s0, 0x1001           # array base
+        addiu $t0, $zero, 5
+        sw    $t0, 0($s0)
+        addiu $t0, $zero, 3
+        sw    $t0, 4($s0)
+        addiu $t0, $zero, 6
+        sw    $t0, 8($s0)
+        addiu $t0, $zero, 8
+        sw    $t0, 12($s0)
+        addiu $t0, $zero, 9
+        sw    $t0, 16($s0)
+        addiu $t0, $zero, 1
+        sw    $t0, 20($s0)
+        addiu $t0, $zero, 4
+        sw    $t0, 24($s0)
+        addiu $t0, $zero, 7
+        sw    $t0, 28($s0)
+        addiu $t0, $zero, 2
+        sw    $t0, 32($s0)
+        addiu $t0, $zero, 10
+        sw    $t0, 36($s0)
+        addiu $s1, $zero, 9         # n - 1
+        addiu $t0, $zero, 0         # i
+outer:  subu  $t1, $s1, $t0         # inner limit 9 - i
+        blez  $t1, done
+        addiu $t2, $zero, 0         # j
+        addu  $t3, $s0, $zero       # &array[j]
+inner:  lw    $t4, 0($t3)
+        lw    $t5, 4($t3)
+        slt   $t6, $t5, $t4         # array[j+1] < array[j]
+        beq   $t6, $zero, noswap
+        sw    $t5, 0($t3)
+        sw    $t4, 4($t3)
+noswap: addiu $t2, $t2, 1
+        addiu $t3, $t3, 4
+        bne   $t2, $t1, inner
+        addiu $t0, $t0, 1
+        j     outer
+done:   addiu $v0, $zero, 10
+        syscall
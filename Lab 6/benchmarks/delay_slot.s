@@ -0,0 +1,58 @@
+# delay_slot -- branch delay slots, for -o delay_slot=1 only. Unlike the other
+# workloads this is assembled with the MIPS convention (a branch target is
+# PC + 4 + (offset << 2)) and every branch and jump is followed by the
+# instruction that runs in its slot: filled and NOP slots, taken and untaken
+# branches, JAL/JALR calls, and loads, stores and MULT/MFLO in slots.
+# Squares of 0..39 go to 0x10010000, a checksum of them to 0x10011000.
+        lui   $s0, 0x1001
+        addiu $s1, $zero, 40        # n
+        addiu $t0, $zero, 0         # i
+        addiu $v1, $zero, 0
+loop:   sll   $t1, $t0, 2
+        addu  $t1, $t1, $s0
+        jal   sq
+        addu  $a0, $t0, $zero       # slot: argument
+        sw    $v0, 0($t1)
+        addiu $t0, $t0, 1
+        slt   $t2, $t0, $s1
+        bne   $t2, $zero, loop
+        addu  $v1, $v1, $v0         # slot: accumulate
+        addiu $t0, $zero, 0
+        addiu $t3, $zero, 0
+sum:    lw    $t4, 0($t1)
+        beq   $t4, $zero, skip
+        addu  $t3, $t3, $t4         # slot, also when taken
+        addiu $t3, $t3, 1
+skip:   addiu $t1, $t1, -4
+        slt   $t2, $t1, $s0
+        beq   $t2, $zero, sum
+        nop
+        lui   $t5, 0
+        ori   $t5, $t5, 0
+        addiu $t6, $zero, 0
+        j     tail
+        sw    $t3, 4096($s0)        # slot: store
+        addiu $t3, $zero, 99        # skipped
+tail:   lui   $t7, 0x0040
+        ori   $t7, $t7, 196         # &fn
+        jalr  $ra, $t7
+        lw    $t6, 4096($s0)        # slot: load
+        mult  $t6, $v1
+        bgez  $t6, out
+        mflo  $s2                   # slot
+        addiu $s2, $zero, 7         # skipped
+out:    blez  $t6, never
+        addiu $s3, $s3, 3
+        bltz  $s3, never
+        sw    $s2, 4100($s0)
+        bgtz  $s3, fin
+        sw    $s3, 4104($s0)
+never:  addiu $s4, $zero, 1
+fin:    addiu $v0, $zero, 10
+        syscall
+sq:     mult  $a0, $a0
+        jr    $ra
+        mflo  $v0                   # slot: result
+fn:     addiu $s5, $zero, 5
+        jr    $ra
+        sw    $s5, 4108($s0)
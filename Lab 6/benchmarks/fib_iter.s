@@ -0,0 +1,22 @@
+# fib_iter -- Fibonacci.cpp: writes F(0)..F(31) to 0x10010000, last value left in $v1.
+# Tight register-carried loop, one store per iteration.
+        lui   $s0, 0x1001
+        addiu $a0, $zero, 30        # input
+        addiu $t0, $zero, 0         # prev
+        addiu $t1, $zero, 1         # current
+        sw    $t0, 0($s0)
+        sw    $t1, 4($s0)
+        addiu $t3, $s0, 8           # next output slot
+        addiu $t2, $zero, 1         # i
+loop:   slt   $t4, $a0, $t2         # i > input
+        bne   $t4, $zero, done
+        addu  $t5, $t0, $t1         # answer = prev + current
+        addu  $t0, $t1, $zero
+        addu  $t1, $t5, $zero
+        sw    $t5, 0($t3)
+        addiu $t3, $t3, 4
+        addiu $t2, $t2, 1
+        j     loop
+done:   addu  $v1, $t1, $zero
+        addiu $v0, $zero, 10
+        syscall
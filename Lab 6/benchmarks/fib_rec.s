@@ -0,0 +1,28 @@
+# fib_rec -- recursive fib(18) = 2584 with a stack frame per call (stack at 0x10020000).
+# JAL/JR heavy with stack loads/stores; result in $s0 and at 0x10010000.
+        lui   $sp, 0x1002
+        lui   $s1, 0x1001
+        addiu $a0, $zero, 18
+        jal   fib
+        addu  $s0, $v0, $zero
+        sw    $s0, 0($s1)
+        addiu $v0, $zero, 10
+        syscall
+fib:    slti  $t0, $a0, 2
+        beq   $t0, $zero, recurse
+        addu  $v0, $a0, $zero       # fib(0) = 0, fib(1) = 1
+        jr    $ra
+recurse: addiu $sp, $sp, -12
+        sw    $ra, 8($sp)
+        sw    $a0, 4($sp)
+        addiu $a0, $a0, -1
+        jal   fib                   # fib(n - 1)
+        sw    $v0, 0($sp)
+        lw    $a0, 4($sp)
+        addiu $a0, $a0, -2
+        jal   fib                   # fib(n - 2)
+        lw    $t1, 0($sp)
+        addu  $v0, $v0, $t1
+        lw    $ra, 8($sp)
+        addiu $sp, $sp, 12
+        jr    $ra
@@ -0,0 +1,33 @@
+# list_chase -- 128 list nodes of {next, value}, one per 16-byte block at 0x10010000,
+# node k in slot (37 * k) mod 128, so successive nodes land far apart.
+# The list is walked 8 times summing the values into $v1 (8 * 8256).
+# Every load address depends on the previous load: no memory-level parallelism.
+        lui   $s0, 0x1001           # node pool
+        addiu $s1, $zero, 128       # nodes
+        addiu $t0, $zero, 0         # k
+        addiu $t1, $zero, 0         # slot of node k
+build:  sll   $t2, $t1, 4
+        addu  $t2, $t2, $s0         # &node k
+        addiu $t3, $t1, 37
+        andi  $t3, $t3, 127         # slot of node k + 1
+        sll   $t4, $t3, 4
+        addu  $t4, $t4, $s0         # &node k + 1
+        addiu $t5, $t0, 1
+        sw    $t5, 4($t2)           # value = k + 1
+        bne   $t5, $s1, link
+        addu  $t4, $zero, $zero     # last node ends the list
+link:   sw    $t4, 0($t2)
+        addu  $t1, $t3, $zero
+        addiu $t0, $t0, 1
+        bne   $t0, $s1, build
+        addiu $s2, $zero, 8         # passes
+        addiu $v1, $zero, 0
+pass:   addu  $t0, $s0, $zero       # node 0 sits in slot 0
+chase:  lw    $t1, 4($t0)
+        addu  $v1, $v1, $t1
+        lw    $t0, 0($t0)
+        bne   $t0, $zero, chase
+        addiu $s2, $s2, -1
+        bgtz  $s2, pass
+        addiu $v0, $zero, 10
+        syscall
@@ -0,0 +1,20 @@
+# ll_lock -- contended spinlock: every core/thread takes the LL/SC lock at
+# 0x10010000 200 times and increments the shared counter at 0x10010040 inside
+# it. $k1 contexts leave 200 * $k1 in the counter and the lock free.
+# Run with -o cores=4 and/or -o threads=<n>; the .expect is for 4 contexts.
+        lui   $s0, 0x1001
+        addiu $s1, $zero, 200       # acquisitions left
+acq:    ll    $t0, 0($s0)
+        bne   $t0, $zero, acq       # held, spin
+        addiu $t0, $zero, 1
+        sc    $t0, 0($s0)
+        beq   $t0, $zero, acq       # lost the reservation, retry
+        lw    $t1, 64($s0)          # critical section: counter++
+        addiu $t1, $t1, 1
+        sw    $t1, 64($s0)
+        sync
+        sw    $zero, 0($s0)         # release
+        addiu $s1, $s1, -1
+        bne   $s1, $zero, acq
+        addiu $v0, $zero, 10
+        syscall
@@ -0,0 +1,58 @@
+# matmul -- C = A * B for 16x16 words, A[i][j] = i + j, B[i][j] = i - j.
+# A at 0x10010000, B at +0x400, C at +0x800; checksum of C in $v1.
+# Row-major A against column-walking B (64-byte stride), MULT/MFLO in the inner loop.
+        lui   $s0, 0x1001           # A
+        addiu $s1, $s0, 1024        # B
+        addiu $s2, $s0, 2048        # C
+        addiu $s3, $zero, 16        # N
+        addiu $t0, $zero, 0         # i
+        addu  $t7, $s0, $zero
+        addu  $t8, $s1, $zero
+init_i: addiu $t1, $zero, 0         # j
+init_j: addu  $t2, $t0, $t1
+        sw    $t2, 0($t7)
+        subu  $t3, $t0, $t1
+        sw    $t3, 0($t8)
+        addiu $t7, $t7, 4
+        addiu $t8, $t8, 4
+        addiu $t1, $t1, 1
+        bne   $t1, $s3, init_j
+        addiu $t0, $t0, 1
+        bne   $t0, $s3, init_i
+        addiu $t0, $zero, 0         # i
+mm_i:   addiu $t1, $zero, 0         # j
+mm_j:   addiu $t2, $zero, 0         # k
+        addiu $t9, $zero, 0         # sum
+        sll   $t4, $t0, 6
+        addu  $t4, $t4, $s0         # &A[i][0]
+        sll   $t5, $t1, 2
+        addu  $t5, $t5, $s1         # &B[0][j]
+mm_k:   lw    $t6, 0($t4)
+        lw    $t7, 0($t5)
+        mult  $t6, $t7
+        mflo  $t8
+        addu  $t9, $t9, $t8
+        addiu $t4, $t4, 4
+        addiu $t5, $t5, 64
+        addiu $t2, $t2, 1
+        bne   $t2, $s3, mm_k
+        sll   $t4, $t0, 6
+        addu  $t4, $t4, $s2
+        sll   $t5, $t1, 2
+        addu  $t4, $t4, $t5
+        sw    $t9, 0($t4)           # C[i][j]
+        addiu $t1, $t1, 1
+        bne   $t1, $s3, mm_j
+        addiu $t0, $t0, 1
+        bne   $t0, $s3, mm_i
+        addiu $v1, $zero, 0         # checksum = checksum * 31 + C[n]
+        addu  $t4, $s2, $zero
+        addiu $t5, $s2, 1024
+sum:    lw    $t6, 0($t4)
+        sll   $t7, $v1, 5
+        subu  $t7, $t7, $v1
+        addu  $v1, $t7, $t6
+        addiu $t4, $t4, 4
+        bne   $t4, $t5, sum
+        addiu $v0, $zero, 10
+        syscall
@@ -0,0 +1,35 @@
+# memcpy -- fills 2048 words at 0x10010000 with 3i + 1, copies them to 0x10014000
+# four words per iteration, then folds the copy into a checksum in $v1.
+# Pure streaming: sequential loads and stores, no reuse.
+        lui   $s0, 0x1001           # src
+        addiu $s1, $s0, 16384       # dst
+        addiu $t0, $zero, 1         # 3i + 1
+        addu  $t1, $s0, $zero
+fill:   sw    $t0, 0($t1)
+        addiu $t0, $t0, 3
+        addiu $t1, $t1, 4
+        bne   $t1, $s1, fill
+        addu  $t1, $s0, $zero       # copy pointers
+        addu  $t2, $s1, $zero
+copy:   lw    $t3, 0($t1)
+        lw    $t4, 4($t1)
+        lw    $t5, 8($t1)
+        lw    $t6, 12($t1)
+        sw    $t3, 0($t2)
+        sw    $t4, 4($t2)
+        sw    $t5, 8($t2)
+        sw    $t6, 12($t2)
+        addiu $t1, $t1, 16
+        addiu $t2, $t2, 16
+        bne   $t1, $s1, copy
+        addiu $v1, $zero, 0         # checksum = checksum * 31 + dst[n]
+        addu  $t2, $s1, $zero
+        addiu $t3, $s1, 8192
+sum:    lw    $t4, 0($t2)
+        sll   $t5, $v1, 5
+        subu  $t5, $t5, $v1
+        addu  $v1, $t5, $t4
+        addiu $t2, $t2, 4
+        bne   $t2, $t3, sum
+        addiu $v0, $zero, 10
+        syscall
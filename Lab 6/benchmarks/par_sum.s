@@ -0,0 +1,29 @@
+# par_sum -- data-parallel interleaved sum split by $k0 (context id) and $k1
+# (context count): context k fills a[i] = i for i = k, k + $k1, ... < 1024 at
+# 0x10010000, interleaved words so neighbouring contexts share lines, then sums
+# its own elements into out[k] at 0x10012000. No context reads another's
+# words, so the result is the same in any interleaving: serial or
+# -o parallel=1 cores, or hardware threads. The .expect is for 4 contexts.
+        lui   $s0, 0x1001
+        addiu $s1, $zero, 1024      # n
+        addu  $t0, $k0, $zero       # i
+fill:   sll   $t1, $t0, 2
+        addu  $t1, $t1, $s0
+        sw    $t0, 0($t1)
+        addu  $t0, $t0, $k1
+        slt   $t2, $t0, $s1
+        bne   $t2, $zero, fill
+        addu  $t0, $k0, $zero
+        addiu $v1, $zero, 0
+sum:    sll   $t1, $t0, 2
+        addu  $t1, $t1, $s0
+        lw    $t3, 0($t1)
+        addu  $v1, $v1, $t3
+        addu  $t0, $t0, $k1
+        slt   $t2, $t0, $s1
+        bne   $t2, $zero, sum
+        sll   $t1, $k0, 2
+        addu  $t1, $t1, $s0
+        sw    $v1, 8192($t1)        # out[k]
+        addiu $v0, $zero, 10
+        syscall
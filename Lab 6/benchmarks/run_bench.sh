@@ -0,0 +1,49 @@
+#!/bin/sh
+# Runs the benchmark workloads through mu-mips in quiet mode and reports
+# simulated cycles, CPI and host MIPS, checking each final state against
+# its .expect file.
+#
+# Every workload is a <name>.in hex file with its <name>.s source next to it.
+# The sources are hand assembled with the simulator's branch convention:
+# a branch target is the branch's own PC + (offset << 2); delay_slot.s uses
+# the MIPS one instead, see there.
+#
+# A workload written <name>@<key>=<value>,... runs with those simulator
+# options on top of SIM_OPTS: the multi-context kernels (ll_lock, par_sum,
+# torn_word) need 4 cores/threads for their .expect, delay_slot needs
+# delay_slot=1.
+#
+# usage: run_bench.sh <mu-mips binary> [workload ...]
+# SIM_OPTS is passed to the simulator, e.g. SIM_OPTS="-o mshrs=4"
+
+SIM=${1:-../src/mu-mips}
+BENCH_DIR=$(dirname "$0")
+[ $# -gt 0 ] && shift
+WORKLOADS=${*:-"bubble_sort fib_iter fib_rec matmul memcpy list_chase stencil switch
+	ll_lock@cores=4 ll_lock@cores=4,parallel=1 ll_lock@threads=4
+	par_sum@cores=4 par_sum@cores=4,parallel=1 par_sum@threads=4 par_sum@cores=2,threads=2
+	torn_word@cores=4 torn_word@cores=4,parallel=1
+	delay_slot@delay_slot=1"}
+
+printf "%-12s %10s %10s %8s %10s  %s\n" "workload" "cycles" "instrs" "CPI" "host MIPS" "result"
+status=0
+for w in $WORKLOADS; do
+	name=${w%%@*}
+	opts=
+	if [ "$name" != "$w" ]; then
+		opts=$(echo "${w#*@}" | sed 's/^/-o /; s/,/ -o /g')
+	fi
+	out=$(printf 'sim\nverify %s\nquit\n' "$BENCH_DIR/$name.expect" | "$SIM" -q $SIM_OPTS $opts "$BENCH_DIR/$name.in")
+	cycles=$(echo "$out" | sed -n 's/.*# Cycles: \([0-9]*\).*/\1/p')
+	instrs=$(echo "$out" | sed -n 's/.*# Instructions: \([0-9]*\).*/\1/p')
+	cpi=$(echo "$out" | sed -n 's/.*CPI: \([0-9.]*\).*/\1/p')
+	mips=$(echo "$out" | sed -n 's/.*Host MIPS: \([0-9.]*\).*/\1/p')
+	if echo "$out" | grep -q "VERIFY PASSED"; then
+		result=ok
+	else
+		result=MISMATCH
+		status=1
+	fi
+	printf "%-12s %10s %10s %8s %10s  %s\n" "$name" "$cycles" "$instrs" "$cpi" "$mips" "$result${opts:+  $opts}"
+done
+exit $status
@@ -0,0 +1,53 @@
+# stencil -- 5-point Laplacian over a 32x32 word grid at 0x10010000 into 0x10011000,
+# grid filled from an LCG (x = x * 1103515245 + 12345, value = (x >> 16) & 0x3ff).
+# Interior swept column by column, so consecutive points are a 128-byte row apart.
+# Checksum of the output grid in $v1.
+        lui   $s0, 0x1001           # in
+        addiu $s1, $s0, 4096        # out
+        lui   $s4, 0x41c6
+        ori   $s4, $s4, 0x4e6d      # LCG multiplier
+        addiu $s5, $zero, 1         # LCG state
+        addu  $t0, $s0, $zero
+fill:   multu $s5, $s4
+        mflo  $s5
+        addiu $s5, $s5, 12345
+        srl   $t1, $s5, 16
+        andi  $t1, $t1, 1023
+        sw    $t1, 0($t0)
+        addiu $t0, $t0, 4
+        bne   $t0, $s1, fill
+        addiu $s3, $zero, 31        # N - 1
+        addiu $t1, $zero, 1         # c
+st_c:   addiu $t0, $zero, 1         # r
+        sll   $t4, $t1, 2
+        addiu $t4, $t4, 128         # row 1, column c
+        addu  $t5, $t4, $s0         # &in[1][c]
+        addu  $t6, $t4, $s1         # &out[1][c]
+st_r:   lw    $t7, -128($t5)
+        lw    $t8, 128($t5)
+        addu  $t7, $t7, $t8
+        lw    $t8, -4($t5)
+        addu  $t7, $t7, $t8
+        lw    $t8, 4($t5)
+        addu  $t7, $t7, $t8
+        lw    $t8, 0($t5)
+        sll   $t8, $t8, 2
+        subu  $t7, $t7, $t8
+        sw    $t7, 0($t6)
+        addiu $t5, $t5, 128
+        addiu $t6, $t6, 128
+        addiu $t0, $t0, 1
+        bne   $t0, $s3, st_r
+        addiu $t1, $t1, 1
+        bne   $t1, $s3, st_c
+        addiu $v1, $zero, 0         # checksum = checksum * 31 + out[n]
+        addu  $t2, $s1, $zero
+        addiu $t3, $s1, 4096
+sum:    lw    $t4, 0($t2)
+        sll   $t5, $v1, 5
+        subu  $t5, $t5, $v1
+        addu  $v1, $t5, $t4
+        addiu $t2, $t2, 4
+        bne   $t2, $t3, sum
+        addiu $v0, $zero, 10
+        syscall
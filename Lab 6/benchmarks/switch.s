@@ -0,0 +1,38 @@
+# switch -- 1024 iterations of a switch on 3 random bits from an LCG, dispatched
+# through a compare-and-branch chain; per-case counts at 0x10010000, accumulators
+# in $s0-$s3 and $s6. Data-dependent branches that no static scheme predicts.
+        lui   $s7, 0x1001           # case histogram
+        lui   $s4, 0x41c6
+        ori   $s4, $s4, 0x4e6d      # LCG multiplier
+        addiu $s5, $zero, 7         # LCG state
+        addiu $t9, $zero, 1024      # iterations
+        addiu $t1, $zero, 1
+        addiu $t2, $zero, 2
+        addiu $t3, $zero, 3
+loop:   multu $s5, $s4
+        mflo  $s5
+        addiu $s5, $s5, 12345
+        srl   $t0, $s5, 16          # x
+        andi  $t4, $t0, 7           # case
+        sll   $t5, $t4, 2
+        addu  $t5, $t5, $s7
+        lw    $t6, 0($t5)
+        addiu $t6, $t6, 1
+        sw    $t6, 0($t5)           # histogram[case]++
+        beq   $t4, $zero, case0
+        beq   $t4, $t1, case1
+        beq   $t4, $t2, case2
+        beq   $t4, $t3, case3
+        addu  $s6, $s6, $t4         # default
+        j     next
+case0:  addu  $s0, $s0, $t0
+        j     next
+case1:  xor   $s1, $s1, $t0
+        j     next
+case2:  addiu $s2, $s2, 1
+        j     next
+case3:  subu  $s3, $s3, $t0
+next:   addiu $t9, $t9, -1
+        bgtz  $t9, loop
+        addiu $v0, $zero, 10
+        syscall
@@ -0,0 +1,73 @@
+#!/bin/sh
+# Simulator throughput harness: how fast mu-mips itself runs, as opposed to
+# the simulated CPI that run_bench.sh reports.
+#
+# Each workload is run REPS times in quiet mode for every engine and cache
+# model. Host time is the wall time of the 'sim' loop as reported by the
+# simulator, so program loading and start-up are not included. Results go
+# to a JSON file (one record per workload/engine/cache, plus a summary per
+# engine/cache) that can be diffed between builds.
+#
+# usage: throughput.sh <mu-mips binary> [output.json]
+#   REPS, ENGINES, CACHES and WORKLOADS can be overridden from the environment.
+
+SIM=${1:-../src/mu-mips}
+OUT=${2:-throughput.json}
+BENCH_DIR=$(dirname "$0")
+REPS=${REPS:-5}
+ENGINES=${ENGINES:-"pipeline functional"}
+CACHES=${CACHES:-"l1 none"}
+WORKLOADS=${WORKLOADS:-"bubble_sort fib_iter fib_rec matmul memcpy list_chase stencil switch"}
+
+RUNS=$(mktemp)
+trap 'rm -f "$RUNS"' EXIT
+
+for engine in $ENGINES; do
+	for cache in $CACHES; do
+		for w in $WORKLOADS; do
+			rep=0
+			while [ $rep -lt "$REPS" ]; do
+				printf 'sim\nquit\n' | "$SIM" -q -o engine=$engine -o cache=$cache "$BENCH_DIR/$w.in" |
+					sed -n 's/.*# Cycles: \([0-9]*\).*# Instructions: \([0-9]*\).*/\1 \2/p; s/.*Host time: \([0-9.]*\).*/\1/p' |
+					tr '\n' ' ' | awk -v w=$w -v e=$engine -v c=$cache '{ print w, e, c, $1, $2, $3 }' >> "$RUNS"
+				rep=$((rep + 1))
+			done
+		done
+	done
+done
+
+# per workload: best and mean wall time over the repetitions; throughput from the best
+awk -v reps="$REPS" -v build="$(git describe --always --dirty 2>/dev/null)" -v out="$OUT" '
+{
+	key = $1 " " $2 " " $3
+	if (!(key in n)) { order[++keys] = key }
+	n[key]++; cycles[key] = $4; instrs[key] = $5; sum[key] += $6
+	if (!(key in best) || $6 < best[key]) best[key] = $6
+}
+END {
+	printf "{\n  \"build\": \"%s\",\n  \"reps\": %d,\n  \"results\": [\n", build, reps > out
+	printf "%-12s %-10s %-5s %10s %10s %12s %10s %8s\n", "workload", "engine", "cache", "instrs", "cycles", "wall s", "host MIPS", "ns/cyc"
+	for (i = 1; i <= keys; i++) {
+		k = order[i]; split(k, f, " ")
+		mips = best[k] > 0 ? instrs[k] / best[k] / 1e6 : 0
+		nspc = cycles[k] > 0 ? best[k] * 1e9 / cycles[k] : 0
+		printf "    {\"workload\": \"%s\", \"engine\": \"%s\", \"cache\": \"%s\", \"instructions\": %d, \"cycles\": %d, \"wall_s_best\": %.9f, \"wall_s_mean\": %.9f, \"host_mips\": %.3f, \"host_ns_per_cycle\": %.2f}%s\n", \
+			f[1], f[2], f[3], instrs[k], cycles[k], best[k], sum[k] / n[k], mips, nspc, i < keys ? "," : "" > out
+		printf "%-12s %-10s %-5s %10d %10d %12.6f %10.3f %8.2f\n", f[1], f[2], f[3], instrs[k], cycles[k], best[k], mips, nspc
+		g = f[2] " " f[3]
+		if (!(g in gi)) { gorder[++groups] = g }
+		gi[g] += instrs[k]; gc[g] += cycles[k]; gt[g] += best[k]
+	}
+	printf "  ],\n  \"summary\": [\n" > out
+	print ""
+	for (i = 1; i <= groups; i++) {
+		g = gorder[i]; split(g, f, " ")
+		mips = gt[g] > 0 ? gi[g] / gt[g] / 1e6 : 0
+		nspc = gc[g] > 0 ? gt[g] * 1e9 / gc[g] : 0
+		printf "    {\"engine\": \"%s\", \"cache\": \"%s\", \"instructions\": %d, \"cycles\": %d, \"wall_s\": %.9f, \"host_mips\": %.3f, \"host_ns_per_cycle\": %.2f}%s\n", \
+			f[1], f[2], gi[g], gc[g], gt[g], mips, nspc, i < groups ? "," : "" > out
+		printf "%-10s %-5s all workloads: %8.3f host MIPS, %6.2f ns per simulated cycle\n", f[1], f[2], mips, nspc
+	}
+	printf "  ]\n}\n" > out
+}' "$RUNS"
+echo "wrote $OUT"
@@ -0,0 +1,42 @@
+# torn_word -- word atomicity across cores: context 0 stores 200 passes of
+# p * 0x01010101 over the 16 words at 0x10010000 while the other contexts
+# load them until it raises the done flag at 0x10010100, counting every word
+# whose four bytes differ (half old, half new) into torn[k] at 0x10012000.
+# Run with -o cores=<n>, serial or -o parallel=1; the .expect is for 4 cores.
+        lui   $s0, 0x1001
+        bne   $k0, $zero, reader
+        lui   $t0, 0x0101
+        ori   $t0, $t0, 0x0101      # step per pass
+        addiu $s1, $zero, 200       # passes
+        addiu $t1, $zero, 0         # value stored
+pass:   addu  $t1, $t1, $t0
+        addu  $t2, $s0, $zero
+        addiu $t3, $s0, 64
+store:  sw    $t1, 0($t2)
+        addiu $t2, $t2, 4
+        bne   $t2, $t3, store
+        addiu $s1, $s1, -1
+        bne   $s1, $zero, pass
+        sync
+        addiu $t4, $zero, 1
+        sw    $t4, 256($s0)         # done
+        j     exit
+reader: lui   $t0, 0x00FF
+        ori   $t0, $t0, 0xFFFF      # low three bytes
+        addiu $v1, $zero, 0         # torn words seen
+sweep:  lw    $t5, 256($s0)         # done flag, read before the sweep
+        addu  $t2, $s0, $zero
+        addiu $t3, $s0, 64
+load:   lw    $t1, 0($t2)
+        srl   $t6, $t1, 8           # all four bytes equal iff w >> 8 == w & 0xFFFFFF
+        and   $t7, $t1, $t0
+        beq   $t6, $t7, whole
+        addiu $v1, $v1, 1
+whole:  addiu $t2, $t2, 4
+        bne   $t2, $t3, load
+        beq   $t5, $zero, sweep
+        sll   $t1, $k0, 2
+        addu  $t1, $t1, $s0
+        sw    $v1, 8192($t1)        # torn[k]
+exit:   addiu $v0, $zero, 10
+        syscall
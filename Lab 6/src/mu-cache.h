@@ -1,39 +1,487 @@
 /******************************************************************************/
 /* CACHE STRUCTURE                                                            */
 /******************************************************************************/
-#define NUM_CACHE_BLOCKS 16
+#define NUM_CACHE_BLOCKS 16 //default L1Cache: 16 blocks, direct-mapped
 #define WORD_PER_BLOCK 4
+#define CACHE_MISS_PENALTY 100 //default cycles to bring a block in from memory
+#define MAX_CACHE_LEVELS 3
 
+/* tag slots per set are padded to a whole number of vector compares */
+#if defined(__AVX2__)
+#define CACHE_VECTOR_WAYS 8
+#elif defined(__SSE2__)
+#define CACHE_VECTOR_WAYS 4
+#else
+#define CACHE_VECTOR_WAYS 1
+#endif
 
-typedef struct CacheBlock_Struct {
-
-  int valid; //indicates if the given block contains a valid data. Initially, this is 0
-  uint32_t tag; //this field should contain the tag, i.e. the high-order 32 - (2+2+4)  = 24 bits
-  uint32_t words[WORD_PER_BLOCK]; //this is where actual data is stored. Each word is 4-byte long, and each cache block contains 4 blocks.
-  
-  
-} CacheBlock;
-
+/* one level of the hierarchy: set-associative, LRU. Tags and valid bits
+   are kept apart from the data, contiguous per set, so a way lookup is a
+   vector compare over the set's tag slots. */
 typedef struct Cache_Struct {
 
-  CacheBlock blocks[NUM_CACHE_BLOCKS]; // there are 16 blocks in the cache
-  
+  const char *name;
+  uint32_t sets; //0 when the level is not present
+  uint32_t ways;
+  uint32_t block_bytes;
+  uint32_t latency; //cycles to bring a block from this level into the one above
+  uint32_t offset_bits, index_bits;
+  uint32_t stride; //tag slots per set: ways rounded up to CACHE_VECTOR_WAYS
+  uint32_t *tags; //sets x stride, tag + 1, 0 marks an invalid way (and the padding)
+  uint32_t *stamps; //sets x stride, time of last use for LRU
+  uint32_t *words; //sets x ways x block words, only L1Cache keeps data
+  uint8_t *prefetched; //sets x ways, L1Cache only: brought in by a prefetch and not used yet
+  uint32_t *ready; //sets x ways, L1Cache only: cycle a prefetched block arrives
+  uint8_t *mesi; //sets x ways, L1Cache only: MESI state with several cores
+  uint32_t *lost; //sets x ways, L1Cache only: block + 1 another core's write invalidated, 0 if none
+  uint32_t clock;
+  uint32_t hits, misses;
+  uint32_t *set_heat; //sets x HEAT_COUNTERS: accesses, misses, evictions of each set
+  uint32_t *region_heat; //(HEAT_REGIONS + 1) x HEAT_COUNTERS, the same per address region
+
 } Cache;
 
+/* heatmap counters, flat arrays exported with the cachemap command.
+   Regions are HEAT_REGION_BYTES each from MEM_DATA_BEGIN; the last one
+   gathers every address past them or outside the data segment. */
+#define HEAT_ACCESS 0
+#define HEAT_MISS 1
+#define HEAT_EVICT 2
+#define HEAT_COUNTERS 3
+#define HEAT_REGIONS 1024
+uint32_t HEAT_REGION_BITS = 12; //"-o heat_region=<bytes>", power of two, 4 KiB pages by default
+
 
 
 /***************************************************************/
-/* CACHE STATS                                                 */
+/* CACHE OBJECT                                                */
+/* Geometry is set with "-o l1=<bytes>:<ways>:<block>" and     */
+/* "-o l2=/l3=<bytes>:<ways>:<block>:<latency>" (or off).      */
 /***************************************************************/
-uint32_t cache_misses; //need to initialize to 0 at the beginning of simulation start
-uint32_t cache_hits;   //need to initialize to 0 at the beginning of simulation start
+CORE_LOCAL Cache L1Cache = { "L1", NUM_CACHE_BLOCKS, 1, WORD_PER_BLOCK * 4, 0 }; //need to use this in the simulator
+Cache L2Cache = { "L2", 0, 8, 64, 10 };
+Cache L3Cache = { "L3", 0, 16, 64, 30 };
+Cache *CACHE_LEVELS[MAX_CACHE_LEVELS] = { NULL, &L2Cache, &L3Cache }; //level 0 is per thread, see cache_level()
+uint32_t MEMORY_LATENCY = CACHE_MISS_PENALTY; //"-o memory_latency=<cycles>"
+
 
 
 /***************************************************************/
-/* CACHE OBJECT                                                */
+/* DRAM                                                        */
+/* With "-o dram=1" a miss in the last level goes to a DRAM    */
+/* controller instead of costing MEMORY_LATENCY: channels of   */
+/* banks with a row buffer each, open or closed page, and      */
+/* FR-FCFS scheduling (row hits first, then oldest) over the   */
+/* write-buffer drains queued at the controller and the read   */
+/* being served. Reads are scheduled as they arrive, so their  */
+/* latency is known at once; writes are posted.                */
+/* Above a burst offset the address splits into DRAM_MAP's     */
+/* fields, e.g. "row:bank:channel:column" keeps a row's        */
+/* columns together for streams to hit in.                     */
+/***************************************************************/
+#define MAX_DRAM_CHANNELS 8
+#define MAX_DRAM_BANKS 32
+#define DRAM_QUEUE 32 //posted writes per channel
+#define DRAM_BURST_BYTES 64 //one column access moves this much
+
+#define DRAM_OPEN_PAGE 0 //rows stay open for the next access to hit
+#define DRAM_CLOSED_PAGE 1 //rows are precharged after every access
+
+#define DRAM_ROW 0 //address fields
+#define DRAM_BANK 1
+#define DRAM_CHANNEL 2
+#define DRAM_COLUMN 3
+#define DRAM_FIELDS 4
+
+typedef struct DRAMBank_Struct {
+
+  uint32_t row; //open row, valid with open set
+  int open;
+  uint32_t ready; //cycle the bank takes its next command
+
+} DRAMBank;
+
+typedef struct DRAMRequest_Struct {
+
+  uint32_t bank, row;
+  uint32_t arrival;
+
+} DRAMRequest;
+
+typedef struct DRAMChannel_Struct {
+
+  DRAMBank banks[MAX_DRAM_BANKS];
+  uint32_t bus_free; //cycle the data bus is free
+  DRAMRequest queue[DRAM_QUEUE]; //posted writes, oldest first
+  int queued;
+
+} DRAMChannel;
+
+typedef struct DRAMStats_Struct {
+
+  uint32_t reads, writes;
+  uint32_t row_hits; //row already open
+  uint32_t row_misses; //bank precharged, row opened
+  uint32_t row_conflicts; //another row open, precharged first
+  uint32_t reordered; //requests served ahead of an older one
+  uint64_t read_cycles; //summed read latency
+
+} DRAMStats;
+
+int DRAM_ENABLED = 0; //"-o dram=1"
+int DRAM_CHANNELS = 1; //"-o dram_channels=<n>", power of two
+int DRAM_BANKS = 8; //"-o dram_banks=<n>" per channel, power of two
+uint32_t DRAM_ROW_BYTES = 2048; //"-o dram_row=<bytes>" per bank, power of two
+int DRAM_PAGE_POLICY = DRAM_OPEN_PAGE; //"-o dram_page=open|closed"
+int DRAM_MAP[DRAM_FIELDS] = { DRAM_COLUMN, DRAM_CHANNEL, DRAM_BANK, DRAM_ROW }; //"-o dram_map=row:bank:channel:column", kept low field first
+uint32_t DRAM_T_CAS = 25, DRAM_T_RCD = 25, DRAM_T_RP = 25, DRAM_T_BURST = 10; //"-o dram_timing=<tCAS>:<tRCD>:<tRP>:<burst>[:<overhead>]", CPU cycles
+uint32_t DRAM_OVERHEAD = 20; //controller and interconnect, there and back
+DRAMChannel DRAM[MAX_DRAM_CHANNELS];
+DRAMStats DRAM_STATS;
+
+/***************************************************************/
+/* MSHRS                                                       */
+/* With NUM_MSHRS > 0 the L1 is non-blocking: a miss takes an  */
+/* MSHR instead of freezing the pipeline, later misses to the  */
+/* same block merge into it, hits go ahead, and only an        */
+/* instruction reading the loaded register waits for it. The   */
+/* pipeline freezes only when every MSHR is busy.              */
+/***************************************************************/
+#define MAX_MSHRS 32
+
+typedef struct MSHR_Struct {
+
+  uint32_t block; //L1 block address being fetched
+  uint32_t ready; //cycle the block arrives, the MSHR is busy until then
+
+} MSHR;
+
+typedef struct MSHRStats_Struct {
+
+  uint32_t primary; //misses that took an MSHR
+  uint32_t secondary; //misses merged into an outstanding MSHR
+  uint32_t full_stalls; //misses that found every MSHR busy
+  uint32_t full_cycles; //cycles frozen waiting for a free MSHR
+  uint32_t dependency_cycles; //cycles an instruction waited on a missing load
+  uint32_t busy_cycles; //cycles with at least one miss outstanding
+  uint64_t occupancy; //sum over those cycles of the misses outstanding
+
+} MSHRStats;
+
+int NUM_MSHRS = 0; //"-o mshrs=<n>", 0 for the blocking cache
+CORE_LOCAL MSHR MSHRS[MAX_MSHRS];
+CORE_LOCAL MSHRStats MSHR_STATS;
+CORE_LOCAL uint32_t REG_READY[32]; //first cycle a register's pending load can be used, 0 if none
+CORE_LOCAL uint32_t DATA_READY; //same for the data of the last cache_reads
+
+/***************************************************************/
+/* WRITE BUFFER                                                */
+/* With WRITE_BUFFER_DEPTH > 0 stores no longer wait for       */
+/* memory: a store updates L1Cache only on a hit (no write     */
+/* allocate) and is queued here. Stores to a block still in    */
+/* the buffer coalesce into its entry; entries drain in order, */
+/* one block per WRITE_BUFFER_DRAIN cycles. A load missing in  */
+/* L1Cache whose word is buffered is forwarded from it. A      */
+/* store finding the buffer full freezes the pipeline until    */
+/* the oldest entry drains.                                    */
+/***************************************************************/
+#define MAX_WRITE_BUFFER 32
+
+typedef struct WriteBufferEntry_Struct {
+
+  uint32_t block; //L1 block address
+  uint64_t words; //bit per word written, for forwarding (first 64 words of a block)
+  uint32_t done; //cycle the block is in memory and the entry frees up
+
+} WriteBufferEntry;
+
+typedef struct WriteBufferStats_Struct {
+
+  uint32_t stores; //stores through the buffer
+  uint32_t coalesced; //of those, merged into an entry already there
+  uint32_t forwarded; //L1 load misses served from the buffer
+  uint32_t full_stalls; //stores that found the buffer full
+  uint32_t full_cycles; //cycles frozen waiting for an entry to drain
+
+} WriteBufferStats;
+
+int WRITE_BUFFER_DEPTH = 0; //"-o write_buffer=<entries>", 0 for stores that stall on a miss
+int WRITE_BUFFER_DRAIN = 10; //"-o write_buffer_drain=<cycles>" memory takes per block
+CORE_LOCAL WriteBufferEntry WRITE_BUFFER[MAX_WRITE_BUFFER]; //oldest first
+CORE_LOCAL int WRITE_BUFFER_COUNT;
+CORE_LOCAL WriteBufferStats WRITE_BUFFER_STATS;
+
+/***************************************************************/
+/* VICTIM CACHE                                                */
+/* A few fully associative blocks beside L1Cache holding the   */
+/* blocks it evicts (Jouppi). An L1 miss that finds its block  */
+/* here swaps the two in VICTIM_LATENCY cycles instead of      */
+/* going below L1. The cache is write-through, so entries are  */
+/* block addresses only and the swap reloads the data words.   */
+/***************************************************************/
+#define MAX_VICTIM_BLOCKS 16
+
+typedef struct VictimCache_Struct {
+
+  uint32_t blocks[MAX_VICTIM_BLOCKS]; //L1 block address + 1, 0 marks an empty entry
+  uint32_t stamps[MAX_VICTIM_BLOCKS]; //LRU order among the entries
+  uint32_t clock;
+  uint32_t hits; //L1 misses served by a swap
+  uint32_t misses; //L1 misses that had to go below L1
+  uint32_t evictions; //L1 blocks taken in
+
+} VictimCache;
+
+int VICTIM_BLOCKS = 0; //"-o victim=<blocks>", 0 for no victim cache
+int VICTIM_LATENCY = 1; //"-o victim_latency=<cycles>" for a swap
+CORE_LOCAL VictimCache VICTIM;
+
 /***************************************************************/
-Cache L1Cache; //need to use this in the simulator
+/* PREFETCHERS                                                 */
+/* Hooked into every demand access to L1Cache. Prefetches go   */
+/* through one issue port taking a request every               */
+/* PREFETCH_INTERVAL cycles behind a queue of PREFETCH_QUEUE;  */
+/* a request finding the queue full is dropped. Next-line and  */
+/* stride prefetch into L1Cache, stream buffers hold their     */
+/* blocks until a miss claims them.                            */
+/***************************************************************/
+#define PREFETCH_NONE 0
+#define PREFETCH_NEXTLINE 1 //next N blocks after a miss or a first use of a prefetched block
+#define PREFETCH_STRIDE 2 //reference prediction table indexed by load/store PC
+#define PREFETCH_STREAM 3 //stream buffers, N blocks deep, allocated on misses
+#define RPT_ENTRIES 64
+#define STREAM_BUFFERS 4
+#define MAX_PREFETCH_DEGREE 16
+
+#define RPT_INITIAL 0 //stride states, as in Chen and Baer
+#define RPT_TRANSIENT 1
+#define RPT_STEADY 2
+#define RPT_NO_PRED 3
+
+typedef struct RPTEntry_Struct {
+
+  uint32_t pc; //load/store owning the entry, 0 if free
+  uint32_t last_addr;
+  int32_t stride;
+  int state;
+
+} RPTEntry;
+
+typedef struct StreamBuffer_Struct {
+
+  uint32_t blocks[MAX_PREFETCH_DEGREE]; //L1 block addresses, oldest first
+  uint32_t ready[MAX_PREFETCH_DEGREE]; //cycle each block arrives, 0 if it was dropped
+  int count;
+  uint32_t stamp; //last use, for LRU allocation
+
+} StreamBuffer;
+
+typedef struct PrefetchStats_Struct {
+
+  uint32_t issued; //requests sent below L1
+  uint32_t dropped; //found the queue full
+  uint32_t redundant; //block already in L1Cache (or the stream buffer)
+  uint32_t useful; //demand accesses served by a prefetched block
+  uint32_t late; //of those, accesses that still had to wait for it
+  uint32_t useless; //prefetched blocks evicted or discarded unused
+
+} PrefetchStats;
+
+int PREFETCHER = PREFETCH_NONE; //"-o prefetch=none|nextline|stride|stream"
+int PREFETCH_DEGREE = 4; //"-o prefetch_degree=<n>": lines ahead, stride distance, stream buffer depth
+int PREFETCH_QUEUE = 8; //"-o prefetch_queue=<n>"
+int PREFETCH_INTERVAL = 4; //"-o prefetch_interval=<cycles>" between issues
+CORE_LOCAL uint32_t PREFETCH_PORT_FREE; //cycle the issue port takes its next request
+CORE_LOCAL uint32_t ACCESS_PC; //load/store being serviced, for the stride prefetcher
+CORE_LOCAL uint32_t PREFETCH_TRIGGER; //LRU stamp of the demand access that triggered the prefetches
+CORE_LOCAL RPTEntry RPT[RPT_ENTRIES];
+CORE_LOCAL StreamBuffer STREAMS[STREAM_BUFFERS];
+CORE_LOCAL PrefetchStats PREFETCH_STATS;
+
+#define CACHE_MODEL_NONE 0 //loads and stores go straight to memory, never miss
+#define CACHE_MODEL_L1 1 //L1Cache, backed by L2Cache/L3Cache when they are configured
+int CACHE_MODEL = CACHE_MODEL_L1;
+
+
+
+/***************************************************************/
+/* 3C MISS CLASSIFICATION                                      */
+/* With "-o threec=1" every demand miss of a level is sorted:  */
+/* compulsory on the first touch of its block (sparse bitmap), */
+/* capacity if a fully associative LRU cache of the same size  */
+/* would miss too (shadow model), conflict otherwise.          */
+/***************************************************************/
+#define THREEC_PAGE_BITS 15 //blocks per bitmap page, 4 KB of bits
+
+typedef struct ThreeC_Struct {
+
+  uint32_t compulsory, capacity, conflict;
+  uint64_t **seen; //bitmap of blocks touched, pages allocated on first touch
+  uint32_t seen_pages;
+
+  /* shadow fully associative LRU cache: lines in a doubly linked LRU
+     list, found through a chained hash of block addresses */
+  uint32_t lines;
+  uint32_t used;
+  uint32_t *block; //block address per line
+  uint32_t *prev, *next; //LRU list, most recent first, THREEC_NONE at the ends
+  uint32_t *chain; //next line in the same hash bucket
+  uint32_t *buckets; //first line of each bucket
+  uint32_t hash_bits;
+  uint32_t head, tail;
+
+} ThreeC;
+
+#define THREEC_NONE 0xFFFFFFFF
+
+int THREEC_ENABLED = 0; //"-o threec=1" or "set threec 1"
+CORE_LOCAL ThreeC THREEC[MAX_CACHE_LEVELS]; //level 0 is the current core's, the others are only used by core 0's thread
+
+/***************************************************************/
+/* STACK DISTANCE PROFILE                                      */
+/* One pass over the data accesses gives the LRU miss ratio of */
+/* every power-of-two cache size and associativity (Mattson).  */
+/* Block size is the L1Cache block size.                       */
+/***************************************************************/
+#define SD_MAX_SET_BITS 10 //set counts 1 .. 1024
+#define SD_MAX_WAY_BITS 5 //per-set LRU stacks kept up to 32 ways
+#define SD_WAYS (1 << SD_MAX_WAY_BITS)
+#define SD_BUCKETS 34 //distance buckets: 0 for distance 0, b for [2^(b-1), 2^b), last for first touches
+#define REUSE_FIRST 0xFFFFFFFF //reuse_access result for a block's first touch
+
+/* reuse distances of one stream of block addresses: the number of
+   distinct blocks since the last access to the same block, exact, in
+   O(log n) per access from a Fenwick tree over access times holding a 1
+   at the latest access to each block, and a hash of block -> latest time.
+   With window set it also counts the distinct blocks of every window of
+   that many accesses: the working set over time. */
+typedef struct ReuseProfile_Struct {
+
+  uint64_t accesses;
+  uint32_t *tree;
+  uint32_t tree_size;
+  uint32_t *hash_block; //block number + 1, 0 marks an empty slot
+  uint32_t *hash_time;
+  uint32_t hash_size; //power of two
+  uint32_t hash_used;
+  uint64_t histogram[SD_BUCKETS];
+
+  uint32_t window; //accesses per window, 0 for no working-set tracking
+  uint32_t window_start; //time of the last access before the current window
+  uint32_t window_blocks; //distinct blocks so far in the current window
+  uint32_t *windows; //distinct blocks of every finished window
+  uint32_t window_count, window_capacity;
+
+} ReuseProfile;
+
+typedef struct StackDistance_Struct {
+
+  int enabled; //set with "-o stackdist=1" or "set stackdist 1"
+
+  /* fully associative */
+  ReuseProfile full;
+
+  /* set-associative: an LRU stack of SD_WAYS blocks per set, for 2^k sets */
+  uint32_t *stacks[SD_MAX_SET_BITS + 1]; //block number + 1, most recent first
+  uint64_t sets[SD_MAX_SET_BITS + 1][SD_MAX_WAY_BITS + 2]; //distance buckets, last is beyond SD_WAYS
+
+} StackDistance;
+
+StackDistance STACK_DIST;
+
+/* reuse-distance and working-set profile of the data and the
+   instruction fetch streams, "-o reuse=1" */
+int REUSE_ENABLED = 0;
+uint32_t REUSE_WINDOW = 1024; //"-o reuse_window=<accesses>"
+ReuseProfile REUSE_DATA;
+ReuseProfile REUSE_FETCH;
+
+
+
+/***************************************************************/
+/* BATCHED CACHES                                              */
+/* BATCH_LANES independent direct-mapped caches, one per       */
+/* vector lane, fed the same data accesses. Tags are kept      */
+/* structure-of-arrays: each lane's stored tag is loaded into  */
+/* a vector and checked with one AVX2 compare, or two SSE2     */
+/* compares; hosts without SSE2 fall back to the scalar loop.  */
+/***************************************************************/
+#define BATCH_LANES 8
+#define BATCH_MAX_SETS 4096 //index widths up to 12 bits
+
+typedef struct BatchCache_Struct {
+
+  int enabled; //set with "-o batch=1" or "set batch 1"
+  uint32_t offset_bits[BATCH_LANES]; //block size 2^offset_bits bytes
+  uint32_t index_bits[BATCH_LANES]; //2^index_bits sets
+  uint32_t tags[BATCH_LANES][BATCH_MAX_SETS]; //tag + 1, 0 marks an invalid block
+  uint32_t hits[BATCH_LANES];
+  uint32_t accesses;
+
+} BatchCache;
+
+BatchCache BATCH;
 
 void cache_miss_rate();
+void cache_init();
+Cache *cache_level(int level);
+void cache_alloc(Cache *cache, int data);
+void cache_flush(Cache *cache);
+int cache_configure(Cache *cache, char *value);
+int cache_lookup(Cache *cache, uint32_t set, uint32_t tag);
+void cache_heat(Cache *cache, uint32_t set, uint32_t addr, int counter);
+void cache_map(char *filename);
+int cache_victim(Cache *cache, uint32_t set);
+int cache_fill(Cache *cache, uint32_t set, uint32_t tag);
+uint32_t cache_below(int level, uint32_t addr, uint32_t arrival);
+void dram_reset();
+void dram_decode(uint32_t addr, uint32_t *channel, uint32_t *bank, uint32_t *row);
+uint32_t dram_issue(DRAMChannel *channel, uint32_t bank, uint32_t row, uint32_t arrival);
+uint32_t dram_probe(uint32_t addr);
+uint32_t dram_read(uint32_t addr, uint32_t arrival);
+void dram_write(uint32_t addr, uint32_t arrival);
+int dram_parse_map(char *value);
+void dram_print();
+uint32_t cache_hierarchy(uint32_t addr, int write, uint32_t *line, uint32_t *ready);
+uint32_t cache_access(uint32_t addr);
+void cache_wait(uint32_t ready);
+void cache_miss(uint32_t addr, uint32_t cycles);
+void mshr_merge(uint32_t addr);
+void mshr_reset();
+void mshr_cycle();
+int mshr_wait(uint32_t instruction, uint32_t cycle);
+void write_buffer_reset();
+void write_buffer_retire();
+void write_buffer_store(uint32_t addr);
+int write_buffer_forward(uint32_t addr);
+void write_buffer_print();
+void threec_reset();
+void threec_alloc(ThreeC *three, Cache *cache);
+void threec_access(int level, uint32_t block, int hit, int allocate);
+void threec_print(int level);
+void victim_reset();
+int victim_lookup(uint32_t block);
+void victim_insert(uint32_t block);
+void victim_print();
+void prefetch_reset();
+int prefetch_slot(uint32_t *issue);
+void prefetch_issue(uint32_t addr);
+void prefetch_access(uint32_t pc, uint32_t addr, int hit);
+void stream_fill(StreamBuffer *stream, uint32_t block);
+int stream_lookup(uint32_t addr, uint32_t *ready);
+void prefetch_print();
+void profile_access(uint32_t addr);
+void batch_reset();
+void batch_access(uint32_t addr);
+void batch_print();
+void reuse_reset(ReuseProfile *profile, uint32_t window);
+uint32_t reuse_access(ReuseProfile *profile, uint32_t block);
+uint32_t reuse_needed(ReuseProfile *profile, double share);
+void reuse_windows(const char *name, ReuseProfile *profile);
+void reuse_print();
+void profile_fetch(uint32_t pc);
+void stackdist_reset();
+void stackdist_access(uint32_t addr);
+void stackdist_print();
 void cache_write_32(uint32_t addr, uint32_t new);
 uint32_t cache_read_32(uint32_t addr);
\ No newline at end of file
@@ -0,0 +1,266 @@
+/******************************************************************************/
+/* MULTI-CORE                                                                 */
+/* With "-o cores=<n>" n cores run the loaded program side by side, each with */
+/* its own registers, pipeline and L1Cache (with its MSHRs, write buffer,     */
+/* victim cache and prefetcher), sharing L2Cache/L3Cache, DRAM and memory.    */
+/* The stages work on the globals, so every cycle each running core's context */
+/* is swapped into them, stepped, and swapped back out. Core i starts with    */
+/* $k0 = i and $k1 = n to split the work between the cores by.                */
+/******************************************************************************/
+#define MAX_CORES 8
+
+/* MESI states of an L1 line, kept coherent by snooping the other L1s on
+   every miss and on writes to lines that are not held exclusively. The
+   L1s are write-through, so Modified only means no other L1 has a copy:
+   memory is always current and a dirty owner never has to write back. */
+#define MESI_INVALID 0
+#define MESI_SHARED 1
+#define MESI_EXCLUSIVE 2
+#define MESI_MODIFIED 3
+
+typedef struct CoherenceStats_Struct {
+
+  uint32_t bus_reads; //BusRd: read misses
+  uint32_t bus_read_exclusive; //BusRdX: write misses
+  uint32_t bus_upgrades; //BusUpgr: writes to a Shared line
+  uint32_t invalidations_sent; //copies invalidated in other L1s
+  uint32_t invalidations_received; //copies of this L1 invalidated by other cores
+  uint32_t transfers; //misses served cache-to-cache by an Exclusive or Modified owner
+  uint32_t coherence_misses; //misses on a block another core's write invalidated here
+
+} CoherenceStats;
+
+/* LL/SC and SYNC. LL links the core to the L1 block it loads from; a
+   store by another core to that block breaks the link, and SC then
+   fails, writing 0 to rt without storing. SYNC holds the core in MEM
+   until its write buffer has drained and its misses have come in. */
+#define OP_LL 0b110000
+#define OP_SC 0b111000
+#define FUNCT_SYNC 0b001111
+
+typedef struct SyncStats_Struct {
+
+  uint32_t ll, sc;
+  uint32_t sc_failures; //SCs that found the link broken
+  uint32_t link_breaks; //links broken by other cores' stores
+  uint64_t spin_cycles; //first LL to the SC that succeeds, summed over successful SCs
+  uint32_t syncs;
+  uint32_t sync_cycles; //cycles SYNC held the core
+
+} SyncStats;
+
+CORE_LOCAL uint32_t LL_LINK; //L1 block address + 1 of the current core's link, 0 if none
+CORE_LOCAL uint32_t SPIN_START; //cycle of the first LL since the last successful SC, 0 if none
+CORE_LOCAL SyncStats SYNC_STATS;
+
+/* everything the stages keep in globals for one core, saved between cycles */
+typedef struct Core_Struct {
+
+  int running; //RUN_FLAG
+  uint32_t instructions; //retired by this core
+  CPU_State current, next;
+  CPU_Pipeline_Reg if_id, id_ex, ex_mem, mem_wb;
+  CPU_Pipeline_Reg slots[MAX_ISSUE_WIDTH][4]; //SLOTS, with ISSUE_WIDTH > 1
+  CPU_Pipeline_Reg front_pipe[2 * (MAX_PIPE_STAGES - 1)], mem_pipe[MAX_PIPE_STAGES - 1];
+  int stall_count, flush_flag;
+  uint32_t cache_miss_flag, cache_stall_count;
+  IssueStats issue; //kept here, not in the globals
+  DepthStats depth; //here too
+  DelaySlotStats delay;
+  uint32_t hi_lo_ready, mult_free, div_free;
+  MulDivStats muldiv; //here too
+
+  Cache l1; //core 0's arrays are the ones cache_init allocates for L1Cache
+  ThreeC threec; //level 0 only, the others are shared
+  MSHR mshrs[MAX_MSHRS];
+  MSHRStats mshr_stats;
+  uint32_t reg_ready[32], data_ready;
+  WriteBufferEntry write_buffer[MAX_WRITE_BUFFER];
+  int write_buffer_count;
+  WriteBufferStats write_buffer_stats;
+  VictimCache victim;
+  RPTEntry rpt[RPT_ENTRIES];
+  StreamBuffer streams[STREAM_BUFFERS];
+  PrefetchStats prefetch_stats;
+  uint32_t prefetch_port_free;
+
+  uint32_t ll_link, ll_version, spin_start;
+  SyncStats sync_stats;
+
+  CoherenceStats coherence;
+
+} Core;
+
+int NUM_CORES = 1; //"-o cores=<n>"
+CORE_LOCAL int CURRENT_CORE = 0; //the core whose context is in the globals
+uint32_t COHERENCE_LATENCY = 20; //"-o coherence_latency=<cycles>" for a cache-to-cache transfer or an upgrade
+Core CORES[MAX_CORES];
+
+void core_init();
+void core_caches();
+void core_save(int i);
+void core_load(int i);
+void core_switch(int i);
+void core_cycle();
+int coherence_miss(uint32_t block, int write, uint32_t *cycles);
+uint32_t coherence_write_hit(uint32_t set, int way, uint32_t block);
+void coherence_invalidate(int i, uint32_t set, int way, uint32_t block);
+void core_print();
+void sync_link(uint32_t addr);
+uint32_t sync_store_conditional(uint32_t pc, uint32_t addr, uint32_t value);
+void sync_store(uint32_t addr);
+void sync_wait();
+void sync_print();
+
+/******************************************************************************/
+/* HOST-PARALLEL CORES                                                        */
+/* With "-o parallel=1" each core runs on its own host thread (core 0 on the  */
+/* main one) for a quantum of cycles at a time, and the threads meet at a     */
+/* barrier between quanta. Inside a quantum a core only changes its own L1:   */
+/* an access below it gets the latency of a read-only look at L2/L3/DRAM and  */
+/* is logged, and at the barrier core 0's thread replays every core's log in  */
+/* cycle order against the shared levels (bound, then weave). Coherence goes  */
+/* core to core through lock-free single-producer rings and takes effect when */
+/* the receiver next drains its rings, every cycle. How late that is depends  */
+/* on the host, so parallel runs are not repeatable: the default lockstep     */
+/* "-o parallel=0" is the deterministic mode.                                 */
+/******************************************************************************/
+#define COHERENCE_RING 1024 //events per ring, a power of two
+#define COHERENCE_INVALIDATE 0
+#define COHERENCE_DOWNGRADE 1
+#define SYNC_BUCKETS 4096 //store versions, by L1 block
+#define OWNER_BUCKETS 4096
+
+typedef struct CoherenceEvent_Struct {
+
+  uint32_t block;
+  uint32_t type;
+
+} CoherenceEvent;
+
+/* one sender to one receiver: only the sender moves tail, only the receiver head */
+typedef struct CoherenceRing_Struct {
+
+  uint32_t head __attribute__((aligned(64)));
+  uint32_t tail __attribute__((aligned(64)));
+  CoherenceEvent events[COHERENCE_RING];
+
+} CoherenceRing;
+
+/* an access below L1 made inside a quantum, for the weave */
+typedef struct UncoreEvent_Struct {
+
+  uint32_t arrival;
+  uint32_t addr;
+  uint32_t level; //cache_below's first level, 0 for a dram_write
+
+} UncoreEvent;
+
+typedef struct UncoreLog_Struct {
+
+  UncoreEvent *events;
+  uint32_t count, size;
+
+} UncoreLog;
+
+typedef struct ParallelRun_Struct {
+
+  uint32_t start, limit; //cycles
+  uint32_t until; //end of the current quantum
+  uint32_t arrived; //worker threads at the barrier
+  uint32_t generation; //quanta started
+  int stop;
+  uint32_t halted[MAX_CORES]; //cycle after each core's last one
+  uint32_t instructions[MAX_CORES];
+
+} ParallelRun;
+
+int PARALLEL = 0; //"-o parallel=1"
+uint32_t QUANTUM = 1000; //"-o quantum=<cycles>" between barriers
+CORE_LOCAL int IN_QUANTUM; //on the threads of a parallel run, outside the weave
+CoherenceRing COHERENCE_RINGS[MAX_CORES][MAX_CORES]; //[from][to]
+UncoreLog UNCORE_LOGS[MAX_CORES];
+ParallelRun PARALLEL_RUN;
+uint32_t SYNC_VERSIONS[SYNC_BUCKETS]; //bumped by every store to the bucket, odd while one is under way
+uint8_t OWNERS[OWNER_BUCKETS]; //by L1 block: core + 1 last known to hold it Exclusive or Modified, else 0
+CORE_LOCAL uint32_t LL_VERSION; //the version LL saw: SC stores only if it is unchanged
+CORE_LOCAL uint32_t *SYNC_HELD; //bucket locked by the current thread's store
+
+int parallel_ready();
+void parallel_run(uint32_t cycles);
+void *parallel_thread(void *arg);
+void parallel_loop(int i);
+int parallel_barrier(int i, uint32_t *generation);
+void parallel_weave();
+uint32_t uncore_access(int level, uint32_t addr, uint32_t arrival);
+void uncore_log(int level, uint32_t addr, uint32_t arrival);
+void coherence_post(uint32_t block, uint32_t type);
+void coherence_drain();
+void coherence_receive(int from, CoherenceEvent *event);
+uint32_t *sync_bucket(uint32_t addr);
+void sync_lock(uint32_t addr);
+void sync_unlock();
+uint32_t sync_load_linked(uint32_t addr);
+
+/******************************************************************************/
+/* HARDWARE MULTITHREADING                                                    */
+/* With "-o threads=<n>" every core holds n thread contexts (registers, PC,   */
+/* pipeline registers, pending loads and LL link) that take turns on its one  */
+/* pipeline, L1Cache, MSHRs, write buffer and prefetcher. Each cycle one      */
+/* thread steps its pipeline: the next ready one in turn ("fine"), or the     */
+/* same one until it misses or has had switch_timeout cycles ("miss", the     */
+/* timeout keeping a spinning thread from locking out the rest), a switch     */
+/* costing switch_penalty idle cycles. A thread waiting on a blocking miss is */
+/* not ready, and the wait runs down while the others issue. Thread t of core */
+/* c starts with $k0 = c * n + t and $k1 = cores * n.                         */
+/******************************************************************************/
+#define MAX_THREADS 8
+#define THREAD_FINE 0 //round robin, a different thread every cycle
+#define THREAD_MISS 1 //switch on a miss
+
+/* what a thread keeps apart from the core's other threads */
+typedef struct HWThread_Struct {
+
+  int running;
+  uint32_t instructions; //retired by this thread
+  uint32_t issue_cycles; //cycles it had the pipeline
+  CPU_State current, next;
+  CPU_Pipeline_Reg if_id, id_ex, ex_mem, mem_wb;
+  CPU_Pipeline_Reg slots[MAX_ISSUE_WIDTH][4];
+  CPU_Pipeline_Reg front_pipe[2 * (MAX_PIPE_STAGES - 1)], mem_pipe[MAX_PIPE_STAGES - 1];
+  int stall_count, flush_flag;
+  uint32_t cache_miss_flag, cache_stall_count;
+  uint32_t reg_ready[32], data_ready;
+  uint32_t hi_lo_ready; //the multiplier and divider are the core's
+  uint32_t ll_link, ll_version, spin_start;
+
+} HWThread;
+
+/* the threads of one core; the current one's context is the core's */
+typedef struct ThreadSet_Struct {
+
+  int current; //thread in the globals (or in CORES[] with the rest of the core)
+  int missed; //the current thread has just missed, switch-on-miss moves on
+  uint32_t switch_wait; //idle cycles left of a switch
+  uint32_t run_cycles; //the current thread's since it was switched to
+  uint32_t switches;
+  uint32_t idle_cycles; //no thread ready to issue
+  HWThread thread[MAX_THREADS];
+
+} ThreadSet;
+
+int NUM_THREADS = 1; //"-o threads=<n>" per core
+int THREAD_POLICY = THREAD_FINE; //"-o thread_policy=fine|miss"
+uint32_t SWITCH_PENALTY = 3; //"-o switch_penalty=<cycles>" to refill the pipeline after a switch on a miss
+uint32_t SWITCH_TIMEOUT = 1000; //"-o switch_timeout=<cycles>" a thread runs without missing before switch-on-miss moves on
+ThreadSet THREADS[MAX_CORES];
+
+void thread_init();
+void thread_save(HWThread *thread);
+void thread_load(HWThread *thread);
+void thread_switch(int t);
+int thread_ready(int t);
+int thread_pick();
+void thread_cycle();
+void thread_step();
+void thread_print();
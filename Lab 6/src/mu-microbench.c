@@ -0,0 +1,318 @@
+/******************************************************************************/
+/* Microbenchmarks for the simulator's own hot functions.                     */
+/*                                                                            */
+/* Built with the whole simulator (mu-mips.c) minus its main, so every        */
+/* function is measured exactly as the simulator runs it. Each benchmark      */
+/* runs OPS operations per sample over a pre-built synthetic stream and       */
+/* reports ns/op (mean, standard deviation and best of SAMPLES samples),      */
+/* plus hardware cycles/op from perf_event or rdtsc when available.           */
+/*                                                                            */
+/* usage: mu-microbench [program for the cycle() benchmark]                   */
+/******************************************************************************/
+#define MU_MIPS_NO_MAIN
+#include "mu-mips.c"
+
+#include <math.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define OPS 65536 //operations per sample
+#define SAMPLES 15
+#define STREAM_LEN 4096 //addresses per synthetic stream, must be a power of two
+
+/* synthetic access streams over the data segment */
+#define STREAM_SEQUENTIAL 0
+#define STREAM_STRIDED 1
+#define STREAM_RANDOM 2
+#define STREAM_CONFLICT 3
+#define NUM_STREAMS 4
+const char *stream_names[NUM_STREAMS] = { "sequential", "strided", "random", "conflict" };
+uint32_t streams[NUM_STREAMS][STREAM_LEN];
+
+volatile uint32_t sink; //keeps results alive so the loops are not optimized away
+
+/***************************************************************/
+/* Hardware cycle counter: perf_event if the kernel allows it,      */
+/* otherwise the time stamp counter, otherwise none                  */
+/***************************************************************/
+int perf_fd = -1;
+const char *counter_name = "none";
+
+void open_cycle_counter() {
+#if defined(__linux__) && defined(PERF_COUNT_HW_CPU_CYCLES)
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_CPU_CYCLES;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	perf_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+	if (perf_fd >= 0) {
+		ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+		counter_name = "perf_event";
+		return;
+	}
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+	counter_name = "rdtsc";
+#endif
+}
+
+uint64_t read_cycle_counter() {
+#if defined(__linux__)
+	if (perf_fd >= 0) {
+		uint64_t count = 0;
+		if (read(perf_fd, &count, sizeof(count)) != sizeof(count)) {
+			return 0;
+		}
+		return count;
+	}
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+/***************************************************************/
+/* Address streams. Strided steps one cache block past the         */
+/* previous one, conflict cycles through tags that all map to the   */
+/* same L1Cache index.                                               */
+/***************************************************************/
+void build_streams() {
+	uint32_t i;
+	uint32_t lcg = 12345;
+	uint32_t cache_bytes = NUM_CACHE_BLOCKS * WORD_PER_BLOCK * 4;
+	for (i = 0; i < STREAM_LEN; i++) {
+		streams[STREAM_SEQUENTIAL][i] = MEM_DATA_BEGIN + i * 4;
+		streams[STREAM_STRIDED][i] = MEM_DATA_BEGIN + i * (WORD_PER_BLOCK * 4 + 4);
+		lcg = lcg * 1103515245 + 12345;
+		streams[STREAM_RANDOM][i] = MEM_DATA_BEGIN + ((lcg >> 8) & 0xFFFC); //64 KB window
+		streams[STREAM_CONFLICT][i] = MEM_DATA_BEGIN + (i % 8) * cache_bytes + (i / 8 % WORD_PER_BLOCK) * 4;
+	}
+}
+
+/* a mix of encodings covering every class the decode helpers sort out */
+uint32_t instruction_mix[] = {
+	0x8E280000, /* LW */      0xAE280004, /* SW */     0x80280001, /* LB */      0xA0280002, /* SB */
+	0x24080005, /* ADDIU */   0x3C111001, /* LUI */    0x31080FFF, /* ANDI */    0x29280010, /* SLTI */
+	0x01095021, /* ADDU */    0x01095022, /* SUB */    0x01090018, /* MULT */    0x00005012, /* MFLO */
+	0x00084080, /* SLL */     0x03E00008, /* JR */     0x0100F809, /* JALR */    0x0000000C, /* SYSCALL */
+	0x1509FFF1, /* BNE */     0x11000008, /* BEQ */    0x1A000008, /* BLEZ */    0x0810002C, /* J */
+	0x0C100008, /* JAL */     0x05010004, /* BGEZ */   0x01095025, /* OR */      0x0109502A, /* SLT */
+};
+#define MIX_LEN (sizeof(instruction_mix) / sizeof(instruction_mix[0]))
+
+/***************************************************************/
+/* Benchmarks: each runs n operations starting at position i       */
+/***************************************************************/
+int stream; //stream used by the memory and cache benchmarks
+
+void bench_mem_read(uint32_t n) {
+	uint32_t i, sum = 0;
+	for (i = 0; i < n; i++) {
+		sum += mem_read_32(streams[stream][i & (STREAM_LEN - 1)]);
+	}
+	sink = sum;
+}
+
+void bench_mem_write(uint32_t n) {
+	uint32_t i;
+	for (i = 0; i < n; i++) {
+		mem_write_32(streams[stream][i & (STREAM_LEN - 1)], i);
+	}
+}
+
+void bench_cache_read(uint32_t n) {
+	uint32_t i, sum = 0;
+	for (i = 0; i < n; i++) {
+		sum += cache_reads(streams[stream][i & (STREAM_LEN - 1)]);
+	}
+	sink = sum;
+}
+
+void bench_cache_write(uint32_t n) {
+	uint32_t i;
+	for (i = 0; i < n; i++) {
+		cache_writes(streams[stream][i & (STREAM_LEN - 1)], i);
+	}
+}
+
+/* tag checks only: one L1Cache against BATCH_LANES caches at once */
+void bench_cache_access(uint32_t n) {
+	uint32_t i, sum = 0;
+	for (i = 0; i < n; i++) {
+		sum += cache_access(streams[stream][i & (STREAM_LEN - 1)]);
+	}
+	sink = sum;
+}
+
+void bench_batch_access(uint32_t n) {
+	uint32_t i;
+	for (i = 0; i < n; i++) {
+		batch_access(streams[stream][i & (STREAM_LEN - 1)]);
+	}
+}
+
+void bench_load_store(uint32_t n) {
+	uint32_t i, sum = 0;
+	for (i = 0; i < n; i++) {
+		uint32_t instruction = instruction_mix[i % MIX_LEN];
+		sum += load_store(instruction >> 26, instruction & 0x3F);
+	}
+	sink = sum;
+}
+
+void bench_reg_imm(uint32_t n) {
+	uint32_t i, sum = 0;
+	for (i = 0; i < n; i++) {
+		sum += reg_imm(instruction_mix[i % MIX_LEN] >> 26);
+	}
+	sink = sum;
+}
+
+void bench_reg_reg(uint32_t n) {
+	uint32_t i, sum = 0;
+	for (i = 0; i < n; i++) {
+		uint32_t instruction = instruction_mix[i % MIX_LEN];
+		sum += reg_reg(instruction >> 26, instruction & 0x3F);
+	}
+	sink = sum;
+}
+
+void bench_reg_jump(uint32_t n) {
+	uint32_t i, sum = 0;
+	for (i = 0; i < n; i++) {
+		uint32_t instruction = instruction_mix[i % MIX_LEN];
+		sum += reg_jump(instruction >> 26, instruction & 0x3F);
+	}
+	sink = sum;
+}
+
+/* the instruction being decoded against two in-flight producers from the mix */
+void bench_hazard(uint32_t n) {
+	uint32_t i, sum = 0;
+	for (i = 0; i < n; i++) {
+		ID_EX.IR = instruction_mix[i % MIX_LEN];
+		ID_EX.REG_RS_VALUE = (ID_EX.IR >> 21) & 0x1F;
+		ID_EX.REG_RT_VALUE = (ID_EX.IR >> 16) & 0x1F;
+		EX_MEM.IR = instruction_mix[(i + 1) % MIX_LEN];
+		MEM_WB.IR = instruction_mix[(i + 2) % MIX_LEN];
+		STALL_COUNT = 0;
+		dataHazardDetection();
+		sum += STALL_COUNT;
+	}
+	STALL_COUNT = 0;
+	sink = sum;
+}
+
+/* whole cycles of the loaded program, restarted from the top when it finishes */
+void bench_cycle(uint32_t n) {
+	uint32_t i;
+	for (i = 0; i < n; i++) {
+		if (RUN_FLAG == FALSE) {
+			memset(&CURRENT_STATE, 0, sizeof(CURRENT_STATE));
+			CURRENT_STATE.PC = MEM_TEXT_BEGIN;
+			NEXT_STATE = CURRENT_STATE;
+			reset_pipeline();
+			RUN_FLAG = TRUE;
+		}
+		cycle();
+	}
+}
+
+/***************************************************************/
+/* Run SAMPLES samples of OPS operations and print one result row  */
+/***************************************************************/
+void measure(const char *name, const char *variant, void (*bench)(uint32_t)) {
+	double ns[SAMPLES];
+	double mean = 0, var = 0, best = 0;
+	uint64_t counted = 0;
+	int s;
+
+	bench(OPS); //warm up the host caches and the simulated state
+	for (s = 0; s < SAMPLES; s++) {
+		uint64_t c0 = read_cycle_counter();
+		double t0 = host_time();
+		bench(OPS);
+		double t1 = host_time();
+		counted += read_cycle_counter() - c0;
+		ns[s] = (t1 - t0) * 1e9 / OPS;
+		mean += ns[s];
+		if (s == 0 || ns[s] < best) {
+			best = ns[s];
+		}
+	}
+	mean /= SAMPLES;
+	for (s = 0; s < SAMPLES; s++) {
+		var += (ns[s] - mean) * (ns[s] - mean);
+	}
+	var /= SAMPLES - 1;
+
+	printf("%-22s %-12s %9.2f %9.2f %9.2f", name, variant, mean, sqrt(var), best);
+	if (strcmp(counter_name, "none") != 0) {
+		printf(" %9.2f", (double) counted / SAMPLES / OPS);
+	}
+	printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+	QUIET_FLAG = 1;
+	strncpy(prog_file, argc > 1 ? argv[1] : "../benchmarks/matmul.in", sizeof(prog_file) - 1);
+	initialize();
+	build_streams();
+	open_cycle_counter();
+
+	printf("%d samples of %d ops, cycle counter: %s\n\n", SAMPLES, OPS, counter_name);
+	printf("%-22s %-12s %9s %9s %9s %9s\n", "function", "stream", "ns/op", "stddev", "best", "cyc/op");
+
+	for (stream = 0; stream < NUM_STREAMS; stream++) {
+		measure("mem_read_32", stream_names[stream], bench_mem_read);
+	}
+	for (stream = 0; stream < NUM_STREAMS; stream++) {
+		measure("mem_write_32", stream_names[stream], bench_mem_write);
+	}
+	for (stream = 0; stream < NUM_STREAMS; stream++) {
+		cache_flush(&L1Cache);
+		measure("cache_reads", stream_names[stream], bench_cache_read);
+	}
+	for (stream = 0; stream < NUM_STREAMS; stream++) {
+		cache_flush(&L1Cache);
+		measure("cache_writes", stream_names[stream], bench_cache_write);
+	}
+	for (stream = 0; stream < NUM_STREAMS; stream++) {
+		cache_flush(&L1Cache);
+		measure("cache_access", stream_names[stream], bench_cache_access);
+	}
+	/* same number of sets, 16 ways: the vector tag match should keep it close */
+	cache_configure(&L1Cache, "4096:16:16");
+	for (stream = 0; stream < NUM_STREAMS; stream++) {
+		measure("cache_access 16-way", stream_names[stream], bench_cache_access);
+	}
+	cache_configure(&L1Cache, "256:1:16");
+	for (stream = 0; stream < NUM_STREAMS; stream++) {
+		batch_reset();
+		measure("batch_access", stream_names[stream], bench_batch_access);
+	}
+	measure("load_store", "mix", bench_load_store);
+	measure("reg_imm", "mix", bench_reg_imm);
+	measure("reg_reg", "mix", bench_reg_reg);
+	measure("reg_jump", "mix", bench_reg_jump);
+	measure("dataHazardDetection", "mix", bench_hazard);
+
+	reset_pipeline();
+	load_program();
+	measure("cycle", "pipeline", bench_cycle);
+	ENGINE = ENGINE_FUNCTIONAL;
+	measure("cycle", "functional", bench_cycle);
+	return 0;
+}
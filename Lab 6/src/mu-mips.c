@@ -1,11 +1,20 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <stdint.h>
 #include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 #include "mu-mips.h"
 #include "mu-cache.h"
+#include "mu-core.h"
+#include "mu-ooo.h"
+#include "mu-trace.h"
 
 /***************************************************************/
 /* Print out a list of commands available                                                                  */
@@ -24,11 +33,55 @@ void help() {
 	printf("print\t-- print the program loaded into memory\n");
 	printf("show\t-- print the current content of the pipeline registers\n");
 	printf("forwarding <val>\t-- enable forwarding with 1, disable with 0 for <val>\n");
+	printf("cache\t-- print the cache statistics and contents\n");
+	printf("cachemap <file>\t-- write per-set and per-region accesses/misses/evictions of each level as CSV\n");
+	printf("reuse\t-- print the reuse distances and working sets gathered with reuse on (set reuse 1, reuse_window <n>)\n");
+	printf("curves\t-- print the miss-ratio curves gathered with stackdist on\n");
+	printf("batch\t-- print the batched cache results gathered with batch on\n");
+	printf("verify <file>\t-- compare registers/memory against an expected-state file\n");
+	printf("set <option> <value>\t-- engine pipeline|functional|ooo, cache l1|none, forwarding 0|1, trace <file>|off, stackdist 0|1, batch 0|1\n");
+	printf("set l1|l2|l3 <bytes>:<ways>:<block>[:<cycles>]\t-- cache geometry, l2/l3 off removes the level\n");
+	printf("set dram 1\t-- DRAM banks and row buffers behind the caches, see dram_channels/banks/row/page/map/timing\n");
+	printf("set mshrs <n>\t-- non-blocking L1 with <n> MSHRs, 0 for a blocking cache\n");
+	printf("set write_buffer <n>\t-- coalescing write buffer of <n> blocks, drained one per write_buffer_drain cycles\n");
+	printf("set threec 1\t-- sort each level's misses into compulsory, capacity and conflict\n");
+	printf("set victim <blocks>\t-- victim cache of up to %d blocks behind L1, swap cost from victim_latency\n", MAX_VICTIM_BLOCKS);
+	printf("set prefetch none|nextline|stride|stream\t-- L1 prefetcher, tuned with prefetch_degree/queue/interval\n");
+	printf("set cores <n>\t-- run the program on up to %d cores with MESI-coherent L1s ($k0 = core, $k1 = cores), see coherence_latency\n", MAX_CORES);
+	printf("set threads <n>\t-- <n> hardware threads per core sharing its pipeline, thread_policy fine|miss, switch_penalty/switch_timeout <cycles>\n");
+	printf("set engine ooo\t-- out-of-order core fetching/committing width a cycle, rob/iq/lsq <entries>, alus <n>, lsq_speculate 0|1\n");
+	printf("set width <n>\t-- in-order superscalar pipeline issuing up to <n> (2 or 4) instructions a cycle, one memory access among them\n");
+	printf("set mult_latency|div_latency <cycles>\t-- multi-cycle multiplier/divider with HI/LO interlocks, mult_pipelined/div_pipelined 0|1\n");
+	printf("set fetch_stages|decode_stages|mem_stages <n>\t-- deeper scalar pipeline (width 1 only), 1 to %d stages each for fetch, decode/register read and memory\n", MAX_PIPE_STAGES);
+	printf("set delay_slot 1\t-- MIPS branch delay slots: the instruction after a branch/jump always runs, targets PC + 4 relative\n");
+	printf("set parallel 1\t-- one host thread per core, meeting every quantum <n> cycles; not repeatable, 0 for lockstep\n");
 	printf("?\t-- display help menu\n");
 	printf("quit\t-- exit the simulator\n\n");
 	printf("------------------------------------------------------------------\n\n");
 }
 
+/***************************************************************/
+/* An aligned word of simulated memory as one atomic access, for    */
+/* cores on host threads: no core reads a word another has only     */
+/* half written. Memory is little-endian, as in the byte path.      */
+/***************************************************************/
+uint32_t mem_word_load(uint8_t *word)
+{
+	uint32_t value = __atomic_load_n((uint32_t *) word, __ATOMIC_ACQUIRE);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	value = __builtin_bswap32(value);
+#endif
+	return value;
+}
+
+void mem_word_store(uint8_t *word, uint32_t value)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	value = __builtin_bswap32(value);
+#endif
+	__atomic_store_n((uint32_t *) word, value, __ATOMIC_RELEASE);
+}
+
 /***************************************************************/
 /* Read a 32-bit word from memory                                                                            */
 /***************************************************************/
@@ -38,6 +91,9 @@ uint32_t mem_read_32(uint32_t address)
 	for (i = 0; i < NUM_MEM_REGION; i++) {
 		if ( (address >= MEM_REGIONS[i].begin) &&  ( address <= MEM_REGIONS[i].end) ) {
 			uint32_t offset = address - MEM_REGIONS[i].begin;
+			if (IN_QUANTUM && (offset & 3) == 0) {
+				return mem_word_load(MEM_REGIONS[i].mem + offset);
+			}
 			return (MEM_REGIONS[i].mem[offset+3] << 24) |
 					(MEM_REGIONS[i].mem[offset+2] << 16) |
 					(MEM_REGIONS[i].mem[offset+1] <<  8) |
@@ -57,6 +113,10 @@ void mem_write_32(uint32_t address, uint32_t value)
 	for (i = 0; i < NUM_MEM_REGION; i++) {
 		if ( (address >= MEM_REGIONS[i].begin) && (address <= MEM_REGIONS[i].end) ) {
 			offset = address - MEM_REGIONS[i].begin;
+			if (IN_QUANTUM && (offset & 3) == 0) {
+				mem_word_store(MEM_REGIONS[i].mem + offset, value);
+				return;
+			}
 
 			MEM_REGIONS[i].mem[offset+3] = (value >> 24) & 0xFF;
 			MEM_REGIONS[i].mem[offset+2] = (value >> 16) & 0xFF;
@@ -70,8 +130,28 @@ void mem_write_32(uint32_t address, uint32_t value)
 /* Execute one cycle                                                                                                              */
 /***************************************************************/
 void cycle() {                                                
-	handle_pipeline();
-	CURRENT_STATE = NEXT_STATE;
+	int i, running = 0;
+	if(NUM_CORES == 1)
+		core_cycle();
+	else
+	{
+		//each running core in turn, ending on core 0's context; RUN_FLAG
+		//is each core's own inside the loop and any core's after it
+		for(i = 0; i < NUM_CORES; i++)
+		{
+			if(!CORES[i].running)
+				continue;
+			core_switch(i);
+			RUN_FLAG = TRUE;
+			uint32_t instructions = INSTRUCTION_COUNT;
+			core_cycle();
+			CORES[i].instructions += INSTRUCTION_COUNT - instructions;
+			CORES[i].running = RUN_FLAG;
+			running |= RUN_FLAG;
+		}
+		core_switch(0);
+		RUN_FLAG = running;
+	}
 	CYCLE_COUNT++;
 }
 
@@ -86,29 +166,20 @@ void run(int num_cycles) {
 	}
 
 	printf("Running simulator for %d cycles...\n\n", num_cycles);
+	if (parallel_ready()) {
+		parallel_run(num_cycles);
+		if (RUN_FLAG == FALSE) {
+			printf("Simulation Stopped.\n\n");
+		}
+		return;
+	}
 	int i; 
-	int load_stall = 0;
 	for (i = 0; i < num_cycles; i++) {
-		if(CACHE_MISS_FLAG == 1)
-		{
-			if(load_stall < 100) //100 cycles to laod from memory
-			{
-				load_stall++;
-				CYCLE_COUNT++;
-			}
-			else //memory loaded
-			{
-				CACHE_MISS_FLAG = 0;	
-			}
-		}
-		else
-		{
-			if (RUN_FLAG == FALSE) {
-				printf("Simulation Stopped.\n\n");
-				break;
-			}
-			cycle();
+		if (RUN_FLAG == FALSE) {
+			printf("Simulation Stopped.\n\n");
+			break;
 		}
+		cycle();
 	}
 }
 
@@ -122,10 +193,32 @@ void runAll() {
 	}
 
 	printf("Simulation Started...\n\n");
-	while (RUN_FLAG){
-		cycle();
+	uint32_t start_cycles = CYCLE_COUNT;
+	uint32_t start_instructions = INSTRUCTION_COUNT;
+	double start = host_time();
+	if (parallel_ready()) {
+		parallel_run(0);
+	} else {
+		while (RUN_FLAG){
+			cycle();
+		}
 	}
+	HOST_SECONDS = host_time() - start;
 	printf("Simulation Finished.\n\n");
+
+	uint32_t cycles = CYCLE_COUNT - start_cycles;
+	uint32_t instructions = INSTRUCTION_COUNT - start_instructions;
+	printf("# Cycles: %u\t# Instructions: %u\tCPI: %0.3f\n", cycles, instructions, instructions ? (double) cycles / instructions : 0.0);
+	printf("Host time: %0.9f s\tHost MIPS: %0.3f\n\n", HOST_SECONDS, HOST_SECONDS > 0 ? instructions / HOST_SECONDS / 1e6 : 0.0);
+}
+
+/***************************************************************/
+/* Monotonic host clock in seconds, used to time the simulator itself     */
+/***************************************************************/
+double host_time() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
 }
 
 /***************************************************************/ 
@@ -172,6 +265,7 @@ void rdump() {
 /***************************************************************/
 void handle_command() {                         
 	char buffer[20];
+	char filename[256];
 	uint32_t start, stop, cycles;
 	uint32_t register_no;
 	int register_value;
@@ -196,6 +290,14 @@ void handle_command() {
 		case 's':
 			if (buffer[1] == 'h' || buffer[1] == 'H'){
 				show_pipeline();
+			}else if (buffer[1] == 'e' || buffer[1] == 'E'){
+				char key[32], value[32];
+				if (scanf("%31s %31s", key, value) != 2) {
+					break;
+				}
+				if (!set_option(key, value)) {
+					printf("Unknown option or value: %s %s\n", key, value);
+				}
 			}else {
 				runAll(); 
 			}
@@ -220,6 +322,8 @@ void handle_command() {
 		case 'r':
 			if (buffer[1] == 'd' || buffer[1] == 'D'){
 				rdump();
+			}else if((buffer[1] == 'e' || buffer[1] == 'E') && (buffer[2] == 'u' || buffer[2] == 'U')){
+				reuse_print();
 			}else if(buffer[1] == 'e' || buffer[1] == 'E'){
 				reset();
 			}
@@ -258,9 +362,30 @@ void handle_command() {
 		case 'p':
 			print_program(); 
 			break;
+		case 'B':
+		case 'b':
+			batch_print();
+			break;
 		case 'C':
 		case 'c':
-			cache_miss_rate();
+			if (strncasecmp(buffer, "cu", 2) == 0){
+				stackdist_print();
+			}else if (strncasecmp(buffer, "cachemap", 8) == 0){
+				if (scanf("%255s", filename) != 1) {
+					break;
+				}
+				cache_map(filename);
+			}else{
+				cache_miss_rate();
+			}
+			break;
+		case 'V':
+		case 'v':
+			if (scanf("%255s", filename) != 1) {
+				break;
+			}
+			verify(filename);
+			break;
 		default:
 			printf("Invalid Command.\n");
 			break;
@@ -269,31 +394,454 @@ void handle_command() {
 
 void cache_miss_rate()
 {
-	double miss_rate = ((double) cache_misses / ((double)cache_hits + (double)cache_misses) * 100);
-	double hit_rate = 100 - miss_rate;
-	
+	int level;
+	uint32_t line, i;
+
 	printf("-------------------------------------\n");
 	printf("Dumping Cache Statistics\n");
 	printf("-------------------------------------\n");
-	printf("Number of Cache hits: %u\n", cache_hits);
-	printf("Number of Cache misses: %u\n", cache_misses);
-	printf("Cache hit rate: %0.2f\n", hit_rate);
-	printf("Cache miss rate: %0.2f\n", miss_rate);
-	printf("-------------------------------------\n");
+	for(level = 0; level < MAX_CACHE_LEVELS; level++)
+	{
+		Cache *cache = cache_level(level);
+		if(cache->sets == 0)
+			continue;
+		uint32_t accesses = cache->hits + cache->misses;
+		double miss_rate = accesses ? 100.0 * cache->misses / accesses : 0.0;
+		printf("%s: %u B, %u-way, %u-byte blocks", cache->name, cache->sets * cache->ways * cache->block_bytes, cache->ways, cache->block_bytes);
+		if(level > 0)
+			printf(", %u cycles", cache->latency);
+		printf("\n");
+		printf("Number of Cache hits: %u\n", cache->hits);
+		printf("Number of Cache misses: %u\n", cache->misses);
+		printf("Cache hit rate: %0.2f\n", accesses ? 100 - miss_rate : 0.0);
+		printf("Cache miss rate: %0.2f\n", miss_rate);
+		if(THREEC_ENABLED)
+			threec_print(level);
+		printf("-------------------------------------\n");
+	}
+
+	if(NUM_MSHRS > 0)
+	{
+		printf("MSHRs: %d\n", NUM_MSHRS);
+		printf("Primary misses: %u\tSecondary (merged): %u\n", MSHR_STATS.primary, MSHR_STATS.secondary);
+		printf("MSHR-full stalls: %u\t(%u cycles)\n", MSHR_STATS.full_stalls, MSHR_STATS.full_cycles);
+		printf("Cycles waiting on a missing load: %u\n", MSHR_STATS.dependency_cycles);
+		printf("Cycles with misses outstanding: %u\tMLP: %0.2f\n", MSHR_STATS.busy_cycles,
+			MSHR_STATS.busy_cycles ? (double) MSHR_STATS.occupancy / MSHR_STATS.busy_cycles : 0.0);
+		printf("-------------------------------------\n");
+	}
+
+	if(DRAM_ENABLED)
+		dram_print();
+
+	if(WRITE_BUFFER_DEPTH > 0)
+		write_buffer_print();
+
+	if(VICTIM_BLOCKS > 0)
+		victim_print();
+
+	if(PREFETCHER != PREFETCH_NONE)
+		prefetch_print();
 
+	if(NUM_CORES > 1)
+		core_print();
+
+	if(NUM_THREADS > 1)
+		thread_print();
+
+	if(ISSUE_WIDTH > 1 && ENGINE == ENGINE_PIPELINE)
+		superscalar_print();
+
+	if(ENGINE == ENGINE_OOO)
+		ooo_print();
+
+	if(MULT_LATENCY > 1 || DIV_LATENCY > 1)
+		muldiv_print();
+
+	if(ENGINE == ENGINE_PIPELINE && front_stages() + memory_stages() > 0)
+		depth_print();
+
+	if(DELAY_SLOT)
+		delay_slot_print();
+
+	sync_print();
+
+	if(L1Cache.sets * L1Cache.ways > 64)
+		return; //too big to list
 	printf("Cache Contenets\n");
-	printf("Block\tValid\tTag\tWord 1\t\tWord 2\t\tWord 3\t\tWord 4\n");
-	
-	for(int i = 0; i < NUM_CACHE_BLOCKS; i ++)
+	printf("Set\tWay\tValid\tTag\tWords\n");
+	for(line = 0; line < L1Cache.sets * L1Cache.ways; line++)
 	{
-		//finish this thingy
-		printf("[%d]\t%d\t%x\t0x%08x\t0x%08x\t0x%08x\t0x%08x\n", i, L1Cache.blocks[i].valid, L1Cache.blocks[i].tag, L1Cache.blocks[i].words[0], L1Cache.blocks[i].words[1],L1Cache.blocks[i].words[2],L1Cache.blocks[i].words[3]);
+		uint32_t tag = L1Cache.tags[line / L1Cache.ways * L1Cache.stride + line % L1Cache.ways];
+		printf("[%u]\t%u\t%d\t%x\t", line / L1Cache.ways, line % L1Cache.ways, tag != 0, tag ? tag - 1 : 0);
+		for(i = 0; i < L1Cache.block_bytes / 4; i++)
+			printf("0x%08x\t", L1Cache.words[line * L1Cache.block_bytes / 4 + i]);
+		printf("\n");
 	}
 	
 	printf("-------------------------------------\n");
 	
 }
 
+/***************************************************************/
+/* Set a simulator option by name, from "-o key=value" or "set"      */
+/* Returns 0 for an unknown option or value.                          */
+/***************************************************************/
+int set_option(char *key, char *value) {
+	if (strcmp(key, "engine") == 0) {
+		if (strcmp(value, "pipeline") == 0) {
+			ENGINE = ENGINE_PIPELINE;
+		} else if (strcmp(value, "functional") == 0) {
+			ENGINE = ENGINE_FUNCTIONAL;
+		} else if (strcmp(value, "ooo") == 0) {
+			ENGINE = ENGINE_OOO;
+			ooo_reset();
+		} else {
+			return 0;
+		}
+	}
+	else if (strcmp(key, "cache") == 0) {
+		if (strcmp(value, "l1") == 0) {
+			CACHE_MODEL = CACHE_MODEL_L1;
+		} else if (strcmp(value, "none") == 0) {
+			CACHE_MODEL = CACHE_MODEL_NONE;
+		} else {
+			return 0;
+		}
+	}
+	else if (strcmp(key, "forwarding") == 0) {
+		ENABLE_FORWARDING = atoi(value) != 0;
+	}
+	else if (strcmp(key, "l1") == 0) {
+		return cache_configure(&L1Cache, value);
+	}
+	else if (strcmp(key, "l2") == 0) {
+		return cache_configure(&L2Cache, value);
+	}
+	else if (strcmp(key, "l3") == 0) {
+		return cache_configure(&L3Cache, value);
+	}
+	else if (strcmp(key, "mshrs") == 0) {
+		if (atoi(value) < 0 || atoi(value) > MAX_MSHRS) {
+			return 0;
+		}
+		NUM_MSHRS = atoi(value);
+		mshr_reset();
+	}
+	else if (strcmp(key, "write_buffer") == 0) {
+		if (atoi(value) < 0 || atoi(value) > MAX_WRITE_BUFFER) {
+			return 0;
+		}
+		WRITE_BUFFER_DEPTH = atoi(value);
+		write_buffer_reset();
+	}
+	else if (strcmp(key, "write_buffer_drain") == 0) {
+		WRITE_BUFFER_DRAIN = atoi(value) > 0 ? atoi(value) : 1;
+	}
+	else if (strcmp(key, "victim") == 0) {
+		if (atoi(value) < 0 || atoi(value) > MAX_VICTIM_BLOCKS) {
+			return 0;
+		}
+		VICTIM_BLOCKS = atoi(value);
+		victim_reset();
+	}
+	else if (strcmp(key, "victim_latency") == 0) {
+		VICTIM_LATENCY = atoi(value) > 0 ? atoi(value) : 1;
+	}
+	else if (strcmp(key, "prefetch") == 0) {
+		const char *names[] = { "none", "nextline", "stride", "stream" };
+		int i;
+		for (i = 0; i < 4 && strcmp(value, names[i]) != 0; i++)
+			;
+		if (i == 4) {
+			return 0;
+		}
+		PREFETCHER = i;
+		prefetch_reset();
+	}
+	else if (strcmp(key, "prefetch_degree") == 0) {
+		if (atoi(value) < 1 || atoi(value) > MAX_PREFETCH_DEGREE) {
+			return 0;
+		}
+		PREFETCH_DEGREE = atoi(value);
+	}
+	else if (strcmp(key, "prefetch_queue") == 0) {
+		PREFETCH_QUEUE = atoi(value) > 0 ? atoi(value) : 1;
+	}
+	else if (strcmp(key, "prefetch_interval") == 0) {
+		PREFETCH_INTERVAL = atoi(value) > 0 ? atoi(value) : 1;
+	}
+	else if (strcmp(key, "dram") == 0) {
+		DRAM_ENABLED = atoi(value) != 0;
+		dram_reset();
+	}
+	else if (strcmp(key, "dram_channels") == 0) {
+		if (atoi(value) < 1 || atoi(value) > MAX_DRAM_CHANNELS || (atoi(value) & (atoi(value) - 1)) != 0) {
+			return 0;
+		}
+		DRAM_CHANNELS = atoi(value);
+		dram_reset();
+	}
+	else if (strcmp(key, "dram_banks") == 0) {
+		if (atoi(value) < 1 || atoi(value) > MAX_DRAM_BANKS || (atoi(value) & (atoi(value) - 1)) != 0) {
+			return 0;
+		}
+		DRAM_BANKS = atoi(value);
+		dram_reset();
+	}
+	else if (strcmp(key, "dram_row") == 0) {
+		if (atoi(value) < DRAM_BURST_BYTES || (atoi(value) & (atoi(value) - 1)) != 0) {
+			return 0;
+		}
+		DRAM_ROW_BYTES = atoi(value);
+		dram_reset();
+	}
+	else if (strcmp(key, "dram_page") == 0) {
+		if (strcmp(value, "open") == 0) {
+			DRAM_PAGE_POLICY = DRAM_OPEN_PAGE;
+		} else if (strcmp(value, "closed") == 0) {
+			DRAM_PAGE_POLICY = DRAM_CLOSED_PAGE;
+		} else {
+			return 0;
+		}
+		dram_reset();
+	}
+	else if (strcmp(key, "dram_map") == 0) {
+		if (!dram_parse_map(value)) {
+			return 0;
+		}
+		dram_reset();
+	}
+	else if (strcmp(key, "dram_timing") == 0) {
+		uint32_t cas, rcd, rp, burst, overhead = DRAM_OVERHEAD;
+		if (sscanf(value, "%u:%u:%u:%u:%u", &cas, &rcd, &rp, &burst, &overhead) < 4) {
+			return 0;
+		}
+		DRAM_T_CAS = cas;
+		DRAM_T_RCD = rcd;
+		DRAM_T_RP = rp;
+		DRAM_T_BURST = burst;
+		DRAM_OVERHEAD = overhead;
+		dram_reset();
+	}
+	else if (strcmp(key, "memory_latency") == 0) {
+		MEMORY_LATENCY = atoi(value);
+	}
+	else if (strcmp(key, "heat_region") == 0) {
+		uint32_t bytes = atoi(value), bits;
+		for (bits = 2; bits < 31 && (1u << bits) < bytes; bits++)
+			;
+		if ((1u << bits) != bytes) {
+			return 0;
+		}
+		HEAT_REGION_BITS = bits;
+		cache_init();
+	}
+	else if (strcmp(key, "threec") == 0) {
+		THREEC_ENABLED = atoi(value) != 0;
+		threec_reset();
+		core_caches();
+	}
+	else if (strcmp(key, "cores") == 0) {
+		if (atoi(value) < 1 || atoi(value) > MAX_CORES) {
+			return 0;
+		}
+		NUM_CORES = atoi(value);
+		cache_init();
+		core_init();
+	}
+	else if (strcmp(key, "coherence_latency") == 0) {
+		COHERENCE_LATENCY = atoi(value) > 0 ? atoi(value) : 1;
+	}
+	else if (strcmp(key, "threads") == 0) {
+		if (atoi(value) < 1 || atoi(value) > MAX_THREADS) {
+			return 0;
+		}
+		NUM_THREADS = atoi(value);
+		core_init();
+	}
+	else if (strcmp(key, "thread_policy") == 0) {
+		if (strcmp(value, "fine") == 0) {
+			THREAD_POLICY = THREAD_FINE;
+		} else if (strcmp(value, "miss") == 0) {
+			THREAD_POLICY = THREAD_MISS;
+		} else {
+			return 0;
+		}
+	}
+	else if (strcmp(key, "switch_penalty") == 0) {
+		SWITCH_PENALTY = atoi(value) > 0 ? atoi(value) : 0;
+	}
+	else if (strcmp(key, "switch_timeout") == 0) {
+		SWITCH_TIMEOUT = atoi(value) > 0 ? atoi(value) : 1;
+	}
+	else if (strcmp(key, "width") == 0) {
+		if (atoi(value) < 1 || atoi(value) > MAX_ISSUE_WIDTH) {
+			return 0;
+		}
+		if (atoi(value) > 1 && (FETCH_STAGES > 1 || DECODE_STAGES > 1 || MEMORY_STAGES > 1)) {
+			printf("width > 1 needs fetch_stages, decode_stages and mem_stages of 1\n");
+			return 0;
+		}
+		ISSUE_WIDTH = atoi(value);
+	}
+	else if (strcmp(key, "mult_latency") == 0) {
+		MULT_LATENCY = atoi(value) > 0 ? atoi(value) : 1;
+	}
+	else if (strcmp(key, "div_latency") == 0) {
+		DIV_LATENCY = atoi(value) > 0 ? atoi(value) : 1;
+	}
+	else if (strcmp(key, "mult_pipelined") == 0) {
+		MULT_PIPELINED = atoi(value) != 0;
+	}
+	else if (strcmp(key, "div_pipelined") == 0) {
+		DIV_PIPELINED = atoi(value) != 0;
+	}
+	else if (strcmp(key, "fetch_stages") == 0 || strcmp(key, "decode_stages") == 0 || strcmp(key, "mem_stages") == 0) {
+		if (atoi(value) < 1 || atoi(value) > MAX_PIPE_STAGES) {
+			return 0;
+		}
+		if (atoi(value) > 1 && ISSUE_WIDTH > 1) {
+			printf("%s only deepens the scalar pipeline, set width 1 first\n", key);
+			return 0;
+		}
+		if (key[0] == 'f')
+			FETCH_STAGES = atoi(value);
+		else if (key[0] == 'd')
+			DECODE_STAGES = atoi(value);
+		else
+			MEMORY_STAGES = atoi(value);
+	}
+	else if (strcmp(key, "delay_slot") == 0) {
+		DELAY_SLOT = atoi(value) != 0;
+	}
+	else if (strcmp(key, "rob") == 0) {
+		if (atoi(value) < 1 || atoi(value) > MAX_ROB) {
+			return 0;
+		}
+		ROB_SIZE = atoi(value);
+	}
+	else if (strcmp(key, "iq") == 0) {
+		IQ_SIZE = atoi(value) > 0 ? atoi(value) : 1;
+	}
+	else if (strcmp(key, "lsq") == 0) {
+		LSQ_SIZE = atoi(value) > 0 ? atoi(value) : 1;
+	}
+	else if (strcmp(key, "alus") == 0) {
+		NUM_ALUS = atoi(value) > 0 ? atoi(value) : 1;
+	}
+	else if (strcmp(key, "lsq_speculate") == 0) {
+		LSQ_SPECULATE = atoi(value) != 0;
+	}
+	else if (strcmp(key, "parallel") == 0) {
+		PARALLEL = atoi(value) != 0;
+	}
+	else if (strcmp(key, "quantum") == 0) {
+		QUANTUM = atoi(value) > 0 ? atoi(value) : 1;
+	}
+	else if (strcmp(key, "reuse") == 0) {
+		REUSE_ENABLED = atoi(value) != 0;
+		reuse_reset(&REUSE_DATA, REUSE_WINDOW);
+		reuse_reset(&REUSE_FETCH, REUSE_WINDOW);
+	}
+	else if (strcmp(key, "reuse_window") == 0) {
+		REUSE_WINDOW = atoi(value) > 0 ? atoi(value) : 1;
+		reuse_reset(&REUSE_DATA, REUSE_WINDOW);
+		reuse_reset(&REUSE_FETCH, REUSE_WINDOW);
+	}
+	else if (strcmp(key, "stackdist") == 0) {
+		stackdist_reset();
+		STACK_DIST.enabled = atoi(value) != 0;
+	}
+	else if (strcmp(key, "batch") == 0) {
+		batch_reset();
+		BATCH.enabled = atoi(value) != 0;
+	}
+	else if (strcmp(key, "trace") == 0) {
+		trace_close();
+		if (strcmp(value, "off") != 0) {
+			return trace_open(value);
+		}
+	}
+	else {
+		return 0;
+	}
+	return 1;
+}
+
+/* "key=value" form used on the command line */
+int parse_option(char *option) {
+	char key[32];
+	char *value = strchr(option, '=');
+	if (value == NULL || value - option >= (int) sizeof(key)) {
+		return 0;
+	}
+	memcpy(key, option, value - option);
+	key[value - option] = '\0';
+	return set_option(key, value + 1);
+}
+
+/***************************************************************/
+/* Compare the architectural state against an expected-state file.  */
+/* Lines are "R <reg> <value>", "HI <value>", "LO <value>" or        */
+/* "M <address> <value>"; anything after '#' is a comment.           */
+/***************************************************************/
+void verify(char *filename) {
+	FILE * fp;
+	char line[256];
+	char kind[8];
+	uint32_t location, expected, actual;
+	int checked = 0, mismatches = 0;
+
+	fp = fopen(filename, "r");
+	if (fp == NULL) {
+		printf("Error: Can't open expected-state file %s\n", filename);
+		return;
+	}
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		char *comment = strchr(line, '#');
+		if (comment != NULL) {
+			*comment = '\0';
+		}
+		if (sscanf(line, "%7s", kind) != 1) {
+			continue;
+		}
+		if (strcmp(kind, "HI") == 0 || strcmp(kind, "LO") == 0) {
+			if (sscanf(line, "%*s %i", &expected) != 1) {
+				continue;
+			}
+			location = 0;
+			actual = kind[0] == 'H' ? CURRENT_STATE.HI : CURRENT_STATE.LO;
+		}
+		else if (sscanf(line, "%*s %i %i", &location, &expected) != 2) {
+			continue;
+		}
+		else if (kind[0] == 'R' && location < MIPS_REGS) {
+			actual = CURRENT_STATE.REGS[location];
+		}
+		else if (kind[0] == 'M') {
+			actual = mem_read_32(location);
+		}
+		else {
+			printf("Unknown expected-state entry: %s", line);
+			continue;
+		}
+		checked++;
+		if (actual != expected) {
+			mismatches++;
+			printf("MISMATCH %s 0x%08x: expected 0x%08x, got 0x%08x\n", kind, location, expected, actual);
+		}
+	}
+	fclose(fp);
+
+	if (mismatches == 0) {
+		printf("VERIFY PASSED (%d values)\n", checked);
+	} else {
+		printf("VERIFY FAILED (%d of %d values differ)\n", mismatches, checked);
+	}
+}
+
 /***************************************************************/
 /* reset registers/memory and reload program                                                    */
 /***************************************************************/
@@ -305,6 +853,7 @@ void reset() {
 	}
 	CURRENT_STATE.HI = 0;
 	CURRENT_STATE.LO = 0;
+	CURRENT_STATE.delay_pc = 0;
 	
 	for (i = 0; i < NUM_MEM_REGION; i++) {
 		uint32_t region_size = MEM_REGIONS[i].end - MEM_REGIONS[i].begin + 1;
@@ -315,10 +864,48 @@ void reset() {
 	load_program();
 	
 	/*reset PC*/
-	INSTRUCTION_COUNT = -4;
+	INSTRUCTION_COUNT = 0;
+	CYCLE_COUNT = 0;
 	CURRENT_STATE.PC =  MEM_TEXT_BEGIN;
 	NEXT_STATE = CURRENT_STATE;
 	RUN_FLAG = TRUE;
+	reset_pipeline();
+	cache_init();
+	core_init();
+}
+
+/***************************************************************/
+/* Empty the pipeline: every pipeline register starts as a bubble  */
+/***************************************************************/
+void reset_pipeline() {
+	int s, latch;
+	memset(&IF_ID, 0, sizeof(IF_ID));
+	memset(&ID_EX, 0, sizeof(ID_EX));
+	memset(&EX_MEM, 0, sizeof(EX_MEM));
+	memset(&MEM_WB, 0, sizeof(MEM_WB));
+	IF_ID.stage_stalled = 1;
+	ID_EX.stage_stalled = 1;
+	EX_MEM.stage_stalled = 1;
+	MEM_WB.stage_stalled = 1;
+	memset(SLOTS, 0, sizeof(SLOTS));
+	for(s = 0; s < MAX_ISSUE_WIDTH; s++)
+		for(latch = 0; latch < 4; latch++)
+			SLOTS[s][latch].stage_stalled = 1;
+	CURRENT_SLOT = 0;
+	memset(FRONT_PIPE, 0, sizeof(FRONT_PIPE));
+	memset(MEM_PIPE, 0, sizeof(MEM_PIPE));
+	for(s = 0; s < 2 * (MAX_PIPE_STAGES - 1); s++)
+		FRONT_PIPE[s].stage_stalled = 1;
+	for(s = 0; s < MAX_PIPE_STAGES - 1; s++)
+		MEM_PIPE[s].stage_stalled = 1;
+	HI_LO_READY = 0;
+	MULT_FREE = 0;
+	DIV_FREE = 0;
+	STALL_COUNT = 0;
+	FLUSH_FLAG = 0;
+	CACHE_MISS_FLAG = 0;
+	CACHE_STALL_COUNT = 0;
+	mshr_reset();
 }
 
 /***************************************************************/
@@ -354,7 +941,7 @@ void load_program() {
 	while( fscanf(fp, "%x\n", &word) != EOF ) {
 		address = MEM_TEXT_BEGIN + i;
 		mem_write_32(address, word);
-		printf("writing 0x%08x into address 0x%08x (%d)\n", word, address, address);
+		sim_print("writing 0x%08x into address 0x%08x (%d)\n", word, address, address);
 		i += 4;
 	}
 	PROGRAM_SIZE = i/4;
@@ -369,33 +956,48 @@ void handle_pipeline()
 {
 	/*INSTRUCTION_COUNT should be incremented when instruction is done*/
 	/*Since we do not have branch/jump instructions, INSTRUCTION_COUNT should be incremented in WB stage */
+	if(ISSUE_WIDTH > 1)
+	{
+		handle_superscalar();
+		return;
+	}
 	NEXT_STATE = CURRENT_STATE;
 	if(STALL_COUNT > 0)
 		STALL_COUNT--; //Decrementing stall
 	WB();
-	MEM();
-	if(CACHE_MISS_FLAG == 1) //skip cycles if stalling
+	MEM(); //a cache miss here freezes the pipeline from the next cycle on, see cycle()
+	if(memory_stages() > 0)
+		pipe_advance(&MEM_WB, MEM_PIPE, memory_stages());
+	EX();
+	if(DELAY_SLOT && EX_MEM.stage_stalled == 0 && reg_jump(EX_MEM.IR >> 26, EX_MEM.IR & 0x3F))
+		delay_slot_count(EX_MEM.PC, FLUSH_FLAG);
+	if(FLUSH_FLAG == 1)
 	{
-		int load_stall = 0;
-		if(load_stall < 100) //100 cycles to laod from memory
+		DepthStats *stats = &CORES[CURRENT_CORE].depth;
+		int k;
+		if(DELAY_SLOT) //the delay slot in IF_ID goes on, fetch goes on from the target
 		{
-			load_stall++;
-			CYCLE_COUNT++;
+			ID();
+			CURRENT_STATE.PC = NEXT_STATE.PC = EX_MEM.ALUOutput; //IF holds if the slot stalled in ID
 		}
-		else //memory loaded
+		else
 		{
-			CACHE_MISS_FLAG = 0;	
+			STALL_COUNT = 1; //stalling ID stage
+			ID();
+			STALL_COUNT = 0;
+			CURRENT_STATE.PC = EX_MEM.ALUOutput; //changing PC
+			stats->squashed += IF_ID.stage_stalled == 0;
+			IF_ID.IR = 0; //wrong-path fetch is squashed, even a SYSCALL
+		}
+		stats->flushes++;
+		for(k = 0; k < front_stages(); k++)
+		{
+			stats->squashed += FRONT_PIPE[k].stage_stalled == 0;
+			FRONT_PIPE[k].stage_stalled = 1;
+			FRONT_PIPE[k].IR = 0;
 		}
-	}
-	EX();
-	if(FLUSH_FLAG == 1)
-	{
-		STALL_COUNT = 1; //stalling ID stage
-		ID();
-		STALL_COUNT = 0;
-		CURRENT_STATE.PC = EX_MEM.ALUOutput; //changing PC
 		IF();
-		FLUSH_FLAG--; //<-- may just set to zero here to avoid any seg faults
+		FLUSH_FLAG = 0;
 	}
 	else
 	{
@@ -404,364 +1006,2913 @@ void handle_pipeline()
 	}
 }
 
-//reading from cache
-uint32_t cache_reads(uint32_t addr)
+/************************************************************/
+/* Superscalar pipeline                                             */
+/************************************************************/
+//one cycle of every slot: each stage runs for the slots oldest first, so
+//WB retires a group in program order and ID sees the group ahead in EX_MEM
+//and MEM_WB of all slots
+void handle_superscalar()
 {
-	//uint32_t byte_offset;
-	uint32_t word_offset = (addr & 0xC) >> 2;
-	uint32_t index = (addr & 0xF0) >> 4;
-	uint32_t word = L1Cache.blocks[index].words[word_offset];
-	uint32_t tag = (addr & 0XFFFFFF00) >> 8;
-	//byte_offset = addr & 0x3;
-	// if tags don't match or not valid then miss
-	if((L1Cache.blocks[index].valid != 1) || (L1Cache.blocks[index].tag != tag)){			
-		//read a word
-		L1Cache.blocks[index].tag = tag;
-		L1Cache.blocks[index].words[0] = mem_read_32(addr); 
-		L1Cache.blocks[index].words[1] = mem_read_32(addr + 0x4);
-		L1Cache.blocks[index].words[2] = mem_read_32(addr + 0x8);
-		L1Cache.blocks[index].words[3] = mem_read_32(addr + 0xC);
-		word = L1Cache.blocks[index].words[word_offset];
-		//increment cache miss? cache miss so 100 cycles
-		CACHE_MISS_FLAG = 1;
-		cache_misses++;
-	} else{
-		//increment cache hit
-		cache_hits++;
+	IssueStats *stats = &CORES[CURRENT_CORE].issue;
+	uint32_t target = 0;
+	int s, flushed = 0, delay = 0, issued = 0, held = ISSUE_WIDTH;
+
+	NEXT_STATE = CURRENT_STATE;
+	if(STALL_COUNT > 0)
+		STALL_COUNT--;
+	for(s = 0; s < ISSUE_WIDTH; s++)
+	{
+		slot_switch(s);
+		WB();
 	}
-	printf("Read from cache: %x\n",word);				
-	return word;
+	for(s = 0; s < ISSUE_WIDTH; s++)
+	{
+		slot_switch(s);
+		MEM();
+	}
+	for(s = 0; s < ISSUE_WIDTH; s++)
+	{
+		slot_switch(s);
+		if(delay && ID_EX.stage_stalled == 0)
+			delay = 0; //the taken branch's delay slot
+		else if(flushed && ID_EX.stage_stalled == 0)
+		{
+			ID_EX.stage_stalled = 1; //behind a taken branch of this group
+			stats->squashed++;
+		}
+		EX();
+		if(DELAY_SLOT && !flushed && EX_MEM.stage_stalled == 0 && reg_jump(EX_MEM.IR >> 26, EX_MEM.IR & 0x3F))
+			delay_slot_count(EX_MEM.PC, FLUSH_FLAG);
+		if(FLUSH_FLAG && !flushed)
+		{
+			flushed = 1;
+			delay = DELAY_SLOT;
+			target = EX_MEM.ALUOutput;
+		}
+	}
+
+	if(flushed)
+	{
+		uint32_t stall = 0;
+		for(s = 0; s < ISSUE_WIDTH; s++)
+		{
+			slot_switch(s);
+			if(s == 0 && delay && IF_ID.stage_stalled == 0)
+			{
+				//the delay slot, the branch having been last in its group, decodes alone
+				ID();
+				stall = STALL_COUNT;
+				if(ID_EX.stage_stalled == 0)
+					issued++;
+				else
+				{
+					held = ISSUE_WIDTH - 1; //kept in the last slot for superscalar_fetch to move up
+					*slot_reg(held, LATCH_IF_ID) = IF_ID;
+				}
+				continue;
+			}
+			STALL_COUNT = 1; //everything else in ID is on the wrong path
+			ID();
+			if(s != held)
+				IF_ID.IR = 0; //even a SYSCALL
+		}
+		STALL_COUNT = stall;
+		CURRENT_STATE.PC = target;
+		FLUSH_FLAG = 0;
+	}
+	else
+	{
+		//in order: once a slot stalls, so do the ones behind it
+		uint32_t conflicts = stats->dependency + stats->memory_port + stats->muldiv_unit;
+		for(s = 0; s < ISSUE_WIDTH; s++)
+		{
+			slot_switch(s);
+			ID();
+			if(ID_EX.stage_stalled == 0)
+				issued++;
+			else if(IF_ID.stage_stalled == 0 && held == ISSUE_WIDTH)
+				held = s;
+		}
+		if(held < ISSUE_WIDTH && stats->dependency + stats->memory_port + stats->muldiv_unit == conflicts)
+			stats->hazard++;
+	}
+	slot_switch(0);
+	superscalar_fetch(held);
+	stats->cycles++;
+	stats->issued[issued]++;
 }
 
-//writing to cache with address and new data
-void cache_writes(uint32_t addr, uint32_t new)
+//put slot s's pipeline registers in the globals the stages work on
+void slot_switch(int s)
 {
-    uint32_t word_offset = (addr & 0x0000000C) >> 2;
-    uint32_t index = (addr & 0x000000F0) >> 4;
-    uint32_t tag = (addr & 0xFFFFFF00) >> 8;
-    
-    if(L1Cache.blocks[index].tag != tag || L1Cache.blocks[index].valid != 1){
-        //reading from mem if cache miss
-	L1Cache.blocks[index].tag = tag;
-        L1Cache.blocks[index].words[0] = mem_read_32((addr & 0xFFFFFFF0));
-        L1Cache.blocks[index].words[1] = mem_read_32((addr & 0xFFFFFFF0) + 0x04);
-        L1Cache.blocks[index].words[2] = mem_read_32((addr & 0xFFFFFFF0) + 0x08);
-        L1Cache.blocks[index].words[3] = mem_read_32((addr & 0xFFFFFFF0) + 0x0C);
-        CACHE_MISS_FLAG = 1; 
-        L1Cache.blocks[index].valid = 1;
-        cache_misses++;
-    }else{
-        cache_hits++;
-    }
-    
-    //writing data from store instruction to the cache blocks
-    L1Cache.blocks[index].words[word_offset] = new;
-    //write to the memory the cache blocks
-    mem_write_32((addr & 0xFFFFFFF0), L1Cache.blocks[index].words[0]);
-    mem_write_32(((addr & 0xFFFFFFF0) + 0x04), L1Cache.blocks[index].words[1]);
-    mem_write_32(((addr & 0xFFFFFFF0) + 0x08), L1Cache.blocks[index].words[2]);
-    mem_write_32(((addr & 0xFFFFFFF0) + 0x0C), L1Cache.blocks[index].words[3]);
-    printf("Wrote to cache: %x\n", new);
+	if(s == CURRENT_SLOT)
+		return;
+	SLOTS[CURRENT_SLOT][LATCH_IF_ID] = IF_ID;
+	SLOTS[CURRENT_SLOT][LATCH_ID_EX] = ID_EX;
+	SLOTS[CURRENT_SLOT][LATCH_EX_MEM] = EX_MEM;
+	SLOTS[CURRENT_SLOT][LATCH_MEM_WB] = MEM_WB;
+	IF_ID = SLOTS[s][LATCH_IF_ID];
+	ID_EX = SLOTS[s][LATCH_ID_EX];
+	EX_MEM = SLOTS[s][LATCH_EX_MEM];
+	MEM_WB = SLOTS[s][LATCH_MEM_WB];
+	CURRENT_SLOT = s;
 }
 
-//writing back to registers, increment instruction count at this stage
-/************************************************************/
-/* writeback (WB) pipeline stage:                                                                          */ 
-/************************************************************/
-void WB() //may need to add more insturctions here, will look later
+//slot s's pipeline register, wherever it is now
+CPU_Pipeline_Reg *slot_reg(int s, int latch)
 {
-	//if bubble happening then skip stage
-	if(MEM_WB.stage_stalled == 1)
-		return; 
-	
-	uint32_t opcode = (MEM_WB.IR & 0xFC000000) >> 26;
-	
-	//printf("opcode = %x\n", opcode);
-	
-	if(opcode == 0) //r type
-	{
-		//r type command
-		uint32_t funct = (MEM_WB.IR & 0x0000003F);// instruction function field	
-		uint32_t rd = (MEM_WB.IR & 0x0000F800) >> 11;//destination reg
-
-		rtypeWB(funct, rd);
-	}
-	else //i or j type (but not jump or branching)
-	{
-		uint32_t rt = (MEM_WB.IR & 0x001F0000) >> 16; //finding rt register
-		
-		switch(opcode)
-		{
-			case 0b001000: { //add immediate
-				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
-				break;
-			}
-			case 0b001001: { //add immediate unsigned
-				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
-				break;	
-			}
-			case 0b001100: { //and immediate
-				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
-				break;	
-			}
-			case 0b001101: { //ORI 
-				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
-				break;
-			}
-			case 0b001110: { //Xori 
-				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
-				break;
-			}
-			case 0b001111: { //load upper immediate
-				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput<<16;
-				break;
-			}
-			case 0b001010: { //SLTI
-				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
-				break;
-			}
-			case 0b100000: { //Loading byte 
-				NEXT_STATE.REGS[rt] = MEM_WB.LMD;
-				break;	
-			}
-			case 0b100001:{ //Loading halfword
-				NEXT_STATE.REGS[rt] = MEM_WB.LMD;
-				break;	
-			}
-			case 0b100011: { //Load word, 32 bits
-				NEXT_STATE.REGS[rt] = MEM_WB.LMD;
-				break;	
-			}
-			case 0b000011: { //JAL
-				NEXT_STATE.REGS[31] = MEM_WB.PC + 4; 	
-			}
-			default: {
-				//not handled yet	
-			}
-		}
+	if(s != CURRENT_SLOT)
+		return &SLOTS[s][latch];
+	switch(latch) {
+		case LATCH_IF_ID:
+			return &IF_ID;
+		case LATCH_ID_EX:
+			return &ID_EX;
+		case LATCH_EX_MEM:
+			return &EX_MEM;
+		default:
+			return &MEM_WB;
 	}
-	CURRENT_STATE = NEXT_STATE;
-	
-	INSTRUCTION_COUNT++; //increasing instriction count after WB stage, don't know if end is good idea but c'est la vie
 }
 
-//writing back r type commands, most to just next state destination reg
-void rtypeWB(uint32_t funct, uint32_t rd)
+//can the instruction decoded in the current slot issue with the older slots
+//of its group? Not if it reads a register or HI/LO one of them writes (no
+//forwarding inside a group), or if it accesses memory or is a MULT/DIV and
+//one of them does too, or with delay slots if it is a branch and one of them
+//is too. Returns 1 for a conflict, which splits the group here.
+int issue_conflict(uint32_t rs, uint32_t rt, int reads_hi_lo)
 {
-	switch(funct)
+	IssueStats *stats = &CORES[CURRENT_CORE].issue;
+	uint32_t opcode = ID_EX.IR >> 26;
+	int memory = load_store(opcode, 0) != 0 || (opcode == 0 && (ID_EX.IR & 0x3F) == FUNCT_SYNC);
+	int muldiv = writes_hi_lo(&ID_EX) == 3;
+	int s;
+	for(s = 0; s < CURRENT_SLOT; s++)
 	{
-		case 0b100000: { //ADD, pulled from brenden's alu ops because I didn't want to write out all the codes again
-			NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
-			break;
-		}
-		case 0b100001: { //ADDIU
-			NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
-		}
-		case 0b100010: { //SUB
-			NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
-			break;
-		}
-		case 0b100011: { //SUBU
-			NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
-			break;
-		}
-		case 0b100100: { //AND
-			NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
-			break;
-		}
-		case 0b100101: { //OR
-			NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
-			break;
-		}
-		case 0b100110: { //XOR
-			NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
-			break;
-		}
-		case 0b100111: { //NOR
-			NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
-			break;
-		}
-		case 0b101010: { //SLT
-			NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
-			break;
-		}
-		case 0b011000: { //MULT
-			NEXT_STATE.HI = MEM_WB.HI;
-			NEXT_STATE.LO = MEM_WB.LO;
-			break;
-		}
-		case 0b011001: { //MULTU
-			NEXT_STATE.HI = MEM_WB.HI;
-			NEXT_STATE.LO = MEM_WB.LO;
-			break;
-		}
-		case 0b010000: { //MFHI
-			NEXT_STATE.REGS[rd] = CURRENT_STATE.HI;
-			break;
-		}
-		case 0b010010: { //MFLO
-			NEXT_STATE.REGS[rd] = CURRENT_STATE.LO;
-			break;
-		}
-		case 0b010001: { //MTHI
-			NEXT_STATE.HI = MEM_WB.ALUOutput;
-			break;
-		}
-		case 0b010011: { //MTLO
-			NEXT_STATE.LO = MEM_WB.ALUOutput;
-			break;
-		}
-		case 0b011010: { //DIV
-			NEXT_STATE.HI = MEM_WB.HI;
-			NEXT_STATE.LO = MEM_WB.LO;
-			break;
-		}
-		case 0b011011: { //DIVU
-			NEXT_STATE.HI = MEM_WB.HI;
-			NEXT_STATE.LO = MEM_WB.LO;
-			break;
-		}
-		case 0b000000: { //SLL
-			NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
-			break;
-		}
-		case 0b000010: { //SRL
-			NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
-			break;
+		CPU_Pipeline_Reg *older = &SLOTS[s][LATCH_ID_EX];
+		uint32_t dest = dest_reg(older);
+		if((dest != 0 && (dest == rs || dest == rt)) || (reads_hi_lo && writes_hi_lo(older)))
+		{
+			stats->dependency++;
+			return 1;
 		}
-		case 0b000011: { //SRA
-			NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
-			break;
+		opcode = older->IR >> 26;
+		if(memory && older->stage_stalled == 0 && (load_store(opcode, 0) != 0 || (opcode == 0 && (older->IR & 0x3F) == FUNCT_SYNC)))
+		{
+			stats->memory_port++;
+			return 1;
 		}
-		case 0b001001: { //JALR, may need to change in future
-			//NEXT_STATE.REGS[rd] = MEM_WB.LMD;
-			break;	
+		if(muldiv && writes_hi_lo(older) == 3)
+		{
+			stats->muldiv_unit++;
+			return 1;
 		}
-		case 0x0000000C: { //syscall
-			if(NEXT_STATE.REGS[2] == 0xA)
-			{
-				RUN_FLAG = FALSE;	
-				MEM_WB.ALUOutput = 0x0;
-				break;
-			}
-			printf("SYSCALL\n");
-			break;
+		if(DELAY_SLOT && reg_jump(ID_EX.IR >> 26, ID_EX.IR & 0x3F) && reg_jump(opcode, older->IR & 0x3F))
+		{
+			stats->dependency++; //a branch in a delay slot waits for the one before it to redirect fetch
+			return 1;
 		}
-		default: {
-			//not handled yet			
+	}
+	return 0;
+}
+
+//IF for every slot: the instructions ID held back (slots held .. width - 1)
+//move up to the front in order, and the slots behind them fetch on from PC,
+//up to a SYSCALL
+void superscalar_fetch(int held)
+{
+	int s, kept = ISSUE_WIDTH - held;
+	uint32_t pc = CURRENT_STATE.PC;
+	int stop = slot_reg(ISSUE_WIDTH - 1, LATCH_IF_ID)->IR == 0x0000000C; //SYSCALL already fetched
+	for(s = 0; s < kept; s++)
+		*slot_reg(s, LATCH_IF_ID) = *slot_reg(held + s, LATCH_IF_ID);
+	for(s = kept; s < ISSUE_WIDTH; s++)
+	{
+		CPU_Pipeline_Reg *if_id = slot_reg(s, LATCH_IF_ID);
+		if(stop)
+		{
+			if_id->stage_stalled = 1;
+			if_id->IR = 0x0000000C;
+			continue;
 		}
+		if_id->IR = mem_read_32(pc);
+		if_id->PC = pc;
+		if(TRACE_OUT != NULL)
+			trace_record(TRACE_FETCH, pc, pc, 4);
+		profile_fetch(pc);
+		if_id->stage_stalled = 0;
+		stop = if_id->IR == 0x0000000C;
+		pc += sizeof(uint32_t);
 	}
+	NEXT_STATE.PC = pc;
+}
+
+void superscalar_print()
+{
+	int i, n;
+	printf("Issue width: %d (Multi %%: cycles issuing 2 or more of those issuing any)\n", ISSUE_WIDTH);
+	printf("Core\tCycles");
+	for(n = 0; n <= ISSUE_WIDTH; n++)
+		printf("\t%d-issue", n);
+	printf("\tMulti %%\n");
+	for(i = 0; i < NUM_CORES; i++)
+	{
+		IssueStats *stats = &CORES[i].issue;
+		uint32_t busy = stats->cycles - stats->issued[0], multi = busy - stats->issued[1];
+		printf("%d\t%u", i, stats->cycles);
+		for(n = 0; n <= ISSUE_WIDTH; n++)
+			printf("\t%u", stats->issued[n]);
+		printf("\t%0.2f\n", busy ? 100.0 * multi / busy : 0.0);
+		printf("\tgroups split by a dependency: %u, the memory port: %u, the multiplier/divider: %u, a stall: %u; slots squashed by a branch: %u\n",
+			stats->dependency, stats->memory_port, stats->muldiv_unit, stats->hazard, stats->squashed);
+	}
+	printf("-------------------------------------\n");
 }
 
-//memory accessed
 /************************************************************/
-/* memory access (MEM) pipeline stage:                                                          */ 
+/* Multiplier and divider                                           */
 /************************************************************/
-void MEM()
+//a MULT/MULTU or DIV/DIVU (funct bit 1 set) has just gone through EX: HI/LO are there latency cycles on, and the unit takes the next
+//operation in one cycle if pipelined, else once this one is done
+void muldiv_start(uint32_t funct)
 {
-	MEM_WB.stage_stalled = EX_MEM.stage_stalled;
-	MEM_WB.REG_RD_VALUE = EX_MEM.REG_RD_VALUE;
-	MEM_WB.REG_RS_VALUE = EX_MEM.REG_RS_VALUE;
-	MEM_WB.REG_RT_VALUE = EX_MEM.REG_RT_VALUE;
-	//if stalled then only pass forward stall
-	if(EX_MEM.stage_stalled == 1)
+	MulDivStats *stats = &CORES[CURRENT_CORE].muldiv;
+	int divide = (funct & 0b10) != 0;
+	uint32_t latency = divide ? DIV_LATENCY : MULT_LATENCY;
+	uint32_t free = CYCLE_COUNT + ((divide ? DIV_PIPELINED : MULT_PIPELINED) ? 1 : latency);
+	if(CYCLE_COUNT + latency > HI_LO_READY)
+		HI_LO_READY = CYCLE_COUNT + latency;
+	if(divide)
 	{
-		printf("MEM stage stalled\n"); //just for debugging
-		MEM_WB.stage_stalled = 1;
-		MEM_WB.REG_RD_VALUE = 0;
-		MEM_WB.REG_RS_VALUE = 0;
-		MEM_WB.REG_RT_VALUE = 0;
-		MEM_WB.LO = 0;
-		MEM_WB.HI = 0;
-		return;
-	}
-	
-	if(EX_MEM.Forwarding_Type==3 || EX_MEM.Forwarding_Type==7) {
+		DIV_FREE = free;
+		stats->divs++;
 	}
-	if(EX_MEM.Forwarding_Type==8) {
-		EX_MEM.B=NEXT_STATE.REGS[EX_MEM.REG_RT_VALUE];
-		MEM_WB.B=NEXT_STATE.REGS[EX_MEM.REG_RT_VALUE];
-		EX_MEM.LMD=NEXT_STATE.REGS[EX_MEM.REG_RT_VALUE];
-		MEM_WB.LMD=NEXT_STATE.REGS[EX_MEM.REG_RT_VALUE];
+	else
+	{
+		MULT_FREE = free;
+		stats->mults++;
 	}
+}
 
-	if(EX_MEM.Forwarding_Type==12) {
-		EX_MEM.B=NEXT_STATE.REGS[EX_MEM.REG_RT_VALUE];
-		MEM_WB.B=NEXT_STATE.REGS[EX_MEM.REG_RT_VALUE];
-		EX_MEM.LMD=NEXT_STATE.REGS[EX_MEM.REG_RT_VALUE];
-		MEM_WB.LMD=NEXT_STATE.REGS[EX_MEM.REG_RT_VALUE];
-	}
-	//forwarding the values from pipeline regsisters
-	MEM_WB.IR = EX_MEM.IR; //instruction
-	MEM_WB.ALUOutput = EX_MEM.ALUOutput; //forwarding output before manpulating
-	MEM_WB.ALUOutputLow = EX_MEM.ALUOutputLow;
-	MEM_WB.PC = EX_MEM.PC; //program counter
-	MEM_WB.HI = EX_MEM.HI;
-	MEM_WB.LO = EX_MEM.LO;
-	
-	uint32_t opcode = (MEM_WB.IR & 0xFC000000) >> 26; ///getting opcode
-		
-	if(opcode == 0x00000000) //opcode is zero, r-type command, most likely syscall 
+//would the instruction have to wait to be in EX in the given cycle? MFHI
+//and MFLO until the last MULT/DIV's HI/LO are in, MTHI and MTLO too so the
+//late result does not land after them, a MULT or DIV until its unit is free.
+//Counts the stall.
+int muldiv_wait(uint32_t instruction, uint32_t cycle)
+{
+	MulDivStats *stats = &CORES[CURRENT_CORE].muldiv;
+	uint32_t funct = instruction & 0x3F;
+	if((instruction >> 26) != 0)
+		return 0;
+	if(funct >= 0b010000 && funct <= 0b010011) //MFHI, MTHI, MFLO, MTLO
 	{
-		opcode = MEM_WB.IR & 0x0000003F; //finding function	field
-		if(opcode == 0x0C)
-		{
-			//SYS call, nothing to do with memory access	
-		}
+		if(HI_LO_READY <= cycle)
+			return 0;
+		stats->hi_lo_stalls++;
+		return 1;
 	}
-	else //other two types of commmands (stuff that actually memory access)
+	if(funct >= 0b011000 && funct <= 0b011011)
 	{
-		switch(opcode)
-		{
-			//loading instructions
-			case 0b100000: { //Loading byte of 8 bits, cache read then get from mem if needed
-				//reading in cache then putting into MEM_WB.LMD for safe keeping
-				uint32_t temp_data = cache_reads(EX_MEM.ALUOutput);
-				MEM_WB.LMD = ((temp_data & 0x000000FF) & 0x80) > 0 ? (temp_data | 0xFFFFFF00) : (temp_data & 0x000000FF);
-				break;
-			}
-			case 0b100001:{ //Loading halfword, ditto as above
-				uint32_t temp_data = cache_reads(EX_MEM.ALUOutput);
-				MEM_WB.LMD = ((temp_data & 0x0000FFFF) & 0x8000) > 0 ? (temp_data | 0xFFFF0000) : (temp_data & 0x0000FFFF);
-				break;
-			}
-			case 0b100011: { //Load word, 32 bits, ditto as above
-				MEM_WB.LMD = cache_reads(EX_MEM.ALUOutput);
-				break;
-			}
-			case 0b101000:{ //storing byte, cache write
-				uint32_t temp_data = cache_reads(EX_MEM.ALUOutput);
-				temp_data = (temp_data & 0xFFFFFF00) | (EX_MEM.B & 0x000000FF);
-				cache_writes(EX_MEM.ALUOutput, EX_MEM.B);
-			}
-			case 0b101001: { //storing halfword, cache write
-				uint32_t temp_data = cache_reads(EX_MEM.ALUOutput);
-				temp_data = (temp_data & 0xFFFF0000) | (EX_MEM.B & 0x0000FFFF);
-				cache_writes(EX_MEM.ALUOutput, EX_MEM.B);
-			}
-			case 0b101011: { //store word, cache write
-				cache_writes(EX_MEM.ALUOutput, EX_MEM.B);
-			}
-		}
+		if((funct & 0b10 ? DIV_FREE : MULT_FREE) <= cycle)
+			return 0;
+		stats->unit_stalls++;
+		return 1;
 	}
+	return 0;
 }
 
-int i = 1;
+void muldiv_print()
+{
+	int i;
+	printf("Multiplier: %u cycles%s, divider: %u cycles%s\n", MULT_LATENCY, MULT_PIPELINED ? " pipelined" : "",
+		DIV_LATENCY, DIV_PIPELINED ? " pipelined" : "");
+	printf("Core\tMULT\tDIV\tHI/LO stalls\tUnit stalls\n");
+	for(i = 0; i < NUM_CORES; i++)
+	{
+		MulDivStats *stats = &CORES[i].muldiv;
+		printf("%d\t%u\t%u\t%u\t\t%u\n", i, stats->mults, stats->divs, stats->hi_lo_stalls, stats->unit_stalls);
+	}
+	printf("-------------------------------------\n");
+}
 
-//instruction executed
 /************************************************************/
-/* execution (EX) pipeline stage:                                                                          */ 
+/* Pipeline depth                                                   */
 /************************************************************/
-void EX()
+//extra latches between IF and ID, and between MEM and WB
+int front_stages()
 {
-	
+	return ISSUE_WIDTH == 1 ? FETCH_STAGES + DECODE_STAGES - 2 : 0;
+}
 
-	// printf("Execution #%i\n", i++);
-	if(ID_EX.stage_stalled == 1)
-	{
-		//execute stage stalled
-		EX_MEM.stage_stalled = 1;
-		EX_MEM.imm = 0;
+int memory_stages()
+{
+	return ISSUE_WIDTH == 1 ? MEMORY_STAGES - 1 : 0;
+}
+
+//one cycle along a chain of n extra latches: what a stage has just written
+//to *in goes into the first, each moves one on, and the last takes its place
+void pipe_advance(CPU_Pipeline_Reg *in, CPU_Pipeline_Reg *pipe, int n)
+{
+	CPU_Pipeline_Reg out = pipe[n - 1];
+	memmove(pipe + 1, pipe, (n - 1) * sizeof(CPU_Pipeline_Reg));
+	pipe[0] = *in;
+	*in = out;
+}
+
+void depth_print()
+{
+	int i;
+	printf("Pipeline depth: %d fetch, %d decode, 1 execute, %d memory stages, 1 writeback (%d in all)\n", FETCH_STAGES, DECODE_STAGES,
+		MEMORY_STAGES, FETCH_STAGES + DECODE_STAGES + MEMORY_STAGES + 2);
+	printf("Taken branch penalty: %d cycles\tLoad-use penalty: %d cycles\n", FETCH_STAGES + DECODE_STAGES - 1 - DELAY_SLOT, MEMORY_STAGES);
+	printf("Core\tFlushes\tSquashed\tLoad-use stall cycles\n");
+	for(i = 0; i < NUM_CORES; i++)
+	{
+		DepthStats *stats = &CORES[i].depth;
+		printf("%d\t%u\t%u\t\t%u\n", i, stats->flushes, stats->squashed, stats->load_use);
+	}
+	printf("-------------------------------------\n");
+}
+
+/************************************************************/
+/* Branch delay slots                                               */
+/************************************************************/
+//the PC a branch's offset counts from: the delay slot's with DELAY_SLOT
+uint32_t branch_pc(uint32_t pc)
+{
+	return DELAY_SLOT ? pc + 4 : pc;
+}
+
+//the return address JAL and JALR write: past the delay slot with DELAY_SLOT
+uint32_t link_pc(uint32_t pc)
+{
+	return DELAY_SLOT ? pc + 8 : pc + 4;
+}
+
+//where an instruction at pc going on to next_pc sends fetch once the one
+//after it has run: a taken branch's or a jump's target, else 0. A branch in
+//a delay slot so takes effect after the first instruction at the target.
+uint32_t delay_redirect(uint32_t pc, uint32_t instruction, uint32_t next_pc)
+{
+	uint32_t opcode = instruction >> 26;
+	if(!reg_jump(opcode, instruction & 0x3F))
+		return 0;
+	return opcode == 0b000010 || opcode == 0b000011 || opcode == 0 || next_pc != pc + 8 ? next_pc : 0; //jumps always
+}
+
+//a branch or jump at pc has executed
+void delay_slot_count(uint32_t pc, int taken)
+{
+	DelaySlotStats *stats = &CORES[CURRENT_CORE].delay;
+	stats->branches++;
+	stats->taken += taken != 0;
+	if(mem_read_32(pc + 4) == 0)
+		stats->nops++;
+	else
+		stats->filled++;
+}
+
+void delay_slot_print()
+{
+	int i;
+	printf("Branch delay slots (Filled %%: slots doing useful work, the rest are NOPs)\n");
+	printf("Core\tBranches\tTaken\tFilled\tNOPs\tFilled %%\n");
+	for(i = 0; i < NUM_CORES; i++)
+	{
+		DelaySlotStats *stats = &CORES[i].delay;
+		printf("%d\t%u\t\t%u\t%u\t%u\t%.2f\n", i, stats->branches, stats->taken, stats->filled, stats->nops,
+			stats->branches ? 100.0 * stats->filled / stats->branches : 0.0);
+	}
+	printf("-------------------------------------\n");
+}
+
+/************************************************************/
+/* Cache hierarchy                                                  */
+/************************************************************/
+//level 0 is L1Cache, which is thread-local and so not in CACHE_LEVELS
+Cache *cache_level(int level)
+{
+	return level == 0 ? &L1Cache : CACHE_LEVELS[level];
+}
+
+//(re)allocate every configured level, empty, with its stats cleared
+void cache_init()
+{
+	int level;
+	for(level = 0; level < MAX_CACHE_LEVELS; level++)
+		cache_alloc(cache_level(level), level == 0);
+	memset(&MSHR_STATS, 0, sizeof(MSHR_STATS));
+	dram_reset();
+	threec_reset();
+	write_buffer_reset();
+	victim_reset();
+	prefetch_reset();
+	batch_reset();
+	core_caches();
+}
+
+//(re)allocate one cache's arrays for its geometry, freeing them when sets
+//is 0; data adds the per-line arrays only an L1 keeps
+void cache_alloc(Cache *cache, int data)
+{
+	free(cache->tags);
+	free(cache->stamps);
+	free(cache->words);
+	free(cache->prefetched);
+	free(cache->ready);
+	free(cache->mesi);
+	free(cache->lost);
+	free(cache->set_heat);
+	free(cache->region_heat);
+	cache->tags = NULL;
+	cache->stamps = NULL;
+	cache->words = NULL;
+	cache->prefetched = NULL;
+	cache->ready = NULL;
+	cache->mesi = NULL;
+	cache->lost = NULL;
+	cache->set_heat = NULL;
+	cache->region_heat = NULL;
+	cache->clock = 0;
+	cache->hits = 0;
+	cache->misses = 0;
+	if(cache->sets == 0)
+		return;
+	for(cache->offset_bits = 0; (1u << cache->offset_bits) < cache->block_bytes; cache->offset_bits++)
+		;
+	for(cache->index_bits = 0; (1u << cache->index_bits) < cache->sets; cache->index_bits++)
+		;
+	cache->stride = (cache->ways + CACHE_VECTOR_WAYS - 1) / CACHE_VECTOR_WAYS * CACHE_VECTOR_WAYS;
+	cache->tags = calloc(cache->sets * cache->stride, sizeof(uint32_t));
+	cache->stamps = malloc(cache->sets * cache->stride * sizeof(uint32_t));
+	cache->set_heat = calloc(cache->sets * HEAT_COUNTERS, sizeof(uint32_t));
+	cache->region_heat = calloc((HEAT_REGIONS + 1) * HEAT_COUNTERS, sizeof(uint32_t));
+	if(data)
+	{
+		cache->words = calloc(cache->sets * cache->ways * cache->block_bytes / 4, sizeof(uint32_t));
+		cache->prefetched = calloc(cache->sets * cache->ways, sizeof(uint8_t));
+		cache->ready = calloc(cache->sets * cache->ways, sizeof(uint32_t));
+		cache->mesi = calloc(cache->sets * cache->ways, sizeof(uint8_t));
+		cache->lost = calloc(cache->sets * cache->ways, sizeof(uint32_t));
+	}
+	cache_flush(cache);
+}
+
+//invalidate every block, keeping the stats. Invalid ways get the oldest
+//stamp so the LRU search fills them first, padding slots the newest so
+//it never picks them.
+void cache_flush(Cache *cache)
+{
+	uint32_t slot;
+	if(cache->sets == 0)
+		return;
+	memset(cache->tags, 0, cache->sets * cache->stride * sizeof(uint32_t));
+	for(slot = 0; slot < cache->sets * cache->stride; slot++)
+		cache->stamps[slot] = slot % cache->stride < cache->ways ? 0 : 0xFFFFFFFF;
+	if(cache->prefetched != NULL)
+		memset(cache->prefetched, 0, cache->sets * cache->ways);
+	if(cache->mesi != NULL)
+	{
+		memset(cache->mesi, MESI_INVALID, cache->sets * cache->ways);
+		memset(cache->lost, 0, cache->sets * cache->ways * sizeof(uint32_t));
+	}
+}
+
+//geometry from "<bytes>:<ways>:<block bytes>[:<latency>]" or "off"; returns 0 if it is not a valid cache
+int cache_configure(Cache *cache, char *value)
+{
+	uint32_t bytes, ways, block, latency = cache->latency;
+	if(strcmp(value, "off") == 0 && cache != &L1Cache)
+	{
+		cache->sets = 0;
+		cache_init();
+		return 1;
+	}
+	if(sscanf(value, "%u:%u:%u:%u", &bytes, &ways, &block, &latency) < 3)
+		return 0;
+	if(ways == 0 || block < 4 || (block & (block - 1)) != 0 || bytes % (ways * block) != 0)
+		return 0;
+	uint32_t sets = bytes / (ways * block);
+	if(sets == 0 || (sets & (sets - 1)) != 0)
+		return 0;
+	cache->sets = sets;
+	cache->ways = ways;
+	cache->block_bytes = block;
+	cache->latency = cache == &L1Cache ? 0 : latency; //L1 hits are part of the MEM stage
+	cache_init();
+	return 1;
+}
+
+//way of set holding tag (tag + 1 as stored), or -1: one vector compare per
+//CACHE_VECTOR_WAYS tag slots, the padding slots are 0 and never match
+int cache_lookup(Cache *cache, uint32_t set, uint32_t tag)
+{
+	uint32_t *tags = cache->tags + set * cache->stride;
+	uint32_t way;
+#if defined(__AVX2__)
+	__m256i key = _mm256_set1_epi32(tag);
+	for(way = 0; way < cache->ways; way += 8)
+	{
+		int match = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_loadu_si256((__m256i *) (tags + way)), key)));
+		if(match != 0)
+			return way + __builtin_ctz(match);
+	}
+#elif defined(__SSE2__)
+	__m128i key = _mm_set1_epi32(tag);
+	for(way = 0; way < cache->ways; way += 4)
+	{
+		int match = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128((__m128i *) (tags + way)), key)));
+		if(match != 0)
+			return way + __builtin_ctz(match);
+	}
+#else
+	for(way = 0; way < cache->ways; way++)
+	{
+		if(tags[way] == tag)
+			return way;
+	}
+#endif
+	return -1;
+}
+
+//bump one heatmap counter for a set and for the region addr falls in
+void cache_heat(Cache *cache, uint32_t set, uint32_t addr, int counter)
+{
+	uint32_t region = (addr - MEM_DATA_BEGIN) >> HEAT_REGION_BITS;
+	if(addr < MEM_DATA_BEGIN || region >= HEAT_REGIONS)
+		region = HEAT_REGIONS;
+	cache->set_heat[set * HEAT_COUNTERS + counter]++;
+	cache->region_heat[region * HEAT_COUNTERS + counter]++;
+}
+
+//heatmaps of every level as CSV: one row per set, then one per region touched
+void cache_map(char *filename)
+{
+	FILE * fp;
+	int level;
+	uint32_t i;
+
+	fp = fopen(filename, "w");
+	if(fp == NULL)
+	{
+		printf("Error: Can't open cache map file %s\n", filename);
+		return;
+	}
+	fprintf(fp, "level,kind,index,address,accesses,misses,evictions\n");
+	for(level = 0; level < MAX_CACHE_LEVELS; level++)
+	{
+		Cache *cache = cache_level(level);
+		if(cache->sets == 0)
+			continue;
+		for(i = 0; i < cache->sets; i++)
+		{
+			uint32_t *heat = cache->set_heat + i * HEAT_COUNTERS;
+			fprintf(fp, "%s,set,%u,,%u,%u,%u\n", cache->name, i, heat[HEAT_ACCESS], heat[HEAT_MISS], heat[HEAT_EVICT]);
+		}
+		for(i = 0; i <= HEAT_REGIONS; i++)
+		{
+			uint32_t *heat = cache->region_heat + i * HEAT_COUNTERS;
+			if(heat[HEAT_ACCESS] == 0 && heat[HEAT_EVICT] == 0)
+				continue;
+			if(i == HEAT_REGIONS)
+				fprintf(fp, "%s,region,other,,%u,%u,%u\n", cache->name, heat[HEAT_ACCESS], heat[HEAT_MISS], heat[HEAT_EVICT]);
+			else
+				fprintf(fp, "%s,region,%u,0x%08x,%u,%u,%u\n", cache->name, i, MEM_DATA_BEGIN + (i << HEAT_REGION_BITS),
+					heat[HEAT_ACCESS], heat[HEAT_MISS], heat[HEAT_EVICT]);
+		}
+	}
+	fclose(fp);
+	printf("Cache map written to %s\n", filename);
+}
+
+//least recently used way of a set, invalid ways first
+int cache_victim(Cache *cache, uint32_t set)
+{
+	uint32_t *stamps = cache->stamps + set * cache->stride;
+	uint32_t way, victim = 0;
+#if defined(__AVX2__)
+	__m256i oldest = _mm256_loadu_si256((__m256i *) stamps);
+	for(way = 8; way < cache->ways; way += 8)
+		oldest = _mm256_min_epu32(oldest, _mm256_loadu_si256((__m256i *) (stamps + way)));
+	__m128i half = _mm_min_epu32(_mm256_castsi256_si128(oldest), _mm256_extracti128_si256(oldest, 1));
+	half = _mm_min_epu32(half, _mm_shuffle_epi32(half, 0x4E));
+	half = _mm_min_epu32(half, _mm_shuffle_epi32(half, 0xB1));
+	__m256i key = _mm256_broadcastd_epi32(half);
+	for(way = 0; way < cache->ways; way += 8)
+	{
+		int match = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_loadu_si256((__m256i *) (stamps + way)), key)));
+		if(match != 0)
+		{
+			victim = way + __builtin_ctz(match);
+			break;
+		}
+	}
+#else
+	for(way = 1; way < cache->ways; way++)
+	{
+		if(stamps[way] < stamps[victim])
+			victim = way;
+	}
+#endif
+	return victim;
+}
+
+//install tag in set over the way with the oldest stamp: an invalid way if
+//there is one, or else the least recently used. L1Cache also reads the
+//block's data (memory is always current, the L1 is write-through).
+int cache_fill(Cache *cache, uint32_t set, uint32_t tag)
+{
+	uint32_t way, victim = cache_victim(cache, set);
+	if(cache->tags[set * cache->stride + victim] != 0)
+	{
+		uint32_t evicted = ((cache->tags[set * cache->stride + victim] - 1) << cache->index_bits) | set;
+		cache_heat(cache, set, evicted << cache->offset_bits, HEAT_EVICT);
+		if(cache == &L1Cache && VICTIM_BLOCKS > 0)
+			victim_insert(evicted);
+	}
+	cache->tags[set * cache->stride + victim] = tag;
+	if(cache == &L1Cache)
+	{
+		uint32_t line = set * cache->ways + victim;
+		uint32_t base = (((tag - 1) << cache->index_bits) | set) << cache->offset_bits;
+		for(way = 0; way < cache->block_bytes / 4; way++)
+			cache->words[line * cache->block_bytes / 4 + way] = mem_read_32(base + 4 * way);
+		if(cache->prefetched[line])
+			PREFETCH_STATS.useless++;
+		cache->prefetched[line] = 0;
+	}
+	return victim;
+}
+
+//walks the levels from level down for addr, filling each one that misses,
+//for a request leaving L1 at cycle arrival.
+//Returns the cycles to bring the block up from the level that had it.
+uint32_t cache_below(int level, uint32_t addr, uint32_t arrival)
+{
+	if(IN_QUANTUM)
+		return uncore_access(level, addr, arrival);
+	for(; level < MAX_CACHE_LEVELS; level++)
+	{
+		Cache *cache = cache_level(level);
+		if(cache->sets == 0)
+			continue;
+		uint32_t block = addr >> cache->offset_bits;
+		uint32_t set = block & (cache->sets - 1);
+		uint32_t tag = (block >> cache->index_bits) + 1;
+		int way = cache_lookup(cache, set, tag);
+		int hit = way >= 0;
+		if(hit)
+			cache->hits++;
+		else
+		{
+			cache->misses++;
+			way = cache_fill(cache, set, tag);
+		}
+		cache->stamps[set * cache->stride + way] = ++cache->clock;
+		cache_heat(cache, set, addr, HEAT_ACCESS);
+		if(!hit)
+			cache_heat(cache, set, addr, HEAT_MISS);
+		if(THREEC_ENABLED)
+			threec_access(level, block, hit, 1);
+		if(hit)
+			return cache->latency;
+	}
+	if(DRAM_ENABLED)
+		return dram_read(addr, arrival);
+	return MEMORY_LATENCY;
+}
+
+//demand access to addr through the whole hierarchy, leaving the L1 line
+//holding it in *line. Returns the cycles of a miss below L1Cache (0 on an
+//L1 hit). A block that a prefetch has not delivered yet is not a miss: its
+//arrival cycle is left in *ready (0 when there is nothing to wait for).
+//With several cores write says whether the other L1s' copies go.
+uint32_t cache_hierarchy(uint32_t addr, int write, uint32_t *line, uint32_t *ready)
+{
+	uint32_t block = addr >> L1Cache.offset_bits;
+	uint32_t set = block & (L1Cache.sets - 1);
+	uint32_t tag = (block >> L1Cache.index_bits) + 1;
+	uint32_t cycles = 0;
+	int way = cache_lookup(&L1Cache, set, tag);
+	int hit = way >= 0;
+
+	*ready = 0;
+	if(hit)
+	{
+		L1Cache.hits++;
+		*line = set * L1Cache.ways + way;
+		if(L1Cache.prefetched[*line])
+		{
+			hit = 2;
+			L1Cache.prefetched[*line] = 0;
+			PREFETCH_STATS.useful++;
+			if(L1Cache.ready[*line] > CYCLE_COUNT + 1)
+			{
+				PREFETCH_STATS.late++;
+				*ready = L1Cache.ready[*line];
+			}
+		}
+		if(NUM_CORES > 1 && write)
+			cycles = coherence_write_hit(set, way, block);
+	}
+	else
+	{
+		uint32_t supplied = 0;
+		int state = MESI_EXCLUSIVE;
+		if(NUM_CORES > 1)
+			state = coherence_miss(block, write, &supplied);
+		//a block waiting in a stream buffer moves into L1Cache as a hit
+		if(PREFETCHER == PREFETCH_STREAM && stream_lookup(addr, ready))
+		{
+			hit = 2;
+			L1Cache.hits++;
+		}
+		else
+		{
+			L1Cache.misses++;
+			if(supplied > 0)
+				cycles = supplied;
+			else if(VICTIM_BLOCKS > 0 && victim_lookup(block))
+				cycles = VICTIM_LATENCY;
+			else
+				cycles = cache_below(1, addr, CYCLE_COUNT + 1);
+		}
+		way = cache_fill(&L1Cache, set, tag);
+		*line = set * L1Cache.ways + way;
+		if(NUM_CORES > 1)
+			L1Cache.mesi[*line] = state;
+	}
+	L1Cache.stamps[set * L1Cache.stride + way] = ++L1Cache.clock;
+	cache_heat(&L1Cache, set, addr, HEAT_ACCESS);
+	if(hit == 0)
+		cache_heat(&L1Cache, set, addr, HEAT_MISS);
+	if(THREEC_ENABLED)
+		threec_access(0, block, hit != 0, 1);
+	if(PREFETCHER != PREFETCH_NONE)
+		prefetch_access(ACCESS_PC, addr, hit);
+	return cycles;
+}
+
+//tag checks only: trace replay stops here, cache_reads/cache_writes go on
+//to move the data and stall. Returns the miss cycles, 0 on an L1 hit.
+uint32_t cache_access(uint32_t addr)
+{
+	uint32_t line, ready;
+	uint32_t cycles = cache_hierarchy(addr, 0, &line, &ready);
+	return cycles ? cycles : ready > CYCLE_COUNT + 1 ? ready - CYCLE_COUNT - 1 : 0;
+}
+
+//reading from cache
+uint32_t cache_reads(uint32_t addr)
+{
+	uint32_t line, ready;
+	if(WRITE_BUFFER_DEPTH > 0 && write_buffer_forward(addr))
+	{
+		DATA_READY = 0;
+		return mem_read_32(addr); //write-through, memory already has the buffered word
+	}
+	uint32_t cycles = cache_hierarchy(addr, 0, &line, &ready);
+	DATA_READY = 0;
+	if(cycles > 0)
+		cache_miss(addr, cycles);
+	else if(ready > 0)
+		cache_wait(ready);
+	else if(NUM_MSHRS > 0)
+		mshr_merge(addr);
+	uint32_t word = L1Cache.words[line * L1Cache.block_bytes / 4 + ((addr & (L1Cache.block_bytes - 1)) >> 2)];
+	sim_print("Read from cache: %x\n",word);				
+	return word;
+}
+
+//writing to cache with address and new data
+void cache_writes(uint32_t addr, uint32_t new)
+{
+	uint32_t line, ready;
+	if(WRITE_BUFFER_DEPTH > 0)
+	{
+		uint32_t block = addr >> L1Cache.offset_bits;
+		uint32_t set = block & (L1Cache.sets - 1);
+		int way = cache_lookup(&L1Cache, set, (block >> L1Cache.index_bits) + 1);
+		if(way >= 0)
+		{
+			L1Cache.hits++;
+			L1Cache.stamps[set * L1Cache.stride + way] = ++L1Cache.clock;
+			L1Cache.words[(set * L1Cache.ways + way) * L1Cache.block_bytes / 4 + ((addr & (L1Cache.block_bytes - 1)) >> 2)] = new;
+			if(NUM_CORES > 1)
+				coherence_write_hit(set, way, block); //the buffer hides the upgrade
+		}
+		else
+		{
+			L1Cache.misses++;
+			cache_heat(&L1Cache, set, addr, HEAT_MISS);
+			if(NUM_CORES > 1)
+				coherence_miss(block, 1, &line); //no allocate, but the other copies still go
+		}
+		cache_heat(&L1Cache, set, addr, HEAT_ACCESS);
+		if(THREEC_ENABLED)
+			threec_access(0, block, way >= 0, 0);
+		write_buffer_store(addr);
+		mem_write_32(addr, new);
+		sim_print("Wrote to write buffer: %x\n", new);
+		return;
+	}
+	uint32_t cycles = cache_hierarchy(addr, 1, &line, &ready);
+	if(cycles > 0)
+		cache_miss(addr, cycles);
+	else if(ready > 0)
+		cache_wait(ready);
+	else if(NUM_MSHRS > 0)
+		mshr_merge(addr);
+	//writing data from store instruction to the cache block, and through to memory
+	L1Cache.words[line * L1Cache.block_bytes / 4 + ((addr & (L1Cache.block_bytes - 1)) >> 2)] = new;
+	mem_write_32(addr, new);
+	sim_print("Wrote to cache: %x\n", new);
+}
+
+//waiting for a block already on its way (a late prefetch): the blocking
+//cache freezes until it arrives, the non-blocking one holds back the readers
+void cache_wait(uint32_t ready)
+{
+	if(NUM_MSHRS == 0)
+	{
+		CACHE_MISS_FLAG = 1;
+		CACHE_STALL_COUNT = ready - CYCLE_COUNT - 1;
+		return;
+	}
+	DATA_READY = ready;
+}
+
+//a miss taking cycles to fill: the blocking cache freezes the pipeline for
+//them (see cycle()), the non-blocking one hands the miss to an MSHR and
+//sets DATA_READY, freezing only until an MSHR frees up if all are busy
+void cache_miss(uint32_t addr, uint32_t cycles)
+{
+	int i, slot = 0;
+	uint32_t start = CYCLE_COUNT + 1;
+	if(NUM_MSHRS == 0)
+	{
+		CACHE_MISS_FLAG = 1;
+		CACHE_STALL_COUNT = cycles;
+		return;
+	}
+	for(i = 0; i < NUM_MSHRS; i++)
+	{
+		if(MSHRS[i].ready < MSHRS[slot].ready)
+			slot = i;
+	}
+	if(MSHRS[slot].ready > start) //all busy, wait for the first to finish
+	{
+		MSHR_STATS.full_stalls++;
+		MSHR_STATS.full_cycles += MSHRS[slot].ready - start;
+		CACHE_MISS_FLAG = 1;
+		CACHE_STALL_COUNT = MSHRS[slot].ready - start;
+		start = MSHRS[slot].ready;
+	}
+	MSHRS[slot].block = addr >> L1Cache.offset_bits;
+	MSHRS[slot].ready = start + cycles;
+	MSHR_STATS.primary++;
+	DATA_READY = MSHRS[slot].ready;
+}
+
+//an L1 tag hit on a block still in flight is a secondary miss: it waits for the same MSHR
+void mshr_merge(uint32_t addr)
+{
+	int i;
+	for(i = 0; i < NUM_MSHRS; i++)
+	{
+		if(MSHRS[i].block == addr >> L1Cache.offset_bits && MSHRS[i].ready > CYCLE_COUNT + 1)
+		{
+			L1Cache.hits--;
+			L1Cache.misses++;
+			MSHR_STATS.secondary++;
+			DATA_READY = MSHRS[i].ready;
+			return;
+		}
+	}
+}
+
+//no misses in flight and no loads pending, stats kept
+void mshr_reset()
+{
+	memset(MSHRS, 0, sizeof(MSHRS));
+	memset(REG_READY, 0, sizeof(REG_READY));
+}
+
+//memory-level parallelism: how many misses are outstanding this cycle
+void mshr_cycle()
+{
+	int i, busy = 0;
+	for(i = 0; i < NUM_MSHRS; i++)
+		busy += MSHRS[i].ready > CYCLE_COUNT;
+	if(busy > 0)
+	{
+		MSHR_STATS.busy_cycles++;
+		MSHR_STATS.occupancy += busy;
+	}
+}
+
+//does instruction read a register whose load has not arrived yet? Stalls are
+//counted here, the caller holds the instruction back for a cycle
+int mshr_wait(uint32_t instruction, uint32_t cycle)
+{
+	int uses_rs, uses_rt;
+	source_regs(instruction, &uses_rs, &uses_rt);
+	if((uses_rs && REG_READY[(instruction >> 21) & 0x1F] > cycle) || (uses_rt && REG_READY[(instruction >> 16) & 0x1F] > cycle))
+	{
+		MSHR_STATS.dependency_cycles++;
+		return 1;
+	}
+	return 0;
+}
+
+/************************************************************/
+/* DRAM controller                                                  */
+/************************************************************/
+void dram_reset()
+{
+	memset(DRAM, 0, sizeof(DRAM));
+	memset(&DRAM_STATS, 0, sizeof(DRAM_STATS));
+}
+
+//channel, bank and row of addr under DRAM_MAP
+void dram_decode(uint32_t addr, uint32_t *channel, uint32_t *bank, uint32_t *row)
+{
+	uint32_t bits[DRAM_FIELDS], value[DRAM_FIELDS];
+	uint32_t rest = addr / DRAM_BURST_BYTES;
+	int i;
+	bits[DRAM_COLUMN] = __builtin_ctz(DRAM_ROW_BYTES / DRAM_BURST_BYTES);
+	bits[DRAM_CHANNEL] = __builtin_ctz(DRAM_CHANNELS);
+	bits[DRAM_BANK] = __builtin_ctz(DRAM_BANKS);
+	bits[DRAM_ROW] = 32; //whatever is left
+	for(i = 0; i < DRAM_FIELDS; i++)
+	{
+		int field = DRAM_MAP[i];
+		value[field] = bits[field] >= 32 ? rest : rest & ((1u << bits[field]) - 1);
+		rest = bits[field] >= 32 ? 0 : rest >> bits[field];
+	}
+	*channel = value[DRAM_CHANNEL];
+	*bank = value[DRAM_BANK];
+	*row = value[DRAM_ROW];
+}
+
+//run one request on its bank, opening and closing rows as the page policy
+//says, then on the channel's data bus. Returns the cycle its data is through.
+uint32_t dram_issue(DRAMChannel *channel, uint32_t bank, uint32_t row, uint32_t arrival)
+{
+	DRAMBank *b = &channel->banks[bank];
+	uint32_t start = arrival > b->ready ? arrival : b->ready;
+	uint32_t activate = 0;
+	if(b->open && b->row == row)
+		DRAM_STATS.row_hits++;
+	else if(b->open)
+	{
+		DRAM_STATS.row_conflicts++;
+		activate = DRAM_T_RP + DRAM_T_RCD;
+	}
+	else
+	{
+		DRAM_STATS.row_misses++;
+		activate = DRAM_T_RCD;
+	}
+	uint32_t data = start + activate + DRAM_T_CAS;
+	if(data < channel->bus_free)
+		data = channel->bus_free;
+	channel->bus_free = data + DRAM_T_BURST;
+	b->row = row;
+	b->open = DRAM_PAGE_POLICY == DRAM_OPEN_PAGE;
+	b->ready = b->open ? start + activate + DRAM_T_BURST : channel->bus_free + DRAM_T_RP; //closed page precharges right after
+	return channel->bus_free;
+}
+
+//a read reaching the controller at cycle arrival: FR-FCFS over it and the
+//writes queued before it on its channel. Returns its latency.
+uint32_t dram_read(uint32_t addr, uint32_t arrival)
+{
+	uint32_t c, bank, row;
+	uint32_t at = arrival + DRAM_OVERHEAD / 2;
+	dram_decode(addr, &c, &bank, &row);
+	DRAMChannel *channel = &DRAM[c];
+	DRAM_STATS.reads++;
+	for(;;)
+	{
+		//the read is the youngest candidate: it goes next only as the oldest row hit
+		int i, pick = -1, oldest = -1;
+		for(i = 0; i < channel->queued; i++)
+		{
+			DRAMRequest *write = &channel->queue[i];
+			if(write->arrival > at)
+				continue;
+			if(oldest < 0)
+				oldest = i;
+			if(pick < 0 && channel->banks[write->bank].open && channel->banks[write->bank].row == write->row)
+				pick = i;
+		}
+		if(pick < 0 && !(channel->banks[bank].open && channel->banks[bank].row == row))
+			pick = oldest;
+		if(pick < 0)
+		{
+			if(oldest >= 0)
+				DRAM_STATS.reordered++;
+			uint32_t latency = dram_issue(channel, bank, row, at) + (DRAM_OVERHEAD - DRAM_OVERHEAD / 2) - arrival;
+			DRAM_STATS.read_cycles += latency;
+			return latency;
+		}
+		if(pick != oldest)
+			DRAM_STATS.reordered++;
+		dram_issue(channel, channel->queue[pick].bank, channel->queue[pick].row, channel->queue[pick].arrival);
+		channel->queued--;
+		memmove(channel->queue + pick, channel->queue + pick + 1, (channel->queued - pick) * sizeof(DRAMRequest));
+	}
+}
+
+//a posted write reaching the controller at cycle arrival, queued until a
+//read schedules past it; a full queue sends its oldest write first
+void dram_write(uint32_t addr, uint32_t arrival)
+{
+	uint32_t c, bank, row;
+	if(IN_QUANTUM)
+	{
+		uncore_log(0, addr, arrival);
+		return;
+	}
+	dram_decode(addr, &c, &bank, &row);
+	DRAMChannel *channel = &DRAM[c];
+	DRAM_STATS.writes++;
+	if(channel->queued == DRAM_QUEUE)
+	{
+		dram_issue(channel, channel->queue[0].bank, channel->queue[0].row, channel->queue[0].arrival);
+		channel->queued--;
+		memmove(channel->queue, channel->queue + 1, channel->queued * sizeof(DRAMRequest));
+	}
+	channel->queue[channel->queued].bank = bank;
+	channel->queue[channel->queued].row = row;
+	channel->queue[channel->queued].arrival = arrival + DRAM_OVERHEAD / 2;
+	channel->queued++;
+}
+
+//what dram_read would take for addr on an idle channel, going by the open
+//rows alone: the estimate a core gets inside a parallel quantum
+uint32_t dram_probe(uint32_t addr)
+{
+	uint32_t c, bank, row;
+	dram_decode(addr, &c, &bank, &row);
+	DRAMBank *b = &DRAM[c].banks[bank];
+	uint32_t activate = !b->open ? DRAM_T_RCD : b->row == row ? 0 : DRAM_T_RP + DRAM_T_RCD;
+	return DRAM_OVERHEAD + activate + DRAM_T_CAS + DRAM_T_BURST;
+}
+
+//"row:bank:channel:column" style, high field first; returns 0 unless it names each field once
+int dram_parse_map(char *value)
+{
+	const char *names[DRAM_FIELDS] = { "row", "bank", "channel", "column" };
+	int map[DRAM_FIELDS], seen = 0, count = 0, i;
+	char copy[64], *field;
+	strncpy(copy, value, sizeof(copy) - 1);
+	copy[sizeof(copy) - 1] = 0;
+	for(field = strtok(copy, ":"); field != NULL; field = strtok(NULL, ":"))
+	{
+		for(i = 0; i < DRAM_FIELDS && strcmp(field, names[i]) != 0; i++)
+			;
+		if(i == DRAM_FIELDS || (seen & (1 << i)))
+			return 0;
+		seen |= 1 << i;
+		map[count++] = i;
+	}
+	if(count != DRAM_FIELDS)
+		return 0;
+	for(i = 0; i < DRAM_FIELDS; i++)
+		DRAM_MAP[i] = map[DRAM_FIELDS - 1 - i];
+	return 1;
+}
+
+void dram_print()
+{
+	const char *names[DRAM_FIELDS] = { "row", "bank", "channel", "column" };
+	uint32_t accesses = DRAM_STATS.row_hits + DRAM_STATS.row_misses + DRAM_STATS.row_conflicts;
+	int i;
+	printf("DRAM: %d channel(s) x %d banks, %u-byte rows, %s page, map ", DRAM_CHANNELS, DRAM_BANKS, DRAM_ROW_BYTES,
+		DRAM_PAGE_POLICY == DRAM_OPEN_PAGE ? "open" : "closed");
+	for(i = DRAM_FIELDS - 1; i >= 0; i--)
+		printf("%s%s", names[DRAM_MAP[i]], i ? ":" : "\n");
+	printf("Reads: %u\tWrites: %u\tReordered (FR-FCFS): %u\n", DRAM_STATS.reads, DRAM_STATS.writes, DRAM_STATS.reordered);
+	printf("Row hits: %u\tRow misses: %u\tRow conflicts: %u\n", DRAM_STATS.row_hits, DRAM_STATS.row_misses, DRAM_STATS.row_conflicts);
+	printf("Row-buffer hit rate: %0.2f\n", accesses ? 100.0 * DRAM_STATS.row_hits / accesses : 0.0);
+	printf("Average read latency: %0.1f cycles\n", DRAM_STATS.reads ? (double) DRAM_STATS.read_cycles / DRAM_STATS.reads : 0.0);
+	printf("-------------------------------------\n");
+}
+
+/************************************************************/
+/* 3C miss classification                                           */
+/************************************************************/
+//fresh bitmaps and shadow caches sized to the current levels
+void threec_reset()
+{
+	int level;
+	for(level = 0; level < MAX_CACHE_LEVELS; level++)
+		threec_alloc(&THREEC[level], cache_level(level));
+}
+
+//one level's bitmap and shadow cache, freed when 3C is off or the level is not there
+void threec_alloc(ThreeC *three, Cache *cache)
+{
+	uint32_t i;
+	for(i = 0; i < three->seen_pages; i++)
+		free(three->seen[i]);
+	free(three->seen);
+	free(three->block);
+	free(three->prev);
+	free(three->next);
+	free(three->chain);
+	free(three->buckets);
+	memset(three, 0, sizeof(ThreeC));
+	if(!THREEC_ENABLED || cache->sets == 0)
+		return;
+	three->seen_pages = (uint32_t) ((1ull << (32 - cache->offset_bits)) >> THREEC_PAGE_BITS);
+	if(three->seen_pages == 0)
+		three->seen_pages = 1;
+	three->seen = calloc(three->seen_pages, sizeof(uint64_t *));
+	three->lines = cache->sets * cache->ways;
+	for(three->hash_bits = 1; (1u << three->hash_bits) < 2 * three->lines; three->hash_bits++)
+		;
+	three->block = malloc(three->lines * sizeof(uint32_t));
+	three->prev = malloc(three->lines * sizeof(uint32_t));
+	three->next = malloc(three->lines * sizeof(uint32_t));
+	three->chain = malloc(three->lines * sizeof(uint32_t));
+	three->buckets = malloc((1u << three->hash_bits) * sizeof(uint32_t));
+	memset(three->buckets, 0xFF, (1u << three->hash_bits) * sizeof(uint32_t));
+	three->head = three->tail = THREEC_NONE;
+}
+
+//one demand access to a level: touch the bitmap and the shadow cache, and
+//sort the miss if the real cache missed. Without allocate (write buffer
+//stores, forwarded loads) a shadow miss leaves the shadow cache alone too.
+void threec_access(int level, uint32_t block, int hit, int allocate)
+{
+	ThreeC *three = &THREEC[level];
+	uint32_t page = block >> THREEC_PAGE_BITS;
+	uint32_t bit = block & ((1u << THREEC_PAGE_BITS) - 1);
+	uint32_t *bucket = &three->buckets[(block * 2654435761u) >> (32 - three->hash_bits)];
+	uint32_t line;
+	int first = 0;
+
+	if(three->seen[page] == NULL)
+		three->seen[page] = calloc(1u << (THREEC_PAGE_BITS - 6), sizeof(uint64_t));
+	if(!(three->seen[page][bit >> 6] & (1ull << (bit & 63))))
+	{
+		first = 1;
+		three->seen[page][bit >> 6] |= 1ull << (bit & 63);
+	}
+
+	for(line = *bucket; line != THREEC_NONE && three->block[line] != block; line = three->chain[line])
+		;
+	int shadow_hit = line != THREEC_NONE;
+	if(shadow_hit && line != three->head)
+	{
+		//unlink, it goes back in at the head
+		three->next[three->prev[line]] = three->next[line];
+		if(three->next[line] != THREEC_NONE)
+			three->prev[three->next[line]] = three->prev[line];
+		else
+			three->tail = three->prev[line];
+	}
+	else if(!shadow_hit && allocate)
+	{
+		if(three->used < three->lines)
+			line = three->used++;
+		else
+		{
+			//evict the least recently used line from the list and its bucket
+			uint32_t *link;
+			line = three->tail;
+			three->tail = three->prev[line];
+			if(three->tail != THREEC_NONE)
+				three->next[three->tail] = THREEC_NONE;
+			else
+				three->head = THREEC_NONE;
+			link = &three->buckets[(three->block[line] * 2654435761u) >> (32 - three->hash_bits)];
+			while(*link != line)
+				link = &three->chain[*link];
+			*link = three->chain[line];
+		}
+		three->block[line] = block;
+		three->chain[line] = *bucket;
+		*bucket = line;
+	}
+	if(line != three->head && line != THREEC_NONE)
+	{
+		three->prev[line] = THREEC_NONE;
+		three->next[line] = three->head;
+		if(three->head != THREEC_NONE)
+			three->prev[three->head] = line;
+		three->head = line;
+		if(three->tail == THREEC_NONE)
+			three->tail = line;
+	}
+
+	if(hit)
+		return;
+	if(first)
+		three->compulsory++;
+	else if(!shadow_hit)
+		three->capacity++;
+	else
+		three->conflict++;
+}
+
+void threec_print(int level)
+{
+	ThreeC *three = &THREEC[level];
+	uint32_t misses = three->compulsory + three->capacity + three->conflict;
+	printf("Compulsory: %u (%0.2f)\tCapacity: %u (%0.2f)\tConflict: %u (%0.2f)\n",
+		three->compulsory, misses ? 100.0 * three->compulsory / misses : 0.0,
+		three->capacity, misses ? 100.0 * three->capacity / misses : 0.0,
+		three->conflict, misses ? 100.0 * three->conflict / misses : 0.0);
+}
+
+/************************************************************/
+/* Write buffer                                                     */
+/************************************************************/
+void write_buffer_reset()
+{
+	WRITE_BUFFER_COUNT = 0;
+	memset(&WRITE_BUFFER_STATS, 0, sizeof(WRITE_BUFFER_STATS));
+}
+
+//drop the entries memory has finished writing
+void write_buffer_retire()
+{
+	int done = 0;
+	while(done < WRITE_BUFFER_COUNT && WRITE_BUFFER[done].done <= CYCLE_COUNT)
+		done++;
+	if(done == 0)
+		return;
+	WRITE_BUFFER_COUNT -= done;
+	memmove(WRITE_BUFFER, WRITE_BUFFER + done, WRITE_BUFFER_COUNT * sizeof(WriteBufferEntry));
+}
+
+//queue a store's word, coalescing into its block's entry if there is one;
+//a full buffer freezes the pipeline (see cycle()) until the oldest entry drains
+void write_buffer_store(uint32_t addr)
+{
+	uint32_t block = addr >> L1Cache.offset_bits;
+	uint32_t word = (addr & (L1Cache.block_bytes - 1)) >> 2;
+	uint32_t start = CYCLE_COUNT + 1;
+	int i;
+	write_buffer_retire();
+	WRITE_BUFFER_STATS.stores++;
+	for(i = 0; i < WRITE_BUFFER_COUNT; i++)
+	{
+		if(WRITE_BUFFER[i].block == block)
+		{
+			WRITE_BUFFER[i].words |= word < 64 ? 1ull << word : 0;
+			WRITE_BUFFER_STATS.coalesced++;
+			return;
+		}
+	}
+	if(WRITE_BUFFER_COUNT == WRITE_BUFFER_DEPTH)
+	{
+		WRITE_BUFFER_STATS.full_stalls++;
+		WRITE_BUFFER_STATS.full_cycles += WRITE_BUFFER[0].done - start;
+		CACHE_MISS_FLAG = 1;
+		CACHE_STALL_COUNT = WRITE_BUFFER[0].done - start;
+		start = WRITE_BUFFER[0].done;
+		WRITE_BUFFER_COUNT--;
+		memmove(WRITE_BUFFER, WRITE_BUFFER + 1, WRITE_BUFFER_COUNT * sizeof(WriteBufferEntry));
+	}
+	WriteBufferEntry *entry = &WRITE_BUFFER[WRITE_BUFFER_COUNT++];
+	if(WRITE_BUFFER_COUNT > 1 && entry[-1].done > start)
+		start = entry[-1].done;
+	entry->block = block;
+	entry->words = word < 64 ? 1ull << word : 0;
+	entry->done = start + WRITE_BUFFER_DRAIN;
+	if(DRAM_ENABLED)
+		dram_write(block << L1Cache.offset_bits, entry->done); //handed to the controller once drained
+}
+
+//a load that misses in L1Cache but whose word is waiting in the buffer
+int write_buffer_forward(uint32_t addr)
+{
+	uint32_t block = addr >> L1Cache.offset_bits;
+	uint32_t word = (addr & (L1Cache.block_bytes - 1)) >> 2;
+	int i;
+	write_buffer_retire();
+	for(i = WRITE_BUFFER_COUNT - 1; i >= 0; i--)
+	{
+		if(WRITE_BUFFER[i].block != block)
+			continue;
+		if(word >= 64 || !(WRITE_BUFFER[i].words & (1ull << word)))
+			return 0;
+		if(cache_lookup(&L1Cache, block & (L1Cache.sets - 1), (block >> L1Cache.index_bits) + 1) >= 0)
+			return 0; //L1 hit, nothing to forward
+		L1Cache.misses++;
+		cache_heat(&L1Cache, block & (L1Cache.sets - 1), addr, HEAT_ACCESS);
+		cache_heat(&L1Cache, block & (L1Cache.sets - 1), addr, HEAT_MISS);
+		if(THREEC_ENABLED)
+			threec_access(0, block, 0, 0);
+		WRITE_BUFFER_STATS.forwarded++;
+		return 1;
+	}
+	return 0;
+}
+
+void write_buffer_print()
+{
+	printf("Write buffer: %d entries, %d cycles per block drained\n", WRITE_BUFFER_DEPTH, WRITE_BUFFER_DRAIN);
+	printf("Stores: %u\tCoalesced: %u\tLoads forwarded: %u\n", WRITE_BUFFER_STATS.stores, WRITE_BUFFER_STATS.coalesced, WRITE_BUFFER_STATS.forwarded);
+	printf("Write-buffer-full stalls: %u\t(%u cycles)\n", WRITE_BUFFER_STATS.full_stalls, WRITE_BUFFER_STATS.full_cycles);
+	printf("-------------------------------------\n");
+}
+
+/************************************************************/
+/* Victim cache                                                     */
+/************************************************************/
+void victim_reset()
+{
+	memset(&VICTIM, 0, sizeof(VICTIM));
+}
+
+//an L1 miss: takes block out of the victim cache if it is there, ready to
+//swap with the block L1Cache evicts for it
+int victim_lookup(uint32_t block)
+{
+	int i;
+	for(i = 0; i < VICTIM_BLOCKS; i++)
+	{
+		if(VICTIM.blocks[i] == block + 1)
+		{
+			VICTIM.blocks[i] = 0;
+			VICTIM.stamps[i] = 0;
+			VICTIM.hits++;
+			return 1;
+		}
+	}
+	VICTIM.misses++;
+	return 0;
+}
+
+void victim_print()
+{
+	printf("Victim cache: %d blocks, %d-cycle swap\n", VICTIM_BLOCKS, VICTIM_LATENCY);
+	printf("Number of Victim hits: %u\n", VICTIM.hits);
+	printf("Number of Victim misses: %u\n", VICTIM.misses);
+	printf("Victim hit rate (of L1 misses): %0.2f\n", VICTIM.hits + VICTIM.misses ? 100.0 * VICTIM.hits / (VICTIM.hits + VICTIM.misses) : 0.0);
+	printf("Blocks taken from L1: %u\n", VICTIM.evictions);
+	printf("-------------------------------------\n");
+}
+
+//a block evicted from L1Cache replaces the least recently inserted entry
+void victim_insert(uint32_t block)
+{
+	int i, oldest = 0;
+	for(i = 1; i < VICTIM_BLOCKS; i++)
+	{
+		if(VICTIM.stamps[i] < VICTIM.stamps[oldest])
+			oldest = i;
+	}
+	VICTIM.blocks[oldest] = block + 1;
+	VICTIM.stamps[oldest] = ++VICTIM.clock;
+	VICTIM.evictions++;
+}
+
+/************************************************************/
+/* Prefetchers                                                      */
+/************************************************************/
+void prefetch_reset()
+{
+	PREFETCH_PORT_FREE = 0;
+	memset(RPT, 0, sizeof(RPT));
+	memset(STREAMS, 0, sizeof(STREAMS));
+	memset(&PREFETCH_STATS, 0, sizeof(PREFETCH_STATS));
+}
+
+//a place on the issue port: the cycle the request goes out in *issue,
+//or 0 (counted as dropped) if PREFETCH_QUEUE requests are already waiting
+int prefetch_slot(uint32_t *issue)
+{
+	if(PREFETCH_PORT_FREE < CYCLE_COUNT)
+		PREFETCH_PORT_FREE = CYCLE_COUNT;
+	if(PREFETCH_PORT_FREE - CYCLE_COUNT >= (uint32_t) (PREFETCH_QUEUE * PREFETCH_INTERVAL))
+	{
+		PREFETCH_STATS.dropped++;
+		return 0;
+	}
+	*issue = PREFETCH_PORT_FREE;
+	PREFETCH_PORT_FREE += PREFETCH_INTERVAL;
+	PREFETCH_STATS.issued++;
+	return 1;
+}
+
+//prefetch addr's block into L1Cache as the most recently used line
+void prefetch_issue(uint32_t addr)
+{
+	uint32_t block = addr >> L1Cache.offset_bits;
+	uint32_t set = block & (L1Cache.sets - 1);
+	uint32_t tag = (block >> L1Cache.index_bits) + 1;
+	uint32_t issue;
+	if(cache_lookup(&L1Cache, set, tag) >= 0)
+	{
+		PREFETCH_STATS.redundant++;
+		return;
+	}
+	//never displace the block the demand access just brought in
+	if(L1Cache.stamps[set * L1Cache.stride + cache_victim(&L1Cache, set)] >= PREFETCH_TRIGGER)
+	{
+		PREFETCH_STATS.dropped++;
+		return;
+	}
+	if(!prefetch_slot(&issue))
+		return;
+	uint32_t cycles = 0;
+	int state = NUM_CORES > 1 ? coherence_miss(block, 0, &cycles) : MESI_EXCLUSIVE;
+	if(cycles == 0)
+		cycles = cache_below(1, addr, issue + 1);
+	int way = cache_fill(&L1Cache, set, tag);
+	uint32_t line = set * L1Cache.ways + way;
+	L1Cache.stamps[set * L1Cache.stride + way] = ++L1Cache.clock;
+	L1Cache.prefetched[line] = 1;
+	L1Cache.ready[line] = issue + 1 + cycles;
+	if(NUM_CORES > 1)
+		L1Cache.mesi[line] = state;
+}
+
+//hook on every demand access to L1Cache. hit is 0 for a miss, 1 for a hit
+//and 2 for the first use of a prefetched block (in L1Cache or a stream buffer).
+void prefetch_access(uint32_t pc, uint32_t addr, int hit)
+{
+	uint32_t block_bytes = L1Cache.block_bytes;
+	int i;
+	PREFETCH_TRIGGER = L1Cache.clock;
+	switch(PREFETCHER)
+	{
+		case PREFETCH_NEXTLINE:
+			//tagged: a prefetched block being used keeps the sequence going
+			if(hit == 1)
+				break;
+			for(i = 1; i <= PREFETCH_DEGREE; i++)
+				prefetch_issue((addr & ~(block_bytes - 1)) + i * block_bytes);
+			break;
+		case PREFETCH_STRIDE: {
+			RPTEntry *entry = &RPT[(pc >> 2) % RPT_ENTRIES];
+			if(entry->pc != pc)
+			{
+				entry->pc = pc;
+				entry->last_addr = addr;
+				entry->stride = 0;
+				entry->state = RPT_INITIAL;
+				break;
+			}
+			int32_t stride = addr - entry->last_addr;
+			int correct = stride == entry->stride;
+			switch(entry->state)
+			{
+				case RPT_INITIAL:
+					entry->state = correct ? RPT_STEADY : RPT_TRANSIENT;
+					break;
+				case RPT_TRANSIENT:
+					entry->state = correct ? RPT_STEADY : RPT_NO_PRED;
+					break;
+				case RPT_STEADY:
+					entry->state = correct ? RPT_STEADY : RPT_INITIAL;
+					break;
+				default:
+					entry->state = correct ? RPT_TRANSIENT : RPT_NO_PRED;
+			}
+			if(!correct && entry->state != RPT_STEADY)
+				entry->stride = stride;
+			entry->last_addr = addr;
+			if(entry->state == RPT_STEADY && entry->stride != 0)
+			{
+				for(i = 1; i <= PREFETCH_DEGREE; i++)
+					prefetch_issue(addr + i * entry->stride);
+			}
+			break;
+		}
+		case PREFETCH_STREAM:
+			//a miss no stream buffer could serve starts a stream in the least recently used one
+			if(hit == 0)
+			{
+				StreamBuffer *stream = &STREAMS[0];
+				for(i = 1; i < STREAM_BUFFERS; i++)
+				{
+					if(STREAMS[i].stamp < stream->stamp)
+						stream = &STREAMS[i];
+				}
+				PREFETCH_STATS.useless += stream->count;
+				stream->count = 0;
+				stream->stamp = L1Cache.clock;
+				stream_fill(stream, (addr >> L1Cache.offset_bits) + 1);
+			}
+			break;
+	}
+}
+
+//top up a stream buffer to PREFETCH_DEGREE blocks, carrying on from block
+void stream_fill(StreamBuffer *stream, uint32_t block)
+{
+	uint32_t issue;
+	while(stream->count < PREFETCH_DEGREE)
+	{
+		if(!prefetch_slot(&issue))
+			return;
+		stream->blocks[stream->count] = block;
+		stream->ready[stream->count] = issue + 1 + cache_below(1, block << L1Cache.offset_bits, issue + 1);
+		stream->count++;
+		block++;
+	}
+}
+
+//an L1 miss served from a stream buffer: the blocks ahead of it are
+//discarded, the buffer is topped up, and *ready is set if the block is
+//still on its way. Returns 0 if no buffer holds the block.
+int stream_lookup(uint32_t addr, uint32_t *ready)
+{
+	uint32_t block = addr >> L1Cache.offset_bits;
+	int i, k;
+	for(i = 0; i < STREAM_BUFFERS; i++)
+	{
+		StreamBuffer *stream = &STREAMS[i];
+		for(k = 0; k < stream->count; k++)
+		{
+			if(stream->blocks[k] != block)
+				continue;
+			PREFETCH_STATS.useful++;
+			PREFETCH_STATS.useless += k;
+			if(stream->ready[k] > CYCLE_COUNT + 1)
+			{
+				PREFETCH_STATS.late++;
+				*ready = stream->ready[k];
+			}
+			stream->count -= k + 1;
+			memmove(stream->blocks, stream->blocks + k + 1, stream->count * sizeof(uint32_t));
+			memmove(stream->ready, stream->ready + k + 1, stream->count * sizeof(uint32_t));
+			stream->stamp = L1Cache.clock;
+			stream_fill(stream, stream->count ? stream->blocks[stream->count - 1] + 1 : block + 1);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void prefetch_print()
+{
+	const char *names[] = { "none", "nextline", "stride", "stream" };
+	uint32_t useful = PREFETCH_STATS.useful;
+	printf("Prefetcher: %s (degree %d, queue %d, one issue per %d cycles)\n", names[PREFETCHER],
+		PREFETCH_DEGREE, PREFETCH_QUEUE, PREFETCH_INTERVAL);
+	printf("Issued: %u\tDropped: %u\tRedundant: %u\n", PREFETCH_STATS.issued, PREFETCH_STATS.dropped, PREFETCH_STATS.redundant);
+	printf("Useful: %u\tLate: %u\tUseless: %u\n", useful, PREFETCH_STATS.late, PREFETCH_STATS.useless);
+	printf("Accuracy: %0.2f\tCoverage: %0.2f\tTimeliness: %0.2f\n",
+		PREFETCH_STATS.issued ? 100.0 * useful / PREFETCH_STATS.issued : 0.0,
+		useful + L1Cache.misses ? 100.0 * useful / (useful + L1Cache.misses) : 0.0,
+		useful ? 100.0 * (useful - PREFETCH_STATS.late) / useful : 0.0);
+	printf("-------------------------------------\n");
+}
+
+/************************************************************/
+/* Multi-core                                                       */
+/************************************************************/
+//every core at the start of the program, after a reset: core 0 is the
+//globals, the others copy its fresh registers and pipeline and start with
+//empty MSHRs, write buffers, victim caches and prefetchers. Their L1s are
+//kept, as core 0's is, see core_caches.
+void core_init()
+{
+	int i;
+	CURRENT_CORE = 0;
+	LL_LINK = 0;
+	LL_VERSION = 0;
+	SPIN_START = 0;
+	memset(&SYNC_STATS, 0, sizeof(SYNC_STATS));
+	memset(&CORES[0].issue, 0, sizeof(IssueStats));
+	memset(&CORES[0].muldiv, 0, sizeof(MulDivStats));
+	memset(&CORES[0].depth, 0, sizeof(DepthStats));
+	memset(&CORES[0].delay, 0, sizeof(DelaySlotStats));
+	ooo_reset();
+	if(NUM_CORES == 1 && NUM_THREADS == 1)
+		return;
+	CURRENT_STATE.REGS[26] = 0;
+	CURRENT_STATE.REGS[27] = NUM_CORES * NUM_THREADS;
+	NEXT_STATE = CURRENT_STATE;
+	if(NUM_CORES == 1)
+	{
+		thread_init();
+		return;
+	}
+	core_save(0);
+	CORES[0].running = RUN_FLAG;
+	CORES[0].instructions = 0;
+	memset(&CORES[0].coherence, 0, sizeof(CoherenceStats));
+	for(i = 1; i < NUM_CORES; i++)
+	{
+		Core *core = &CORES[i];
+		Cache l1 = core->l1;
+		ThreeC threec = core->threec;
+		memset(core, 0, sizeof(Core));
+		core->l1 = l1;
+		core->threec = threec;
+		core->running = RUN_FLAG;
+		core->current = CURRENT_STATE;
+		core->current.REGS[26] = i * NUM_THREADS;
+		core->next = core->current;
+		core->if_id = IF_ID;
+		core->id_ex = ID_EX;
+		core->ex_mem = EX_MEM;
+		core->mem_wb = MEM_WB;
+		memcpy(core->slots, SLOTS, sizeof(SLOTS));
+		memcpy(core->front_pipe, FRONT_PIPE, sizeof(FRONT_PIPE));
+		memcpy(core->mem_pipe, MEM_PIPE, sizeof(MEM_PIPE));
+	}
+	thread_init();
+}
+
+//private L1s (and their 3C shadows) for cores 1 .. NUM_CORES - 1, empty, in
+//L1Cache's geometry; core 0's is L1Cache itself. Cores past NUM_CORES are freed.
+void core_caches()
+{
+	int i;
+	for(i = 1; i < MAX_CORES; i++)
+	{
+		Cache *l1 = &CORES[i].l1;
+		l1->name = L1Cache.name;
+		l1->sets = i < NUM_CORES ? L1Cache.sets : 0;
+		l1->ways = L1Cache.ways;
+		l1->block_bytes = L1Cache.block_bytes;
+		l1->latency = 0;
+		cache_alloc(l1, 1);
+		threec_alloc(&CORES[i].threec, l1);
+	}
+}
+
+//copy the globals the stages keep core i's state in out to its context
+void core_save(int i)
+{
+	Core *core = &CORES[i];
+	core->current = CURRENT_STATE;
+	core->next = NEXT_STATE;
+	core->if_id = IF_ID;
+	core->id_ex = ID_EX;
+	core->ex_mem = EX_MEM;
+	core->mem_wb = MEM_WB;
+	if(ISSUE_WIDTH > 1)
+		memcpy(core->slots, SLOTS, sizeof(SLOTS));
+	if(front_stages() > 0)
+		memcpy(core->front_pipe, FRONT_PIPE, sizeof(FRONT_PIPE));
+	if(memory_stages() > 0)
+		memcpy(core->mem_pipe, MEM_PIPE, sizeof(MEM_PIPE));
+	core->stall_count = STALL_COUNT;
+	core->flush_flag = FLUSH_FLAG;
+	core->cache_miss_flag = CACHE_MISS_FLAG;
+	core->cache_stall_count = CACHE_STALL_COUNT;
+	core->hi_lo_ready = HI_LO_READY;
+	core->mult_free = MULT_FREE;
+	core->div_free = DIV_FREE;
+	core->l1 = L1Cache;
+	core->threec = THREEC[0];
+	memcpy(core->mshrs, MSHRS, sizeof(MSHRS));
+	core->mshr_stats = MSHR_STATS;
+	memcpy(core->reg_ready, REG_READY, sizeof(REG_READY));
+	core->data_ready = DATA_READY;
+	memcpy(core->write_buffer, WRITE_BUFFER, sizeof(WRITE_BUFFER));
+	core->write_buffer_count = WRITE_BUFFER_COUNT;
+	core->write_buffer_stats = WRITE_BUFFER_STATS;
+	core->victim = VICTIM;
+	memcpy(core->rpt, RPT, sizeof(RPT));
+	memcpy(core->streams, STREAMS, sizeof(STREAMS));
+	core->prefetch_stats = PREFETCH_STATS;
+	core->prefetch_port_free = PREFETCH_PORT_FREE;
+	core->ll_link = LL_LINK;
+	core->ll_version = LL_VERSION;
+	core->spin_start = SPIN_START;
+	core->sync_stats = SYNC_STATS;
+}
+
+//and back into the globals
+void core_load(int i)
+{
+	Core *core = &CORES[i];
+	CURRENT_STATE = core->current;
+	NEXT_STATE = core->next;
+	IF_ID = core->if_id;
+	ID_EX = core->id_ex;
+	EX_MEM = core->ex_mem;
+	MEM_WB = core->mem_wb;
+	if(ISSUE_WIDTH > 1)
+		memcpy(SLOTS, core->slots, sizeof(SLOTS));
+	if(front_stages() > 0)
+		memcpy(FRONT_PIPE, core->front_pipe, sizeof(FRONT_PIPE));
+	if(memory_stages() > 0)
+		memcpy(MEM_PIPE, core->mem_pipe, sizeof(MEM_PIPE));
+	STALL_COUNT = core->stall_count;
+	FLUSH_FLAG = core->flush_flag;
+	CACHE_MISS_FLAG = core->cache_miss_flag;
+	CACHE_STALL_COUNT = core->cache_stall_count;
+	HI_LO_READY = core->hi_lo_ready;
+	MULT_FREE = core->mult_free;
+	DIV_FREE = core->div_free;
+	L1Cache = core->l1;
+	THREEC[0] = core->threec;
+	memcpy(MSHRS, core->mshrs, sizeof(MSHRS));
+	MSHR_STATS = core->mshr_stats;
+	memcpy(REG_READY, core->reg_ready, sizeof(REG_READY));
+	DATA_READY = core->data_ready;
+	memcpy(WRITE_BUFFER, core->write_buffer, sizeof(WRITE_BUFFER));
+	WRITE_BUFFER_COUNT = core->write_buffer_count;
+	WRITE_BUFFER_STATS = core->write_buffer_stats;
+	VICTIM = core->victim;
+	memcpy(RPT, core->rpt, sizeof(RPT));
+	memcpy(STREAMS, core->streams, sizeof(STREAMS));
+	PREFETCH_STATS = core->prefetch_stats;
+	PREFETCH_PORT_FREE = core->prefetch_port_free;
+	LL_LINK = core->ll_link;
+	LL_VERSION = core->ll_version;
+	SPIN_START = core->spin_start;
+	SYNC_STATS = core->sync_stats;
+}
+
+void core_switch(int i)
+{
+	if(i == CURRENT_CORE)
+		return;
+	core_save(CURRENT_CORE);
+	core_load(i);
+	CURRENT_CORE = i;
+}
+
+//one cycle of the core in the globals; cycle() advances the clock
+void core_cycle()
+{
+	if(NUM_MSHRS > 0)
+		mshr_cycle();
+	if(NUM_THREADS > 1)
+		thread_cycle();
+	else
+		thread_step();
+}
+
+//one cycle of the thread in the globals
+void thread_step()
+{
+	if(CACHE_MISS_FLAG == 1) //pipeline frozen while the block comes in from memory
+	{
+		if(CACHE_STALL_COUNT > 0)
+		{
+			CACHE_STALL_COUNT--;
+			return;
+		}
+		CACHE_MISS_FLAG = 0;
+	}
+	if(ENGINE == ENGINE_FUNCTIONAL)
+		functional_step();
+	else if(ENGINE == ENGINE_OOO)
+		ooo_step();
+	else
+		handle_pipeline();
+	CURRENT_STATE = NEXT_STATE;
+}
+
+//snoop the other L1s on a miss of the current core: BusRd for a read,
+//BusRdX for a write, which invalidates every other copy. Returns the state
+//the block takes here, with the cycles of a cache-to-cache transfer in
+//*cycles when another L1 held it Exclusive or Modified (else 0, and the
+//block comes from below L1).
+int coherence_miss(uint32_t block, int write, uint32_t *cycles)
+{
+	CoherenceStats *stats = &CORES[CURRENT_CORE].coherence;
+	uint32_t set = block & (L1Cache.sets - 1);
+	uint32_t tag = (block >> L1Cache.index_bits) + 1;
+	uint32_t way;
+	int i, shared = 0;
+
+	*cycles = 0;
+	if(write)
+		stats->bus_read_exclusive++;
+	else
+		stats->bus_reads++;
+	for(way = 0; way < L1Cache.ways; way++)
+	{
+		if(L1Cache.lost[set * L1Cache.ways + way] == block + 1)
+		{
+			stats->coherence_misses++;
+			L1Cache.lost[set * L1Cache.ways + way] = 0;
+			break;
+		}
+	}
+	if(IN_QUANTUM)
+	{
+		//the other L1s are on other threads: tell them, and go by OWNERS
+		//rather than their tags for a cache-to-cache transfer
+		uint8_t *owner = &OWNERS[block & (OWNER_BUCKETS - 1)];
+		int held = __atomic_load_n(owner, __ATOMIC_RELAXED);
+		shared = held != 0 && held != CURRENT_CORE + 1;
+		if(shared)
+		{
+			stats->transfers++;
+			*cycles = COHERENCE_LATENCY;
+		}
+		__atomic_store_n(owner, write || !shared ? CURRENT_CORE + 1 : 0, __ATOMIC_RELAXED);
+		coherence_post(block, write ? COHERENCE_INVALIDATE : COHERENCE_DOWNGRADE);
+		return write ? MESI_MODIFIED : shared ? MESI_SHARED : MESI_EXCLUSIVE;
+	}
+	for(i = 0; i < NUM_CORES; i++)
+	{
+		if(i == CURRENT_CORE)
+			continue;
+		Cache *other = &CORES[i].l1;
+		int found = cache_lookup(other, set, tag);
+		if(found < 0)
+			continue;
+		uint8_t *state = &other->mesi[set * other->ways + found];
+		if(*state == MESI_EXCLUSIVE || *state == MESI_MODIFIED)
+		{
+			stats->transfers++;
+			*cycles = COHERENCE_LATENCY;
+		}
+		shared = 1;
+		if(write)
+			coherence_invalidate(i, set, found, block);
+		else
+			*state = MESI_SHARED;
+	}
+	return write ? MESI_MODIFIED : shared ? MESI_SHARED : MESI_EXCLUSIVE;
+}
+
+//a write of the current core hitting way of set: Exclusive turns Modified
+//silently, Shared takes a BusUpgr invalidating the other copies. Returns
+//the cycles the upgrade takes.
+uint32_t coherence_write_hit(uint32_t set, int way, uint32_t block)
+{
+	uint8_t *state = &L1Cache.mesi[set * L1Cache.ways + way];
+	uint32_t tag = (block >> L1Cache.index_bits) + 1;
+	int i;
+
+	if(IN_QUANTUM)
+	{
+		//a downgrade may still be on its way here, so every write invalidates
+		__atomic_store_n(&OWNERS[block & (OWNER_BUCKETS - 1)], CURRENT_CORE + 1, __ATOMIC_RELAXED);
+		coherence_post(block, COHERENCE_INVALIDATE);
+		if(*state == MESI_SHARED)
+			CORES[CURRENT_CORE].coherence.bus_upgrades++;
+		uint32_t cycles = *state == MESI_SHARED ? COHERENCE_LATENCY : 0;
+		*state = MESI_MODIFIED;
+		return cycles;
+	}
+	if(*state == MESI_MODIFIED)
+		return 0;
+	if(*state == MESI_EXCLUSIVE)
+	{
+		*state = MESI_MODIFIED;
+		return 0;
+	}
+	CORES[CURRENT_CORE].coherence.bus_upgrades++;
+	for(i = 0; i < NUM_CORES; i++)
+	{
+		if(i == CURRENT_CORE)
+			continue;
+		int found = cache_lookup(&CORES[i].l1, set, tag);
+		if(found >= 0)
+			coherence_invalidate(i, set, found, block);
+	}
+	*state = MESI_MODIFIED;
+	return COHERENCE_LATENCY;
+}
+
+//drop core i's copy of block (in way of set), remembering it so that the
+//core's next miss on the block counts as a coherence miss
+void coherence_invalidate(int i, uint32_t set, int way, uint32_t block)
+{
+	Cache *other = &CORES[i].l1;
+	uint32_t line = set * other->ways + way;
+	other->tags[set * other->stride + way] = 0;
+	other->stamps[set * other->stride + way] = 0;
+	if(other->prefetched[line])
+		CORES[i].prefetch_stats.useless++;
+	other->prefetched[line] = 0;
+	other->mesi[line] = MESI_INVALID;
+	other->lost[line] = block + 1;
+	CORES[CURRENT_CORE].coherence.invalidations_sent++;
+	CORES[i].coherence.invalidations_received++;
+}
+
+void core_print()
+{
+	int i;
+	printf("Cores: %d, MESI, %u cycles cache-to-cache", NUM_CORES, COHERENCE_LATENCY);
+	if(parallel_ready())
+		printf(", host-parallel with a %u cycle quantum", QUANTUM);
+	printf("\n");
+	printf("Core\tInstrs\tIPC\tL1 hits\tL1 miss\tBusRd\tBusRdX\tBusUpgr\tInv out\tInv in\tC2C\tCoh miss\n");
+	for(i = 0; i < NUM_CORES; i++)
+	{
+		Cache *l1 = i == CURRENT_CORE ? &L1Cache : &CORES[i].l1;
+		CoherenceStats *stats = &CORES[i].coherence;
+		printf("%d\t%u\t%0.3f\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\n", i, CORES[i].instructions,
+			CYCLE_COUNT ? (double) CORES[i].instructions / CYCLE_COUNT : 0.0, l1->hits, l1->misses,
+			stats->bus_reads, stats->bus_read_exclusive, stats->bus_upgrades, stats->invalidations_sent,
+			stats->invalidations_received, stats->transfers, stats->coherence_misses);
+	}
+	printf("-------------------------------------\n");
+}
+
+/************************************************************/
+/* Hardware multithreading                                          */
+/************************************************************/
+//the threads of every core after core_init: thread 0 is the core's own
+//context, the others copy it with the next $k0s
+void thread_init()
+{
+	int i, t;
+	for(i = 0; i < NUM_CORES; i++)
+	{
+		ThreadSet *set = &THREADS[i];
+		memset(set, 0, sizeof(ThreadSet));
+		core_switch(i);
+		for(t = 0; t < NUM_THREADS; t++)
+		{
+			thread_save(&set->thread[t]);
+			memcpy(set->thread[t].slots, SLOTS, sizeof(SLOTS));
+			memcpy(set->thread[t].front_pipe, FRONT_PIPE, sizeof(FRONT_PIPE));
+			memcpy(set->thread[t].mem_pipe, MEM_PIPE, sizeof(MEM_PIPE));
+			set->thread[t].current.REGS[26] += t;
+			set->thread[t].next = set->thread[t].current;
+			set->thread[t].running = RUN_FLAG;
+		}
+	}
+	core_switch(0);
+}
+
+//copy the globals a thread keeps its own out to its context
+void thread_save(HWThread *thread)
+{
+	thread->current = CURRENT_STATE;
+	thread->next = NEXT_STATE;
+	thread->if_id = IF_ID;
+	thread->id_ex = ID_EX;
+	thread->ex_mem = EX_MEM;
+	thread->mem_wb = MEM_WB;
+	if(ISSUE_WIDTH > 1)
+		memcpy(thread->slots, SLOTS, sizeof(SLOTS));
+	if(front_stages() > 0)
+		memcpy(thread->front_pipe, FRONT_PIPE, sizeof(FRONT_PIPE));
+	if(memory_stages() > 0)
+		memcpy(thread->mem_pipe, MEM_PIPE, sizeof(MEM_PIPE));
+	thread->stall_count = STALL_COUNT;
+	thread->flush_flag = FLUSH_FLAG;
+	thread->cache_miss_flag = CACHE_MISS_FLAG;
+	thread->cache_stall_count = CACHE_STALL_COUNT;
+	memcpy(thread->reg_ready, REG_READY, sizeof(REG_READY));
+	thread->data_ready = DATA_READY;
+	thread->hi_lo_ready = HI_LO_READY;
+	thread->ll_link = LL_LINK;
+	thread->ll_version = LL_VERSION;
+	thread->spin_start = SPIN_START;
+}
+
+//and back into the globals
+void thread_load(HWThread *thread)
+{
+	CURRENT_STATE = thread->current;
+	NEXT_STATE = thread->next;
+	IF_ID = thread->if_id;
+	ID_EX = thread->id_ex;
+	EX_MEM = thread->ex_mem;
+	MEM_WB = thread->mem_wb;
+	if(ISSUE_WIDTH > 1)
+		memcpy(SLOTS, thread->slots, sizeof(SLOTS));
+	if(front_stages() > 0)
+		memcpy(FRONT_PIPE, thread->front_pipe, sizeof(FRONT_PIPE));
+	if(memory_stages() > 0)
+		memcpy(MEM_PIPE, thread->mem_pipe, sizeof(MEM_PIPE));
+	STALL_COUNT = thread->stall_count;
+	FLUSH_FLAG = thread->flush_flag;
+	CACHE_MISS_FLAG = thread->cache_miss_flag;
+	CACHE_STALL_COUNT = thread->cache_stall_count;
+	memcpy(REG_READY, thread->reg_ready, sizeof(REG_READY));
+	DATA_READY = thread->data_ready;
+	HI_LO_READY = thread->hi_lo_ready;
+	LL_LINK = thread->ll_link;
+	LL_VERSION = thread->ll_version;
+	SPIN_START = thread->spin_start;
+}
+
+//make thread t of the current core the one in the globals
+void thread_switch(int t)
+{
+	ThreadSet *set = &THREADS[CURRENT_CORE];
+	if(t == set->current)
+		return;
+	thread_save(&set->thread[set->current]);
+	thread_load(&set->thread[t]);
+	set->current = t;
+}
+
+//can thread t of the current core step this cycle: running, and not
+//waiting out a blocking miss
+int thread_ready(int t)
+{
+	ThreadSet *set = &THREADS[CURRENT_CORE];
+	if(!set->thread[t].running)
+		return 0;
+	if(t == set->current)
+		return !(CACHE_MISS_FLAG == 1 && CACHE_STALL_COUNT > 0);
+	return !(set->thread[t].cache_miss_flag == 1 && set->thread[t].cache_stall_count > 0);
+}
+
+//the thread to issue this cycle, -1 if none is ready: the next ready one
+//after the current, which switch-on-miss keeps until it misses or times out
+int thread_pick()
+{
+	ThreadSet *set = &THREADS[CURRENT_CORE];
+	int i;
+	if(THREAD_POLICY == THREAD_MISS && !set->missed && set->run_cycles < SWITCH_TIMEOUT && thread_ready(set->current))
+		return set->current;
+	for(i = 1; i <= NUM_THREADS; i++)
+	{
+		int t = (set->current + i) % NUM_THREADS;
+		if(thread_ready(t))
+			return t;
+	}
+	return -1;
+}
+
+//one cycle of a multithreaded core: one thread steps the pipeline, the
+//blocking misses of the others run down. RUN_FLAG ends up the core's.
+void thread_cycle()
+{
+	ThreadSet *set = &THREADS[CURRENT_CORE];
+	int t, pick = -1, running = 0;
+
+	if(set->switch_wait > 0)
+		set->switch_wait--;
+	else
+	{
+		pick = thread_pick();
+		if(pick < 0)
+			set->idle_cycles++;
+	}
+	if(pick >= 0 && pick != set->current)
+	{
+		thread_switch(pick);
+		set->switches++;
+		set->missed = 0;
+		set->run_cycles = 0;
+		if(THREAD_POLICY == THREAD_MISS && SWITCH_PENALTY > 0)
+		{
+			set->switch_wait = SWITCH_PENALTY - 1; //this cycle is the first
+			pick = -1;
+		}
+	}
+	for(t = 0; t < NUM_THREADS; t++)
+	{
+		HWThread *thread = &set->thread[t];
+		if(t == pick)
+			continue;
+		if(t == set->current && CACHE_MISS_FLAG == 1 && CACHE_STALL_COUNT > 0)
+			CACHE_STALL_COUNT--;
+		else if(t != set->current && thread->cache_miss_flag == 1 && thread->cache_stall_count > 0)
+			thread->cache_stall_count--;
+	}
+	if(pick >= 0)
+	{
+		HWThread *thread = &set->thread[pick];
+		uint32_t instructions = INSTRUCTION_COUNT, data_ready = DATA_READY;
+		RUN_FLAG = TRUE;
+		thread_step();
+		thread->instructions += INSTRUCTION_COUNT - instructions;
+		thread->issue_cycles++;
+		set->run_cycles++;
+		thread->running = RUN_FLAG;
+		set->missed = (CACHE_MISS_FLAG == 1 && CACHE_STALL_COUNT > 0) || (DATA_READY != data_ready && DATA_READY > CYCLE_COUNT + 1);
+	}
+	for(t = 0; t < NUM_THREADS; t++)
+		running |= set->thread[t].running;
+	RUN_FLAG = running;
+}
+
+//per-thread and per-core throughput
+void thread_print()
+{
+	int i, t;
+	printf("Threads: %d per core, ", NUM_THREADS);
+	if(THREAD_POLICY == THREAD_FINE)
+		printf("fine-grained\n");
+	else
+		printf("switch on miss, %u cycles a switch, after at most %u cycles\n", SWITCH_PENALTY, SWITCH_TIMEOUT);
+	printf("Core\tThread\tInstrs\tIPC\tIssue %%\n");
+	for(i = 0; i < NUM_CORES; i++)
+	{
+		ThreadSet *set = &THREADS[i];
+		uint32_t instructions = 0;
+		for(t = 0; t < NUM_THREADS; t++)
+		{
+			HWThread *thread = &set->thread[t];
+			instructions += thread->instructions;
+			printf("%d\t%d\t%u\t%0.3f\t%0.2f\n", i, t, thread->instructions,
+				CYCLE_COUNT ? (double) thread->instructions / CYCLE_COUNT : 0.0,
+				CYCLE_COUNT ? 100.0 * thread->issue_cycles / CYCLE_COUNT : 0.0);
+		}
+		printf("%d\tall\t%u\t%0.3f\t(%u switches, %u cycles with no thread ready)\n", i, instructions,
+			CYCLE_COUNT ? (double) instructions / CYCLE_COUNT : 0.0, set->switches, set->idle_cycles);
+	}
+	printf("-------------------------------------\n");
+}
+
+/************************************************************/
+/* LL/SC and SYNC                                                   */
+/************************************************************/
+//LL: link the current core to addr's block
+void sync_link(uint32_t addr)
+{
+	SYNC_STATS.ll++;
+	LL_LINK = (addr >> L1Cache.offset_bits) + 1;
+	if(SPIN_START == 0)
+		SPIN_START = CYCLE_COUNT;
+}
+
+//SC: store value to addr if the link still holds. Returns what goes to rt,
+//1 for a store made, 0 for a broken link. Either way the link is gone.
+uint32_t sync_store_conditional(uint32_t pc, uint32_t addr, uint32_t value)
+{
+	SYNC_STATS.sc++;
+	int linked = LL_LINK == (addr >> L1Cache.offset_bits) + 1;
+	if(linked && IN_QUANTUM)
+	{
+		//stores of other threads are only seen through the bucket's version;
+		//taking it odd here locks out theirs until data_store is done
+		uint32_t *version = sync_bucket(addr);
+		uint32_t seen = LL_VERSION;
+		if(__atomic_compare_exchange_n(version, &seen, LL_VERSION + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			SYNC_HELD = version;
+		else
+		{
+			linked = 0;
+			SYNC_STATS.link_breaks++;
+		}
+	}
+	if(!linked)
+	{
+		SYNC_STATS.sc_failures++;
+		LL_LINK = 0;
+		return 0;
+	}
+	LL_LINK = 0;
+	data_store(pc, 0b101011, addr, value);
+	if(SPIN_START != 0)
+		SYNC_STATS.spin_cycles += CYCLE_COUNT - SPIN_START;
+	SPIN_START = 0;
+	return 1;
+}
+
+//every store: break the links other cores and threads hold to its block.
+//A core's current thread keeps its link with the core, the others in THREADS.
+void sync_store(uint32_t addr)
+{
+	uint32_t link = (addr >> L1Cache.offset_bits) + 1;
+	int i, t;
+	for(i = 0; i < NUM_CORES; i++)
+	{
+		for(t = 0; t < NUM_THREADS; t++)
+		{
+			int current = t == THREADS[i].current || NUM_THREADS == 1;
+			if(i == CURRENT_CORE && current)
+				continue;
+			uint32_t *ll_link = current ? &CORES[i].ll_link : &THREADS[i].thread[t].ll_link;
+			if(*ll_link == link)
+			{
+				*ll_link = 0;
+				(i == CURRENT_CORE ? &SYNC_STATS : &CORES[i].sync_stats)->link_breaks++;
+			}
+		}
+	}
+}
+
+//SYNC in MEM: freeze the core (see core_cycle()) until its buffered stores
+//are in memory and its outstanding misses have arrived
+void sync_wait()
+{
+	uint32_t until = CYCLE_COUNT + 1;
+	int i;
+	SYNC_STATS.syncs++;
+	for(i = 0; i < WRITE_BUFFER_COUNT; i++)
+	{
+		if(WRITE_BUFFER[i].done > until)
+			until = WRITE_BUFFER[i].done;
+	}
+	for(i = 0; i < NUM_MSHRS; i++)
+	{
+		if(MSHRS[i].ready > until)
+			until = MSHRS[i].ready;
+	}
+	if(until == CYCLE_COUNT + 1)
+		return;
+	SYNC_STATS.sync_cycles += until - CYCLE_COUNT - 1;
+	CACHE_MISS_FLAG = 1;
+	CACHE_STALL_COUNT = until - CYCLE_COUNT - 1;
+}
+
+//per-core LL/SC and SYNC counts, when the program used any
+void sync_print()
+{
+	int i, used = 0;
+	for(i = 0; i < NUM_CORES; i++)
+	{
+		SyncStats *stats = i == CURRENT_CORE ? &SYNC_STATS : &CORES[i].sync_stats;
+		used |= stats->ll + stats->sc + stats->syncs > 0;
+	}
+	if(!used)
+		return;
+	printf("Synchronization\n");
+	printf("Core\tLL\tSC\tSC fail\tFail %%\tLink breaks\tSpin cycles\tPer SC\tSYNC\tSYNC cycles\n");
+	for(i = 0; i < NUM_CORES; i++)
+	{
+		SyncStats *stats = i == CURRENT_CORE ? &SYNC_STATS : &CORES[i].sync_stats;
+		uint32_t successes = stats->sc - stats->sc_failures;
+		printf("%d\t%u\t%u\t%u\t%0.2f\t%u\t\t%llu\t\t%0.1f\t%u\t%u\n", i, stats->ll, stats->sc, stats->sc_failures,
+			stats->sc ? 100.0 * stats->sc_failures / stats->sc : 0.0, stats->link_breaks,
+			(unsigned long long) stats->spin_cycles, successes ? (double) stats->spin_cycles / successes : 0.0,
+			stats->syncs, stats->sync_cycles);
+	}
+	printf("-------------------------------------\n");
+}
+
+/************************************************************/
+/* Host-parallel cores                                              */
+/************************************************************/
+//whether run and sim go parallel: the profilers and the trace writer keep
+//one stream for all the cores, so they stay in lockstep
+int parallel_ready()
+{
+	if(!PARALLEL || NUM_CORES == 1)
+		return 0;
+	if(TRACE_OUT != NULL || STACK_DIST.enabled || REUSE_ENABLED || BATCH.enabled)
+	{
+		printf("Traces and profiles need one stream: running the cores in lockstep\n");
+		return 0;
+	}
+	return 1;
+}
+
+//up to cycles cycles (0 for to the end) with core i > 0 on thread i and
+//core 0 on this one, then every core's context back where cycle() has it
+void parallel_run(uint32_t cycles)
+{
+	pthread_t threads[MAX_CORES];
+	uint32_t instructions = INSTRUCTION_COUNT;
+	int i, running = 0;
+
+	memset(&PARALLEL_RUN, 0, sizeof(PARALLEL_RUN));
+	PARALLEL_RUN.start = CYCLE_COUNT;
+	PARALLEL_RUN.limit = cycles > 0 ? CYCLE_COUNT + cycles : UINT32_MAX;
+	PARALLEL_RUN.until = PARALLEL_RUN.limit - CYCLE_COUNT > QUANTUM ? CYCLE_COUNT + QUANTUM : PARALLEL_RUN.limit;
+	for(i = 1; i < NUM_CORES; i++)
+	{
+		if(pthread_create(&threads[i], NULL, parallel_thread, (void *) (intptr_t) i) != 0)
+		{
+			printf("Error: cannot start a thread for core %d\n", i);
+			exit(1);
+		}
+	}
+	RUN_FLAG = CORES[0].running;
+	INSTRUCTION_COUNT = 0;
+	parallel_loop(0);
+	for(i = 1; i < NUM_CORES; i++)
+		pthread_join(threads[i], NULL);
+
+	INSTRUCTION_COUNT = instructions;
+	for(i = 0; i < NUM_CORES; i++)
+	{
+		INSTRUCTION_COUNT += PARALLEL_RUN.instructions[i];
+		running |= CORES[i].running;
+	}
+	if(!running) //ends with the last core to halt, as in lockstep
+	{
+		CYCLE_COUNT = PARALLEL_RUN.start;
+		for(i = 0; i < NUM_CORES; i++)
+		{
+			if(PARALLEL_RUN.halted[i] > CYCLE_COUNT)
+				CYCLE_COUNT = PARALLEL_RUN.halted[i];
+		}
+	}
+	RUN_FLAG = running;
+}
+
+void *parallel_thread(void *arg)
+{
+	int i = (int) (intptr_t) arg;
+	CURRENT_CORE = i;
+	core_load(i);
+	CYCLE_COUNT = PARALLEL_RUN.start;
+	INSTRUCTION_COUNT = 0;
+	RUN_FLAG = CORES[i].running;
+	parallel_loop(i);
+	core_save(i);
+	return NULL;
+}
+
+//core i's quanta, on its own thread with its context in the globals
+void parallel_loop(int i)
+{
+	uint32_t generation = 0;
+	PARALLEL_RUN.halted[i] = CYCLE_COUNT;
+	IN_QUANTUM = 1;
+	do
+	{
+		uint32_t until = PARALLEL_RUN.until;
+		while(CYCLE_COUNT < until)
+		{
+			coherence_drain();
+			if(RUN_FLAG)
+			{
+				core_cycle();
+				PARALLEL_RUN.halted[i] = CYCLE_COUNT + 1;
+			}
+			CYCLE_COUNT++;
+		}
+		CORES[i].running = RUN_FLAG;
+	} while(parallel_barrier(i, &generation));
+	coherence_drain(); //nothing is sent after the last barrier
+	IN_QUANTUM = 0;
+	CORES[i].instructions += INSTRUCTION_COUNT;
+	PARALLEL_RUN.instructions[i] = INSTRUCTION_COUNT;
+}
+
+//end of a quantum on core i's thread. Core 0's waits for the others, weaves
+//their uncore logs into the shared levels and sets up the next quantum; the
+//others wait for it, draining their rings all the while so that a sender
+//stuck on a full one gets going. Returns 0 once the run is over.
+int parallel_barrier(int i, uint32_t *generation)
+{
+	int j, running = 0;
+	if(i > 0)
+	{
+		__atomic_fetch_add(&PARALLEL_RUN.arrived, 1, __ATOMIC_RELEASE);
+		while(__atomic_load_n(&PARALLEL_RUN.generation, __ATOMIC_ACQUIRE) == *generation)
+		{
+			coherence_drain();
+			sched_yield();
+		}
+		(*generation)++;
+		return !PARALLEL_RUN.stop;
+	}
+	while(__atomic_load_n(&PARALLEL_RUN.arrived, __ATOMIC_ACQUIRE) < (uint32_t) NUM_CORES - 1)
+	{
+		coherence_drain();
+		sched_yield();
+	}
+	PARALLEL_RUN.arrived = 0;
+	parallel_weave();
+	for(j = 0; j < NUM_CORES; j++)
+		running |= CORES[j].running;
+	PARALLEL_RUN.stop = !running || CYCLE_COUNT >= PARALLEL_RUN.limit;
+	PARALLEL_RUN.until = PARALLEL_RUN.limit - CYCLE_COUNT > QUANTUM ? CYCLE_COUNT + QUANTUM : PARALLEL_RUN.limit;
+	(*generation)++;
+	__atomic_store_n(&PARALLEL_RUN.generation, *generation, __ATOMIC_RELEASE);
+	return !PARALLEL_RUN.stop;
+}
+
+//the quantum's accesses below L1, oldest arrival first across the cores
+//(in program order within one), through the real L2/L3 and DRAM
+void parallel_weave()
+{
+	uint32_t next[MAX_CORES] = { 0 };
+	int i;
+	IN_QUANTUM = 0;
+	for(;;)
+	{
+		int pick = -1;
+		for(i = 0; i < NUM_CORES; i++)
+		{
+			UncoreLog *log = &UNCORE_LOGS[i];
+			if(next[i] < log->count && (pick < 0 || log->events[next[i]].arrival < UNCORE_LOGS[pick].events[next[pick]].arrival))
+				pick = i;
+		}
+		if(pick < 0)
+			break;
+		UncoreEvent *event = &UNCORE_LOGS[pick].events[next[pick]++];
+		if(event->level == 0)
+			dram_write(event->addr, event->arrival);
+		else
+			cache_below(event->level, event->addr, event->arrival);
+	}
+	for(i = 0; i < NUM_CORES; i++)
+		UNCORE_LOGS[i].count = 0;
+	IN_QUANTUM = 1;
+}
+
+//cache_below inside a quantum: the shared levels only change in the weave,
+//so looking up addr's block in them without filling anything is safe here
+uint32_t uncore_access(int level, uint32_t addr, uint32_t arrival)
+{
+	uncore_log(level, addr, arrival);
+	for(; level < MAX_CACHE_LEVELS; level++)
+	{
+		Cache *cache = cache_level(level);
+		if(cache->sets == 0)
+			continue;
+		uint32_t block = addr >> cache->offset_bits;
+		if(cache_lookup(cache, block & (cache->sets - 1), (block >> cache->index_bits) + 1) >= 0)
+			return cache->latency;
+	}
+	if(DRAM_ENABLED)
+		return dram_probe(addr);
+	return MEMORY_LATENCY;
+}
+
+void uncore_log(int level, uint32_t addr, uint32_t arrival)
+{
+	UncoreLog *log = &UNCORE_LOGS[CURRENT_CORE];
+	if(log->count == log->size)
+	{
+		log->size = log->size ? 2 * log->size : 1024;
+		log->events = realloc(log->events, log->size * sizeof(UncoreEvent));
+	}
+	log->events[log->count].arrival = arrival;
+	log->events[log->count].addr = addr;
+	log->events[log->count].level = level;
+	log->count++;
+}
+
+//send block's event to every other core; on a full ring, take in our own
+//events until the receiver has made room
+void coherence_post(uint32_t block, uint32_t type)
+{
+	int i;
+	for(i = 0; i < NUM_CORES; i++)
+	{
+		if(i == CURRENT_CORE)
+			continue;
+		CoherenceRing *ring = &COHERENCE_RINGS[CURRENT_CORE][i];
+		uint32_t tail = ring->tail;
+		while(tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == COHERENCE_RING)
+		{
+			coherence_drain();
+			sched_yield();
+		}
+		ring->events[tail & (COHERENCE_RING - 1)].block = block;
+		ring->events[tail & (COHERENCE_RING - 1)].type = type;
+		__atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+	}
+}
+
+//take in every event the other cores have sent the current one
+void coherence_drain()
+{
+	int i;
+	for(i = 0; i < NUM_CORES; i++)
+	{
+		if(i == CURRENT_CORE)
+			continue;
+		CoherenceRing *ring = &COHERENCE_RINGS[i][CURRENT_CORE];
+		uint32_t head = ring->head;
+		uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+		if(head == tail)
+			continue;
+		for(; head != tail; head++)
+			coherence_receive(i, &ring->events[head & (COHERENCE_RING - 1)]);
+		__atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+	}
+}
+
+//core from's write (invalidate) or read miss (downgrade) on a block, applied
+//to the current core's L1 as coherence_invalidate and coherence_miss would
+void coherence_receive(int from, CoherenceEvent *event)
+{
+	uint32_t set = event->block & (L1Cache.sets - 1);
+	int way = cache_lookup(&L1Cache, set, (event->block >> L1Cache.index_bits) + 1);
+	if(way < 0)
+		return;
+	uint32_t line = set * L1Cache.ways + way;
+	if(event->type == COHERENCE_DOWNGRADE)
+	{
+		if(L1Cache.mesi[line] != MESI_INVALID)
+			L1Cache.mesi[line] = MESI_SHARED;
+		return;
+	}
+	L1Cache.tags[set * L1Cache.stride + way] = 0;
+	L1Cache.stamps[set * L1Cache.stride + way] = 0;
+	if(L1Cache.prefetched[line])
+		PREFETCH_STATS.useless++;
+	L1Cache.prefetched[line] = 0;
+	L1Cache.mesi[line] = MESI_INVALID;
+	L1Cache.lost[line] = event->block + 1;
+	CORES[CURRENT_CORE].coherence.invalidations_received++;
+	__atomic_fetch_add(&CORES[from].coherence.invalidations_sent, 1, __ATOMIC_RELAXED);
+}
+
+//version of the bucket addr's L1 block falls in
+uint32_t *sync_bucket(uint32_t addr)
+{
+	return &SYNC_VERSIONS[(addr >> L1Cache.offset_bits) & (SYNC_BUCKETS - 1)];
+}
+
+//a store inside a quantum: make the bucket's version odd, unless SC already has
+void sync_lock(uint32_t addr)
+{
+	uint32_t *version = sync_bucket(addr);
+	if(SYNC_HELD != NULL)
+		return;
+	for(;;)
+	{
+		uint32_t seen = __atomic_load_n(version, __ATOMIC_RELAXED);
+		if(!(seen & 1) && __atomic_compare_exchange_n(version, &seen, seen + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			break;
+		coherence_drain();
+	}
+	SYNC_HELD = version;
+}
+
+//and even again, one up on the version before it
+void sync_unlock()
+{
+	__atomic_store_n(SYNC_HELD, *SYNC_HELD + 1, __ATOMIC_RELEASE);
+	SYNC_HELD = NULL;
+}
+
+//LL inside a quantum: the word from memory, read while the bucket's version
+//is even and unchanged, which SC then checks it still is
+uint32_t sync_load_linked(uint32_t addr)
+{
+	uint32_t *version = sync_bucket(addr);
+	for(;;)
+	{
+		uint32_t seen = __atomic_load_n(version, __ATOMIC_ACQUIRE);
+		if(!(seen & 1))
+		{
+			uint32_t value = mem_read_32(addr);
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if(__atomic_load_n(version, __ATOMIC_RELAXED) == seen)
+			{
+				LL_VERSION = seen;
+				return value;
+			}
+		}
+		coherence_drain();
+	}
+}
+
+//data side of memory as seen by MEM and the functional engine: through L1Cache,
+//or straight to memory when the cache model is turned off
+uint32_t cache_read_32(uint32_t addr)
+{
+	if(CACHE_MODEL == CACHE_MODEL_NONE)
+		return mem_read_32(addr);
+	return cache_reads(addr);
+}
+
+void cache_write_32(uint32_t addr, uint32_t new)
+{
+	if(CACHE_MODEL == CACHE_MODEL_NONE)
+	{
+		mem_write_32(addr, new);
+		return;
+	}
+	cache_writes(addr, new);
+}
+
+//loads LB/LH/LW/LL made by the instruction at pc, picking the byte lane out of the word and sign extending
+uint32_t data_load(uint32_t pc, uint32_t opcode, uint32_t addr)
+{
+	ACCESS_PC = pc;
+	if(TRACE_OUT != NULL)
+		trace_record(TRACE_READ, pc, addr, opcode == 0b100000 ? 1 : opcode == 0b100001 ? 2 : 4);
+	profile_access(addr);
+	if(opcode == OP_LL)
+		sync_link(addr);
+	if(opcode == OP_LL && IN_QUANTUM)
+	{
+		cache_read_32(addr); //for the timing: the L1 copy may be older than another thread's store
+		return sync_load_linked(addr);
+	}
+	return load_extract(opcode, addr, cache_read_32(addr));
+}
+
+//what a load reads out of the word holding addr
+uint32_t load_extract(uint32_t opcode, uint32_t addr, uint32_t word)
+{
+	switch(opcode)
+	{
+		case 0b100000: { //Loading byte of 8 bits
+			uint32_t temp_data = word >> ((addr & 0x3) << 3);
+			return ((temp_data & 0x000000FF) & 0x80) > 0 ? (temp_data | 0xFFFFFF00) : (temp_data & 0x000000FF);
+		}
+		case 0b100001: { //Loading halfword
+			uint32_t temp_data = word >> ((addr & 0x2) << 3);
+			return ((temp_data & 0x0000FFFF) & 0x8000) > 0 ? (temp_data | 0xFFFF0000) : (temp_data & 0x0000FFFF);
+		}
+		default: //Load word, 32 bits
+			return word;
+	}
+}
+
+//stores SB/SH/SW made by the instruction at pc; partial stores are merged into the word (write-through, so memory holds the current word)
+void data_store(uint32_t pc, uint32_t opcode, uint32_t addr, uint32_t value)
+{
+	ACCESS_PC = pc;
+	if(TRACE_OUT != NULL)
+		trace_record(TRACE_WRITE, pc, addr, opcode == 0b101000 ? 1 : opcode == 0b101001 ? 2 : 4);
+	profile_access(addr);
+	if(IN_QUANTUM)
+		sync_lock(addr);
+	else if(NUM_CORES > 1 || NUM_THREADS > 1)
+		sync_store(addr);
+	switch(opcode)
+	{
+		case 0b101000: { //storing byte
+			uint32_t shift = (addr & 0x3) << 3;
+			uint32_t temp_data = mem_read_32(addr & 0xFFFFFFFC);
+			temp_data = (temp_data & ~(0x000000FF << shift)) | ((value & 0x000000FF) << shift);
+			cache_write_32(addr & 0xFFFFFFFC, temp_data);
+			break;
+		}
+		case 0b101001: { //storing halfword
+			uint32_t shift = (addr & 0x2) << 3;
+			uint32_t temp_data = mem_read_32(addr & 0xFFFFFFFC);
+			temp_data = (temp_data & ~(0x0000FFFF << shift)) | ((value & 0x0000FFFF) << shift);
+			cache_write_32(addr & 0xFFFFFFFC, temp_data);
+			break;
+		}
+		default: //store word
+			cache_write_32(addr, value);
+	}
+	if(IN_QUANTUM)
+		sync_unlock();
+}
+
+//writing back to registers, increment instruction count at this stage
+/************************************************************/
+/* writeback (WB) pipeline stage:                                                                          */ 
+/************************************************************/
+void WB() //may need to add more insturctions here, will look later
+{
+	//if bubble happening then skip stage
+	if(MEM_WB.stage_stalled == 1)
+		return; 
+	
+	uint32_t opcode = (MEM_WB.IR & 0xFC000000) >> 26;
+	if(NUM_MSHRS > 0 && load_store(opcode, 0) != 1)
+		REG_READY[dest_reg(&MEM_WB)] = 0; //overwritten, no longer waiting on an older load
+	
+	//printf("opcode = %x\n", opcode);
+	
+	if(opcode == 0) //r type
+	{
+		//r type command
+		uint32_t funct = (MEM_WB.IR & 0x0000003F);// instruction function field	
+		uint32_t rd = (MEM_WB.IR & 0x0000F800) >> 11;//destination reg
+
+		rtypeWB(funct, rd);
+	}
+	else //i or j type (but not jump or branching)
+	{
+		uint32_t rt = (MEM_WB.IR & 0x001F0000) >> 16; //finding rt register
+		
+		switch(opcode)
+		{
+			case 0b001000: { //add immediate
+				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
+				break;
+			}
+			case 0b001001: { //add immediate unsigned
+				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
+				break;	
+			}
+			case 0b001100: { //and immediate
+				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
+				break;	
+			}
+			case 0b001101: { //ORI 
+				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
+				break;
+			}
+			case 0b001110: { //Xori 
+				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
+				break;
+			}
+			case 0b001111: { //load upper immediate, shifted in EX
+				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
+				break;
+			}
+			case 0b001010: { //SLTI
+				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
+				break;
+			}
+			case 0b100000: { //Loading byte 
+				NEXT_STATE.REGS[rt] = MEM_WB.LMD;
+				break;	
+			}
+			case 0b100001:{ //Loading halfword
+				NEXT_STATE.REGS[rt] = MEM_WB.LMD;
+				break;	
+			}
+			case 0b100011: { //Load word, 32 bits
+				NEXT_STATE.REGS[rt] = MEM_WB.LMD;
+				break;	
+			}
+			case OP_LL: //load linked
+			case OP_SC: { //store conditional, LMD is 1 if it stored
+				NEXT_STATE.REGS[rt] = MEM_WB.LMD;
+				break;
+			}
+			case 0b000011: { //JAL
+				NEXT_STATE.REGS[31] = MEM_WB.LMD; //return address kept in LMD by EX
+				break;
+			}
+			default: {
+				//not handled yet	
+			}
+		}
+	}
+	NEXT_STATE.REGS[0] = 0; //$zero stays zero
+	CURRENT_STATE = NEXT_STATE;
+	
+	INSTRUCTION_COUNT++; //increasing instriction count after WB stage, don't know if end is good idea but c'est la vie
+}
+
+//writing back r type commands, most to just next state destination reg
+void rtypeWB(uint32_t funct, uint32_t rd)
+{
+	switch(funct)
+	{
+		case 0b100000: { //ADD, pulled from brenden's alu ops because I didn't want to write out all the codes again
+			NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
+			break;
+		}
+		case 0b100001: { //ADDIU
+			NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
+		}
+		case 0b100010: { //SUB
+			NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
+			break;
+		}
+		case 0b100011: { //SUBU
+			NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
+			break;
+		}
+		case 0b100100: { //AND
+			NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
+			break;
+		}
+		case 0b100101: { //OR
+			NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
+			break;
+		}
+		case 0b100110: { //XOR
+			NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
+			break;
+		}
+		case 0b100111: { //NOR
+			NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
+			break;
+		}
+		case 0b101010: { //SLT
+			NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
+			break;
+		}
+		case 0b011000: { //MULT
+			NEXT_STATE.HI = MEM_WB.HI;
+			NEXT_STATE.LO = MEM_WB.LO;
+			break;
+		}
+		case 0b011001: { //MULTU
+			NEXT_STATE.HI = MEM_WB.HI;
+			NEXT_STATE.LO = MEM_WB.LO;
+			break;
+		}
+		case 0b010000: { //MFHI, HI read (and forwarded) in EX
+			NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
+			break;
+		}
+		case 0b010010: { //MFLO
+			NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
+			break;
+		}
+		case 0b010001: { //MTHI
+			NEXT_STATE.HI = MEM_WB.HI;
+			break;
+		}
+		case 0b010011: { //MTLO
+			NEXT_STATE.LO = MEM_WB.LO;
+			break;
+		}
+		case 0b011010: { //DIV
+			NEXT_STATE.HI = MEM_WB.HI;
+			NEXT_STATE.LO = MEM_WB.LO;
+			break;
+		}
+		case 0b011011: { //DIVU
+			NEXT_STATE.HI = MEM_WB.HI;
+			NEXT_STATE.LO = MEM_WB.LO;
+			break;
+		}
+		case 0b000000: { //SLL
+			NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
+			break;
+		}
+		case 0b000010: { //SRL
+			NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
+			break;
+		}
+		case 0b000011: { //SRA
+			NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
+			break;
+		}
+		case 0b001001: { //JALR, return address kept in LMD by EX
+			NEXT_STATE.REGS[rd] = MEM_WB.LMD;
+			break;	
+		}
+		case 0x0000000C: { //syscall
+			if(NEXT_STATE.REGS[2] == 0xA)
+			{
+				RUN_FLAG = FALSE;	
+				MEM_WB.ALUOutput = 0x0;
+				break;
+			}
+			printf("SYSCALL\n");
+			break;
+		}
+		default: {
+			//not handled yet			
+		}
+	}
+}
+
+//memory accessed
+/************************************************************/
+/* memory access (MEM) pipeline stage:                                                          */ 
+/************************************************************/
+void MEM()
+{
+	MEM_WB.stage_stalled = EX_MEM.stage_stalled;
+	MEM_WB.REG_RD_VALUE = EX_MEM.REG_RD_VALUE;
+	MEM_WB.REG_RS_VALUE = EX_MEM.REG_RS_VALUE;
+	MEM_WB.REG_RT_VALUE = EX_MEM.REG_RT_VALUE;
+	//if stalled then only pass forward stall
+	if(EX_MEM.stage_stalled == 1)
+	{
+		sim_print("MEM stage stalled\n"); //just for debugging
+		MEM_WB.stage_stalled = 1;
+		MEM_WB.REG_RD_VALUE = 0;
+		MEM_WB.REG_RS_VALUE = 0;
+		MEM_WB.REG_RT_VALUE = 0;
+		MEM_WB.LO = 0;
+		MEM_WB.HI = 0;
+		return;
+	}
+	
+	//forwarding the values from pipeline regsisters
+	MEM_WB.IR = EX_MEM.IR; //instruction
+	MEM_WB.B = EX_MEM.B;
+	MEM_WB.LMD = EX_MEM.LMD; //return address of JAL/JALR, loads overwrite it below
+	MEM_WB.ALUOutput = EX_MEM.ALUOutput; //forwarding output before manpulating
+	MEM_WB.ALUOutputLow = EX_MEM.ALUOutputLow;
+	MEM_WB.PC = EX_MEM.PC; //program counter
+	MEM_WB.HI = EX_MEM.HI;
+	MEM_WB.LO = EX_MEM.LO;
+	
+	uint32_t opcode = (MEM_WB.IR & 0xFC000000) >> 26; ///getting opcode
+		
+	if(opcode == 0x00000000) //opcode is zero, r-type command, most likely syscall 
+	{
+		opcode = MEM_WB.IR & 0x0000003F; //finding function	field
+		if(opcode == 0x0C)
+		{
+			//SYS call, nothing to do with memory access	
+		}
+		else if(opcode == FUNCT_SYNC)
+			sync_wait();
+	}
+	else //other two types of commmands (stuff that actually memory access)
+	{
+		switch(load_store(opcode, 0))
+		{
+			case 1: { //loading instructions, cache read then get from mem if needed
+				MEM_WB.LMD = data_load(EX_MEM.PC, opcode, EX_MEM.ALUOutput);
+				if(NUM_MSHRS > 0 && dest_reg(&MEM_WB) != 0)
+					REG_READY[dest_reg(&MEM_WB)] = DATA_READY;
+				break;
+			}
+			case 2: { //storing instructions, cache write
+				if(opcode == OP_SC)
+					MEM_WB.LMD = sync_store_conditional(EX_MEM.PC, EX_MEM.ALUOutput, EX_MEM.B);
+				else
+					data_store(EX_MEM.PC, opcode, EX_MEM.ALUOutput, EX_MEM.B);
+				break;
+			}
+		}
+	}
+}
+
+//instruction executed
+/************************************************************/
+/* execution (EX) pipeline stage:                                                                          */ 
+/************************************************************/
+void EX()
+{
+	if(ID_EX.stage_stalled == 1)
+	{
+		//execute stage stalled
+		EX_MEM.stage_stalled = 1;
+		EX_MEM.imm = 0;
 		EX_MEM.IR = 0;
 		EX_MEM.A = 0;
 		EX_MEM.B = 0;
@@ -772,720 +3923,2146 @@ void EX()
 		EX_MEM.REG_RT_VALUE = 0;
 		EX_MEM.PC = 0;
 		EX_MEM.ALUOutput = 0;
-		printf("EX stalled\n");
+		sim_print("EX stalled\n");
+		return;
+	}
+	if(!QUIET_FLAG)
+	{
+		printf("[0x%08X]\t", ID_EX.PC);
+		print_instruction(ID_EX.IR);
+	}
+	if(ENABLE_FORWARDING == 1) //operands written after ID read the register file
+	{
+		ID_EX.A = forward_operand(ID_EX.REG_RS_VALUE, ID_EX.A);
+		ID_EX.B = forward_operand(ID_EX.REG_RT_VALUE, ID_EX.B);
+	}
+	EX_MEM.stage_stalled = ID_EX.stage_stalled;
+	EX_MEM.IR = ID_EX.IR;
+	EX_MEM.A = ID_EX.A;
+	EX_MEM.B = ID_EX.B;
+	EX_MEM.HI = 0;
+	EX_MEM.LO = 0;
+	EX_MEM.REG_RD_VALUE = ID_EX.REG_RD_VALUE;
+	EX_MEM.REG_RS_VALUE = ID_EX.REG_RS_VALUE;
+	EX_MEM.REG_RT_VALUE = ID_EX.REG_RT_VALUE;
+	EX_MEM.PC = ID_EX.PC;
+	EX_MEM.imm = ID_EX.imm;
+	EX_MEM.ALUOutput = 0;
+	EX_MEM.LMD = 0;
+	
+	if(load_store(ID_EX.IR>>26, ID_EX.IR & 0x0000003F)==3) { //moves to and from HI/LO
+		switch(ID_EX.IR & 0x0000003F) {
+			case 0b010000: //MFHI
+				EX_MEM.ALUOutput = forward_hi_lo(1);
+				break;
+			case 0b010010: //MFLO
+				EX_MEM.ALUOutput = forward_hi_lo(0);
+				break;
+			case 0b010001: //MTHI
+				EX_MEM.HI = ID_EX.A;
+				break;
+			case 0b010011: //MTLO
+				EX_MEM.LO = ID_EX.A;
+				break;
+		}
+	}
+	else if(reg_jump(ID_EX.IR>>26, ID_EX.IR & 0x3F)) {
+		branch_jump(ID_EX.IR>>26);
+	}
+	else if(load_store(ID_EX.IR>>26, ID_EX.IR & 0x0000003F)) {
+		EX_MEM.ALUOutput = ID_EX.A + ID_EX.imm; //imm sign extended in ID
+	}
+	else if(reg_imm(ID_EX.IR>>26)) {
+		EX_MEM.ALUOutput = ALUOperationI();
+	}
+	else if(reg_reg(ID_EX.IR>>26, ID_EX.IR & 0x0000003F)) { //reg-reg
+		EX_MEM.ALUOutput = ALUOperationR();
+		if(writes_hi_lo(&EX_MEM) == 3) //MULT/MULTU/DIV/DIVU
+			muldiv_start(ID_EX.IR & 0x3F);
+	}
+}
+
+uint32_t ALUOperationI() {
+	switch(ID_EX.IR >> 26) {
+		case 0b001000: { //ADDI
+			if(ID_EX.imm >> 15) {
+				ID_EX.imm = 0xFFFF0000 | ID_EX.imm; //sign extend	
+			}
+			uint8_t bit30_carry = (((ID_EX.imm >> 30) & 0x1) + (0x1 & (ID_EX.A >> 30))) >> 1;
+			uint8_t bit31_carry = (((ID_EX.imm >> 31) & 0x1) + (0x1 & (ID_EX.A >> 31))) >> 1;
+			if(bit30_carry == bit31_carry)
+				return ID_EX.A + ID_EX.imm;
+			break;
+		}
+		case 0b001001: { //ADDIU, unsigned so not carry bits
+			//printf("EX_MEM.A = %X\n", EX_MEM.A);
+			//printf("EX_MEM.imm = %X\n", EX_MEM.imm);
+			//printf("result = %X\n", EX_MEM.A + EX_MEM.imm);
+			return EX_MEM.A + EX_MEM.imm;
+			break;
+		}
+		case 0b001100: { //ANDI, logical immediates are zero extended
+			return ID_EX.A & (ID_EX.imm & 0x0000FFFF);
+			break;
+		}
+		case 0b001101: { //ORI
+			return ID_EX.A | (ID_EX.imm & 0x0000FFFF);
+			break;
+		}
+		case 0b001110: { //XORI
+			return ID_EX.A ^ (ID_EX.imm & 0x0000FFFF);
+			break;
+		}
+		case 0b001111: { //LUI
+			return ID_EX.imm << 16;
+		}
+		case 0b001010: { //SLTI
+			if((int32_t) ID_EX.A < (int16_t) ID_EX.imm) {
+				return 1;
+			} 
+			else {
+				return 0;
+			}
+		}
+		default:
+			return 0;
+	}
+	return 0;
+}
+
+uint32_t ALUOperationR() {
+	switch(ID_EX.IR & 0x0000003F) {
+		case 0b100000: { //ADD
+			return ID_EX.A + ID_EX.B;
+			break;
+		}
+		case 0b100001: { //ADDU
+			return ID_EX.A + ID_EX.B;
+			break;
+		}
+		case 0b100010: { //SUB
+			return ID_EX.A - ID_EX.B;
+			break;
+		}
+		case 0b100011: { //SUBU
+			return ID_EX.A - ID_EX.B;
+			break;
+		}
+		case 0b100100: { //AND
+			return ID_EX.A & ID_EX.B;
+			break;
+		}
+		case 0b100101: { //OR
+			return ID_EX.A | ID_EX.B;
+			break;
+		}
+		case 0b100110: { //XOR
+			return ID_EX.A ^ ID_EX.B;
+			break;
+		}
+		case 0b100111: { //NOR
+			return ~(ID_EX.A | ID_EX.B);
+			break;
+		}
+		case 0b101010: { //SLT
+			if((int32_t) ID_EX.A < (int32_t) ID_EX.B) {
+				return 1;
+			} else {
+				return 0;
+			}
+		}
+		case 0b011000: { //MULT, sign extended to 64 bits
+			int64_t result = (int64_t) (int32_t) EX_MEM.A * (int64_t) (int32_t) EX_MEM.B;
+			EX_MEM.LO = result;
+			EX_MEM.HI = (result) >> 32;
+			return 0;
+		}
+		case 0b011001: { //MULTU
+			uint64_t result = (uint64_t) EX_MEM.A * (uint64_t) EX_MEM.B;
+			EX_MEM.LO = result;
+			EX_MEM.HI = (result) >> 32;
+			return 0;
+		}
+		case 0b011010: { //DIV, result undefined for a zero divisor so leave HI/LO alone
+			if(EX_MEM.A == 0x80000000 && EX_MEM.B == 0xFFFFFFFF) //INT_MIN / -1 overflows on the host
+			{
+				EX_MEM.LO = 0x80000000;
+				EX_MEM.HI = 0;
+			}
+			else if(EX_MEM.B != 0)
+			{
+				EX_MEM.LO = (int32_t) EX_MEM.A / (int32_t) EX_MEM.B;
+				EX_MEM.HI = (int32_t) EX_MEM.A % (int32_t) EX_MEM.B;
+			}
+			return 0;
+		}
+		case 0b011011: { //DIVU
+			if(EX_MEM.B != 0)
+			{
+				EX_MEM.LO = EX_MEM.A / EX_MEM.B;
+				EX_MEM.HI = EX_MEM.A % EX_MEM.B;
+			}
+			return 0;
+		}
+		case 0b000000: { //SLL
+			return ID_EX.B << ID_EX.sham_t;
+		}
+		case 0b000010: { //SRL
+			return ID_EX.B >> ID_EX.sham_t;
+		}
+		case 0b000011: { //SRA
+			return (int32_t) ID_EX.B >> ID_EX.sham_t;
+		}
+		case 0b001000: { //JR
+			FLUSH_FLAG = 1;
+			CURRENT_STATE.PC = CURRENT_STATE.REGS[31];
+			return ID_EX.A;
+		}
+		case 0b001001: { //JALR
+			FLUSH_FLAG = 1;
+			EX_MEM.LMD = CURRENT_STATE.PC + 4;
+			return ID_EX.A;
+		}
+		case 0b010000: { //MFHI
+			break;			
+		}
+		case 0b010010: { //MFLO
+			break;			
+		}
+		case 0b010011: {
+			EX_MEM.ALUOutput = EX_MEM.A;	
+		}
+		default: {
+			return 0;
+		}
+	}
+	return 0;
+}
+
+//returns 1 for load 2 for store 3 if accessing HI or LO registers and 0 if niether
+int load_store(uint32_t opcode, uint32_t regreg) {
+	switch(opcode) {
+		case 0b100011:
+		case 0b100000:
+		case 0b100001:
+		case OP_LL:
+			return 1;
+		case 0b101011:
+		case 0b101000: //store byte
+		case 0b101001:
+		case OP_SC:
+			return 2;
+		case 0b000000: {
+			switch(regreg) {
+				case 0b010000:
+				case 0b010001:
+				case 0b010010:
+				case 0b010011:
+					return 3;
+				default:
+					return 0;
+			}
+		}
+		default:
+			return 0;
 	}
-	if(ID_EX.stage_stalled == 0)
-	{	
-		printf("[0x%08X]\t", ID_EX.PC);
-		uint32_t instr = (mem_read_32(ID_EX.PC)); //reading in address from mem
-		print_instruction(instr);
-		EX_MEM.stage_stalled =ID_EX.stage_stalled;
-		EX_MEM.Forwarding_Type = ID_EX.Forwarding_Type;
-		EX_MEM.IR = ID_EX.IR;
-		EX_MEM.A = ID_EX.A;
-		EX_MEM.B = ID_EX.B;
-		EX_MEM.HI = 0;
-		EX_MEM.LO = 0;
-		EX_MEM.REG_RD_VALUE = ID_EX.REG_RD_VALUE;
-		EX_MEM.REG_RS_VALUE = ID_EX.REG_RS_VALUE;
-		EX_MEM.REG_RT_VALUE = ID_EX.REG_RT_VALUE;
-		EX_MEM.PC = ID_EX.PC;
-		EX_MEM.imm =ID_EX.imm;
-		EX_MEM.ALUOutput = 0;
-		
-		if(ID_EX.Forwarding_Type == 1 || ID_EX.Forwarding_Type == 5) {
-			ID_EX.A = MEM_WB.ALUOutput;
-			EX_MEM.A = ID_EX.A;
-		}
-		else if(ID_EX.Forwarding_Type == 2 || ID_EX.Forwarding_Type == 6) {
-			ID_EX.B = MEM_WB.ALUOutput;
-			EX_MEM.B = ID_EX.B;
-		}
-		else if(ID_EX.Forwarding_Type == 3) {
-			ID_EX.A = NEXT_STATE.REGS[ID_EX.REG_RS_VALUE];
-			EX_MEM.A = ID_EX.A;
-		}
-		else if(ID_EX.Forwarding_Type == 4) {
-			ID_EX.B = NEXT_STATE.REGS[ID_EX.REG_RT_VALUE];
-			EX_MEM.B = ID_EX.B;
-		}
-		else if(ID_EX.Forwarding_Type == 7) {
-			ID_EX.A = MEM_WB.LMD;
-		}
-		else if(ID_EX.Forwarding_Type == 8) {
-			ID_EX.B = MEM_WB.LMD;
-			EX_MEM.B = ID_EX.B;
-		}
-		else if(ID_EX.Forwarding_Type == 9|| ID_EX.Forwarding_Type == 11) {
-			ID_EX.A = MEM_WB.ALUOutput;
-			EX_MEM.A = ID_EX.A;
-			ID_EX.B = NEXT_STATE.REGS[ID_EX.REG_RT_VALUE];
-			EX_MEM.B = ID_EX.B;
-		}
-		else if(ID_EX.Forwarding_Type == 10) {
-			ID_EX.A = NEXT_STATE.REGS[ID_EX.REG_RD_VALUE];
-			EX_MEM.A = ID_EX.A;
-		}
-		else if(ID_EX.Forwarding_Type == 12) {
-			ID_EX.A = NEXT_STATE.REGS[ID_EX.REG_RS_VALUE];
-			EX_MEM.A = ID_EX.A;
-		}
-		else if(ID_EX.Forwarding_Type == 13) {
-			ID_EX.A = NEXT_STATE.REGS[ID_EX.REG_RS_VALUE];
-			EX_MEM.A = ID_EX.A;
-			ID_EX.B = MEM_WB.ALUOutput;
-			EX_MEM.B = ID_EX.B;
-		}
-		else if(ID_EX.Forwarding_Type == 14) {
-			ID_EX.A = NEXT_STATE.REGS[ID_EX.REG_RS_VALUE];
-			EX_MEM.A = ID_EX.A;
-			ID_EX.B = MEM_WB.ALUOutput;
-			EX_MEM.B = ID_EX.B;
+}
+
+//brnach and jump instrucions function
+int branch_jump(uint32_t opcode)
+{
+	switch(opcode) {
+		case 0b000100: {//BEQ
+			if(EX_MEM.A == EX_MEM.B) //branch is taken
+			{
+				/*if(EX_MEM.imm >> 15) //negative immediate so sign extend
+				{
+					   EX_MEM.imm = 0xFFFF0000 | EX_MEM.imm;
+				}*/
+				
+				int32_t offset = EX_MEM.imm << 2;
+				EX_MEM.ALUOutput = branch_pc(EX_MEM.PC) + offset; //finding outcome of branch
+				FLUSH_FLAG = 1; //flush flag enabled
+			}
+			// else
+				//no branch
+			break;
+		}
+		case 0b000101: {//BNE
+			if(EX_MEM.A != EX_MEM.B) //branch is taken
+			{
+				/*if(EX_MEM.imm >> 15) //negative immediate so sign extend
+				{
+					   EX_MEM.imm = 0xFFFF0000 | EX_MEM.imm;
+				}*/
+
+				int32_t offset = EX_MEM.imm << 2;
+				EX_MEM.ALUOutput = branch_pc(EX_MEM.PC) + offset; //finding outcome of branch
+				FLUSH_FLAG = 1; //flush flag enabled
+			}
+			// else
+				//no branch
+			break;
+		}
+		case 0b000110: {//BLEZ
+			if(EX_MEM.A >> 31 || EX_MEM.A==0) //branch is taken
+			{
+				/*if(EX_MEM.imm >> 15) //negative immediate so sign extend
+				{
+					   EX_MEM.imm = 0xFFFF0000 | EX_MEM.imm;
+				}*/
+				
+				int32_t offset = EX_MEM.imm << 2;
+				EX_MEM.ALUOutput = branch_pc(EX_MEM.PC) + offset; //finding outcome of branch
+				FLUSH_FLAG = 1; //flush flag enabled
+			}
+			// else
+				//no branch
+			break;
+		}
+		case 0b000111: {//BGTZ
+			if((int32_t) EX_MEM.A > 0) //branch is taken
+			{
+				/*if(EX_MEM.imm >> 15) //negative immediate so sign extend
+				{
+					   EX_MEM.imm = 0xFFFF0000 | EX_MEM.imm;
+				}*/
+				
+				int32_t offset = EX_MEM.imm << 2;
+				EX_MEM.ALUOutput = branch_pc(EX_MEM.PC) + offset; //finding outcome of branch
+				FLUSH_FLAG = 1; //flush flag enabled
+			}
+			//else
+				//no branch
+			break;
 		}
+		case 0b000001: { //special branch instructions
 		
-		if(load_store(ID_EX.IR>>26, ID_EX.IR & 0x0000003F)==3) {		
-			EX_MEM.ALUOutput = ID_EX.A;
+			if(EX_MEM.REG_RT_VALUE == 00001) //BGEZ
+			{
+				//printf("Called BGEZ\n");
+				if((int32_t) EX_MEM.A >= 0) //taking branch
+				{
+					/*if(EX_MEM.imm >> 15) //negative immediate so sign extend
+					{
+					   EX_MEM.imm = 0xFFFF0000 | EX_MEM.imm;
+					}*/
+				
+					int32_t offset = EX_MEM.imm << 2;
+					EX_MEM.ALUOutput = branch_pc(EX_MEM.PC) + offset; //finding outcome of branch
+					FLUSH_FLAG = 1; //flush flag enabled
+				}
+				// else
+					//no branch
+				//break; 
+			}
+			if(EX_MEM.REG_RT_VALUE == 00000) //BLTZ
+			{
+				if((int32_t) EX_MEM.A < 0) //taking branch
+				{
+					/*if(EX_MEM.imm >> 15) //negative immediate so sign extend
+					{
+					   EX_MEM.imm = 0xFFFF0000 | EX_MEM.imm;
+					}*/
+					
+					int32_t offset = EX_MEM.imm << 2;
+					EX_MEM.ALUOutput = branch_pc(EX_MEM.PC) + offset; //finding outcome of branch
+					FLUSH_FLAG = 1; //flush flag enabled
+				}
+				//else
+					//no branch
+				//break; 
+			}
+			break;
+		}
+		case 0b000010: { //J
+			FLUSH_FLAG = 1;
+			EX_MEM.ALUOutput = ((EX_MEM.IR) & 0x03FFFFFF)<<2;
+			break;
+		}
+		case 0b000011: { //JAL
+			FLUSH_FLAG = 1;
+			EX_MEM.ALUOutput = (((EX_MEM.IR) & 0x03FFFFFF) << 2);
+			EX_MEM.LMD = link_pc(EX_MEM.PC); //return address
+			break;
+		}
+		case 0b000000: { 
+			switch(EX_MEM.IR & 0x3F) {
+				case 0b001000: { //JR
+					FLUSH_FLAG = 1;
+					EX_MEM.ALUOutput = ID_EX.A;
+					//NEXT_STATE.PC = EX_MEM.A;
+					break;
+				}
+				case 0b001001: { //JALR
+					FLUSH_FLAG = 1;
+					EX_MEM.ALUOutput = ID_EX.A;
+					EX_MEM.LMD = link_pc(EX_MEM.PC); //return address
+					break;
+				}
+			}
+		}
+	}
+	//printf("Test\n");
+	return 0;
+}
+
+int reg_imm(uint32_t opcode) {
+	switch(opcode) {
+		case 0b001000:
+		case 0b001001:
+		case 0b001100:
+		case 0b001101:
+		case 0b001110:
+		case 0b001010:
+		case 0b001111:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+int reg_jump(uint32_t opcode, uint32_t instruction) {
+	switch(opcode) {
+		case 0b000100:
+		case 0b000101:
+		case 0b000110:
+		case 0b000111:
+		case 0b000001:
+		case 0b000010:
+		case 0b000011:
+			return 1;
+		case 0b000000:
+			switch(instruction) {
+				case(0b001000):
+				case(0b001001):
+					return 2;
+			    default:
+					return 0;
+			}
+		default:
+			return 0;
+	}
+}
+
+int reg_reg(uint32_t opcode, uint32_t instruction) {
+	if(opcode == 0b000000) {
+		switch(instruction) {
+			case 0b100000:
+			case 0b100001:
+			case 0b100010:
+			case 0b100011:
+			case 0b011000:
+			case 0b011001:
+			case 0b011010:
+			case 0b011011:
+			case 0b100100:
+			case 0b100101:
+			case 0b100110:
+			case 0b100111:
+			case 0b101010:
+			case 0b000000:
+			case 0b000010:
+			case 0b000011:
+				return 1;
+			default:
+				return 0;
+		}
+	}
+	return 0;
+}
+
+//This is where the instruction is actually determined by the bit fields
+/************************************************************/
+/* instruction decode (ID) pipeline stage:                                                         */ 
+/************************************************************/
+void ID()
+{		
+	if(STALL_COUNT > 0 || IF_ID.stage_stalled == 1)
+	{
+		//ID stage stalled for a hazard or a jump/branch outcome, or nothing was fetched
+		ID_EX.stage_stalled = 1;
+		ID_EX.IR = 0xFFFFFFFF;
+		sim_print("ID stalling\n");
+		return;
+	}
+	ID_EX.PC = IF_ID.PC;
+	ID_EX.IR = IF_ID.IR; //transfering instruction
+	ID_EX.imm = IF_ID.IR & 0x00008000 ? IF_ID.IR | 0xFFFF0000 : IF_ID.IR & 0x0000FFFF; //immediate
+	ID_EX.A = CURRENT_STATE.REGS[(IF_ID.IR>>21) & 0x1F]; //rs reg
+	ID_EX.B = CURRENT_STATE.REGS[(IF_ID.IR>>16) & 0x1F]; //rt reg
+	ID_EX.REG_RS_VALUE = (IF_ID.IR>>21) & 0x1F;
+	ID_EX.REG_RT_VALUE = (IF_ID.IR>>16) & 0x1F;
+	ID_EX.REG_RD_VALUE = (IF_ID.IR>>11) & 0x1F;
+	ID_EX.sham_t = (IF_ID.IR>>6) & 0x1F;
+	ID_EX.stage_stalled = 0;
+
+	dataHazardDetection();
+
+	if(STALL_COUNT > 0)
+	{
+		ID_EX.stage_stalled = 1;
+		ID_EX.IR = 0xFFFFFFFF;
+		ID_EX.REG_RD_VALUE = -1;
+		ID_EX.REG_RT_VALUE = -1;
+		ID_EX.REG_RS_VALUE = -1;
+		sim_print("Stall at ID stage at %x\n", CURRENT_STATE.PC);
+	}
+}
+
+//function to detect data hazard in pipeline
+//runs after EX and MEM this cycle, so EX_MEM holds the instruction one ahead of
+//the one being decoded and MEM_WB the one two ahead; anything older is already written back.
+//With ISSUE_WIDTH > 1 that is the EX_MEM and MEM_WB of every slot, with mem_stages > 1
+//MEM_PIPE holds those in between.
+void dataHazardDetection()
+{
+	int uses_rs, uses_rt, s;
+	source_regs(ID_EX.IR, &uses_rs, &uses_rt);
+	uint32_t rs = uses_rs ? ID_EX.REG_RS_VALUE : 0;
+	uint32_t rt = uses_rt ? ID_EX.REG_RT_VALUE : 0;
+	int reads_hi_lo = (ID_EX.IR >> 26) == 0 && ((ID_EX.IR & 0x3F) == 0b010000 || (ID_EX.IR & 0x3F) == 0b010010);
+
+	int ahead1_hit = 0, ahead1_load = 0, ahead2_hit = 0, ahead1_hi_lo = 0, ahead2_hi_lo = 0;
+	for(s = 0; s < ISSUE_WIDTH; s++)
+	{
+		CPU_Pipeline_Reg *ex_mem = slot_reg(s, LATCH_EX_MEM);
+		CPU_Pipeline_Reg *mem_wb = slot_reg(s, LATCH_MEM_WB);
+		uint32_t ahead1 = dest_reg(ex_mem);
+		uint32_t ahead2 = dest_reg(mem_wb);
+		if(ahead1 != 0 && (ahead1 == rs || ahead1 == rt))
+		{
+			ahead1_hit = 1;
+			ahead1_load |= load_store(ex_mem->IR>>26, ex_mem->IR & 0x0000003F) == 1 || (ex_mem->IR >> 26) == OP_SC;
 		}
-		else if(reg_jump(ID_EX.IR>>26, ID_EX.IR & 0x3F)) {
-			branch_jump(ID_EX.IR>>26);
+		ahead2_hit |= ahead2 != 0 && (ahead2 == rs || ahead2 == rt);
+		ahead1_hi_lo |= reads_hi_lo && writes_hi_lo(ex_mem);
+		ahead2_hi_lo |= reads_hi_lo && writes_hi_lo(mem_wb);
+	}
+
+	//a load that missed under the non-blocking cache holds its readers back until the block arrives
+	if(NUM_MSHRS > 0 && mshr_wait(ID_EX.IR, CYCLE_COUNT + 1))
+	{
+		STALL_COUNT = 1;
+		return;
+	}
+
+	//HI/LO still being computed, or the multiplier/divider busy
+	if((MULT_LATENCY > 1 || DIV_LATENCY > 1) && muldiv_wait(ID_EX.IR, CYCLE_COUNT + 1))
+	{
+		STALL_COUNT = 1;
+		return;
+	}
+
+	//a group issues in order, so a slot that cannot go with the older ones waits for the next cycle
+	if(ISSUE_WIDTH > 1 && CURRENT_SLOT > 0 && issue_conflict(rs, rt, reads_hi_lo))
+	{
+		STALL_COUNT = 1;
+		return;
+	}
+
+	//with mem_stages > 1 the instructions in the memory stages after MEM, youngest
+	//first: cycles until a load among them has its data, and until one is written back
+	int memory = memory_stages(), pipe_load = 0, pipe_hit = 0, k;
+	for(k = memory - 1; k >= 0; k--)
+	{
+		CPU_Pipeline_Reg *pipe = &MEM_PIPE[k];
+		uint32_t dest = dest_reg(pipe);
+		if(!((dest != 0 && (dest == rs || dest == rt)) || (reads_hi_lo && writes_hi_lo(pipe))))
+			continue;
+		pipe_hit = memory + 1 - k;
+		pipe_load = dest != 0 && (load_store(pipe->IR>>26, pipe->IR & 0x0000003F) == 1 || (pipe->IR >> 26) == OP_SC) ? memory - k : 0;
+	}
+
+	if(ENABLE_FORWARDING == 1)
+	{
+		//everything forwards into EX except a load's data (or an SC's outcome), which comes out of the last memory stage
+		if(ahead1_load)
+			STALL_COUNT = memory + 1;
+		if(pipe_load > STALL_COUNT)
+			STALL_COUNT = pipe_load;
+		if(memory > 0)
+			CORES[CURRENT_CORE].depth.load_use += STALL_COUNT;
+		return;
+	}
+
+	//without forwarding wait until the producer has been written back
+	if(ahead1_hit || ahead1_hi_lo)
+		STALL_COUNT = memory + 2;
+	else if(pipe_hit > 0)
+		STALL_COUNT = pipe_hit;
+	else if(ahead2_hit || ahead2_hi_lo)
+		STALL_COUNT = 1;
+}
+
+//which of rs/rt an instruction actually reads
+void source_regs(uint32_t instruction, int *uses_rs, int *uses_rt)
+{
+	uint32_t opcode = instruction >> 26;
+	*uses_rs = 0;
+	*uses_rt = 0;
+	if(opcode == 0)
+	{
+		switch(instruction & 0x3F) {
+			case 0b000000: //SLL
+			case 0b000010: //SRL
+			case 0b000011: //SRA
+				*uses_rt = 1;
+				break;
+			case 0b010001: //MTHI
+			case 0b010011: //MTLO
+			case 0b001000: //JR
+			case 0b001001: //JALR
+				*uses_rs = 1;
+				break;
+			case 0b010000: //MFHI
+			case 0b010010: //MFLO
+			case 0b001100: //SYSCALL
+				break;
+			default:
+				*uses_rs = 1;
+				*uses_rt = 1;
 		}
-		else if(load_store(ID_EX.IR>>26, ID_EX.IR & 0x0000003F)) {
-			printf("0x%x\n", ID_EX.A);
-			if(EX_MEM.imm >> 15) //sign extend
-			{
-				EX_MEM.imm = 0xFFFF0000 | EX_MEM.imm; 	
-			}
-			EX_MEM.ALUOutput = ID_EX.A + ID_EX.imm;
+	}
+	else if(opcode == 0b000100 || opcode == 0b000101 || load_store(opcode, 0) == 2) //BEQ, BNE and stores
+	{
+		*uses_rs = 1;
+		*uses_rt = 1;
+	}
+	else if(opcode != 0b000010 && opcode != 0b000011 && opcode != 0b001111) //everything but J, JAL and LUI reads rs
+	{
+		*uses_rs = 1;
+	}
+}
+
+//register written back by the instruction in a pipeline register, 0 if none (or a bubble)
+uint32_t dest_reg(CPU_Pipeline_Reg *reg)
+{
+	if(reg->stage_stalled == 1)
+		return 0;
+	return instruction_dest(reg->IR);
+}
+
+//register an instruction writes, 0 if none
+uint32_t instruction_dest(uint32_t instruction)
+{
+	uint32_t opcode = instruction >> 26;
+	if(opcode == 0)
+	{
+		switch(instruction & 0x3F) {
+			case 0b011000: //MULT
+			case 0b011001: //MULTU
+			case 0b011010: //DIV
+			case 0b011011: //DIVU
+			case 0b010001: //MTHI
+			case 0b010011: //MTLO
+			case 0b001000: //JR
+			case 0b001100: //SYSCALL
+				return 0;
+			default:
+				return (instruction >> 11) & 0x1F; //rd
 		}
-		else if(reg_imm(ID_EX.IR>>26)) {
-			EX_MEM.ALUOutput = ALUOperationI();
+	}
+	if(opcode == 0b000011) //JAL
+		return 31;
+	if(reg_imm(opcode) || load_store(opcode, 0) == 1 || opcode == OP_SC)
+		return (instruction >> 16) & 0x1F; //rt
+	return 0;
+}
+
+//value the instruction in a pipeline register will write back to dest_reg()
+uint32_t result_value(CPU_Pipeline_Reg *reg)
+{
+	uint32_t opcode = reg->IR >> 26;
+	if(load_store(opcode, 0) == 1 || opcode == OP_SC || opcode == 0b000011 || (opcode == 0 && (reg->IR & 0x3F) == 0b001001))
+		return reg->LMD; //loaded data, SC's outcome, or the return address of JAL/JALR
+	return reg->ALUOutput;
+}
+
+//does the instruction write HI/LO? bit 0 for LO, bit 1 for HI
+int writes_hi_lo(CPU_Pipeline_Reg *reg)
+{
+	if(reg->stage_stalled == 1 || (reg->IR >> 26) != 0)
+		return 0;
+	switch(reg->IR & 0x3F) {
+		case 0b011000: //MULT
+		case 0b011001: //MULTU
+		case 0b011010: //DIV
+		case 0b011011: //DIVU
+			return 3;
+		case 0b010001: //MTHI
+			return 2;
+		case 0b010011: //MTLO
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+//latest value of a register as seen by EX: the instruction that just left MEM
+//(the youngest slot's, with ISSUE_WIDTH > 1, or the youngest in the memory
+//stages after it), otherwise the register file (WB has already run this cycle)
+uint32_t forward_operand(uint32_t reg, uint32_t value)
+{
+	int s;
+	if(reg == 0)
+		return 0;
+	for(s = 0; s < memory_stages(); s++) //younger than MEM_WB
+	{
+		if(dest_reg(&MEM_PIPE[s]) == reg)
+			return result_value(&MEM_PIPE[s]);
+	}
+	for(s = ISSUE_WIDTH - 1; s >= 0; s--)
+	{
+		CPU_Pipeline_Reg *mem_wb = slot_reg(s, LATCH_MEM_WB);
+		if(dest_reg(mem_wb) == reg)
+			return result_value(mem_wb);
+	}
+	return CURRENT_STATE.REGS[reg];
+}
+
+//same as forward_operand() for HI (hi = 1) or LO (hi = 0)
+uint32_t forward_hi_lo(int hi)
+{
+	int s;
+	if(ENABLE_FORWARDING == 1)
+	{
+		for(s = 0; s < memory_stages(); s++)
+		{
+			if(writes_hi_lo(&MEM_PIPE[s]) & (hi ? 2 : 1))
+				return hi ? MEM_PIPE[s].HI : MEM_PIPE[s].LO;
 		}
-		else if(reg_reg(ID_EX.IR>>26, ID_EX.IR & 0x0000003F)) { //reg-reg
-			EX_MEM.ALUOutput = ALUOperationR();
+		for(s = ISSUE_WIDTH - 1; s >= 0; s--)
+		{
+			CPU_Pipeline_Reg *mem_wb = slot_reg(s, LATCH_MEM_WB);
+			if(writes_hi_lo(mem_wb) & (hi ? 2 : 1))
+				return hi ? mem_wb->HI : mem_wb->LO;
 		}
-		else if(ID_EX.IR != 0xC) {
-			// printf("ERROR EX\n");
+	}
+	return hi ? CURRENT_STATE.HI : CURRENT_STATE.LO;
+}
+
+/************************************************************/
+/* instruction fetch (IF) pipeline stage:                                                              */ 
+/************************************************************/
+void IF()
+{
+	if(STALL_COUNT == 0)
+	{
+		//with more front-end stages IF fetches into the youngest of them and the rest move on to IF_ID
+		CPU_Pipeline_Reg *fetched = front_stages() > 0 ? &FRONT_PIPE[0] : &IF_ID;
+		int syscall = fetched->IR == 0x0000000C;
+		if(front_stages() > 0)
+			pipe_advance(&IF_ID, FRONT_PIPE, front_stages());
+		if(syscall) //SYSCALL already fetched, nothing more to fetch
+		{
+			fetched->stage_stalled = 1;
+			fetched->IR = 0x0000000C;
+			return; 
 		}
+		fetched->IR = mem_read_32(CURRENT_STATE.PC);
+		fetched->PC = CURRENT_STATE.PC;
+		if(TRACE_OUT != NULL)
+			trace_record(TRACE_FETCH, CURRENT_STATE.PC, CURRENT_STATE.PC, 4);
+		profile_fetch(CURRENT_STATE.PC);
+		fetched->stage_stalled = 0;
+		NEXT_STATE.PC = CURRENT_STATE.PC + sizeof(uint32_t); //incrementing program counter by four for next state
 	}
+	else
+		sim_print("Stalling at IF stage\n");
 }
 
-uint32_t ALUOperationI() {
-	switch(ID_EX.IR >> 26) {
-		case 0b001000: { //ADDI
-			if(ID_EX.imm >> 15) {
-				ID_EX.imm = 0xFFFF0000 | ID_EX.imm; //sign extend	
+
+/************************************************************/
+/* functional engine: a whole instruction per cycle, no pipeline.  */
+/* Same ISA and branch convention as the pipeline (target = PC +    */
+/* offset << 2, or with delay slots PC + 4 + offset << 2 and the     */
+/* slot run before it), used as the fast reference engine.           */
+/************************************************************/
+void functional_step()
+{
+	uint32_t instruction = mem_read_32(CURRENT_STATE.PC);
+	uint32_t opcode = instruction >> 26;
+	uint32_t funct = instruction & 0x3F;
+	uint32_t rs = (instruction >> 21) & 0x1F;
+	uint32_t rt = (instruction >> 16) & 0x1F;
+	uint32_t imm = instruction & 0x0000FFFF;
+	uint32_t simm = imm & 0x8000 ? imm | 0xFFFF0000 : imm; //sign extended
+	uint32_t A = CURRENT_STATE.REGS[rs];
+	uint32_t B = CURRENT_STATE.REGS[rt];
+
+	if(NUM_MSHRS > 0 && mshr_wait(instruction, CYCLE_COUNT))
+	{
+		NEXT_STATE = CURRENT_STATE; //operand still coming from memory
+		return;
+	}
+	if(TRACE_OUT != NULL)
+		trace_record(TRACE_FETCH, CURRENT_STATE.PC, CURRENT_STATE.PC, 4);
+	profile_fetch(CURRENT_STATE.PC);
+
+	if(!QUIET_FLAG)
+	{
+		printf("[0x%08X]\t", CURRENT_STATE.PC);
+		print_instruction(instruction);
+	}
+	NEXT_STATE = CURRENT_STATE;
+	NEXT_STATE.PC = CURRENT_STATE.PC + 4;
+
+	if(opcode == 0 && funct == 0b001100) //SYSCALL
+	{
+		if(CURRENT_STATE.REGS[2] == 0xA)
+			RUN_FLAG = FALSE;
+	}
+	else if(opcode == 0 && funct == FUNCT_SYNC)
+	{
+		sync_wait();
+	}
+	else if(load_store(opcode, 0) == 1)
+	{
+		NEXT_STATE.REGS[rt] = data_load(CURRENT_STATE.PC, opcode, A + simm);
+		if(NUM_MSHRS > 0 && rt != 0)
+			REG_READY[rt] = DATA_READY;
+	}
+	else if(opcode == OP_SC)
+	{
+		NEXT_STATE.REGS[rt] = sync_store_conditional(CURRENT_STATE.PC, A + simm, B);
+	}
+	else if(load_store(opcode, 0) == 2)
+	{
+		data_store(CURRENT_STATE.PC, opcode, A + simm, B);
+	}
+	else
+	{
+		uint32_t value = execute(instruction, CURRENT_STATE.PC, A, B, &NEXT_STATE.HI, &NEXT_STATE.LO, &NEXT_STATE.PC);
+		NEXT_STATE.REGS[instruction_dest(instruction)] = value;
+	}
+	if(DELAY_SLOT) //a branch takes effect after the next instruction
+	{
+		NEXT_STATE.delay_pc = delay_redirect(CURRENT_STATE.PC, instruction, NEXT_STATE.PC);
+		NEXT_STATE.PC = CURRENT_STATE.delay_pc ? CURRENT_STATE.delay_pc : CURRENT_STATE.PC + 4;
+		if(reg_jump(opcode, funct))
+			delay_slot_count(CURRENT_STATE.PC, NEXT_STATE.delay_pc);
+	}
+	NEXT_STATE.REGS[0] = 0; //$zero stays zero
+	INSTRUCTION_COUNT++;
+}
+
+//what an instruction other than a memory access, SYSCALL or SYNC computes
+//from its operands: returns the value for instruction_dest() (0 if none),
+//updates *hi/*lo if it writes them (MFHI/MFLO read them) and sets *next_pc
+uint32_t execute(uint32_t instruction, uint32_t pc, uint32_t A, uint32_t B, uint32_t *hi, uint32_t *lo, uint32_t *next_pc)
+{
+	uint32_t opcode = instruction >> 26;
+	uint32_t rt = (instruction >> 16) & 0x1F;
+	uint32_t sa = (instruction >> 6) & 0x1F;
+	uint32_t imm = instruction & 0x0000FFFF;
+	uint32_t simm = imm & 0x8000 ? imm | 0xFFFF0000 : imm; //sign extended
+	uint32_t branch_target = branch_pc(pc) + (simm << 2);
+
+	*next_pc = DELAY_SLOT && reg_jump(opcode, instruction & 0x3F) ? pc + 8 : pc + 4; //with a delay slot, past it
+	if(opcode == 0)
+	{
+		switch(instruction & 0x3F)
+		{
+			case 0b100000: //ADD
+			case 0b100001: //ADDU
+				return A + B;
+			case 0b100010: //SUB
+			case 0b100011: //SUBU
+				return A - B;
+			case 0b100100: //AND
+				return A & B;
+			case 0b100101: //OR
+				return A | B;
+			case 0b100110: //XOR
+				return A ^ B;
+			case 0b100111: //NOR
+				return ~(A | B);
+			case 0b101010: //SLT
+				return (int32_t) A < (int32_t) B;
+			case 0b011000: { //MULT
+				int64_t result = (int64_t) (int32_t) A * (int64_t) (int32_t) B;
+				*lo = result;
+				*hi = result >> 32;
+				return 0;
 			}
-			uint8_t bit30_carry = (((ID_EX.imm >> 30) & 0x1) + (0x1 & (ID_EX.A >> 30))) >> 1;
-			uint8_t bit31_carry = (((ID_EX.imm >> 31) & 0x1) + (0x1 & (ID_EX.A >> 31))) >> 1;
-			if(bit30_carry == bit31_carry)
-				return ID_EX.A + ID_EX.imm;
-			break;
+			case 0b011001: { //MULTU
+				uint64_t result = (uint64_t) A * (uint64_t) B;
+				*lo = result;
+				*hi = result >> 32;
+				return 0;
+			}
+			case 0b011010: //DIV
+				if(A == 0x80000000 && B == 0xFFFFFFFF) //INT_MIN / -1 overflows on the host
+				{
+					*lo = 0x80000000;
+					*hi = 0;
+				}
+				else if(B != 0)
+				{
+					*lo = (int32_t) A / (int32_t) B;
+					*hi = (int32_t) A % (int32_t) B;
+				}
+				return 0;
+			case 0b011011: //DIVU
+				if(B != 0)
+				{
+					*lo = A / B;
+					*hi = A % B;
+				}
+				return 0;
+			case 0b010000: //MFHI
+				return *hi;
+			case 0b010010: //MFLO
+				return *lo;
+			case 0b010001: //MTHI
+				*hi = A;
+				return 0;
+			case 0b010011: //MTLO
+				*lo = A;
+				return 0;
+			case 0b000000: //SLL
+				return B << sa;
+			case 0b000010: //SRL
+				return B >> sa;
+			case 0b000011: //SRA
+				return (int32_t) B >> sa;
+			case 0b001000: //JR
+				*next_pc = A;
+				return 0;
+			case 0b001001: //JALR
+				*next_pc = A;
+				return link_pc(pc);
 		}
-		case 0b001001: { //ADDIU, unsigned so not carry bits
-			//printf("EX_MEM.A = %X\n", EX_MEM.A);
-			//printf("EX_MEM.imm = %X\n", EX_MEM.imm);
-			//printf("result = %X\n", EX_MEM.A + EX_MEM.imm);
-			return EX_MEM.A + EX_MEM.imm;
+		return 0;
+	}
+	switch(opcode)
+	{
+		case 0b001000: //ADDI
+		case 0b001001: //ADDIU
+			return A + simm;
+		case 0b001100: //ANDI
+			return A & imm;
+		case 0b001101: //ORI
+			return A | imm;
+		case 0b001110: //XORI
+			return A ^ imm;
+		case 0b001010: //SLTI
+			return (int32_t) A < (int32_t) simm;
+		case 0b001111: //LUI
+			return imm << 16;
+		case 0b000100: //BEQ
+			if(A == B)
+				*next_pc = branch_target;
+			return 0;
+		case 0b000101: //BNE
+			if(A != B)
+				*next_pc = branch_target;
+			return 0;
+		case 0b000110: //BLEZ
+			if((int32_t) A <= 0)
+				*next_pc = branch_target;
+			return 0;
+		case 0b000111: //BGTZ
+			if((int32_t) A > 0)
+				*next_pc = branch_target;
+			return 0;
+		case 0b000001: //BGEZ (rt = 1) and BLTZ (rt = 0)
+			if(rt == 1 ? (int32_t) A >= 0 : (int32_t) A < 0)
+				*next_pc = branch_target;
+			return 0;
+		case 0b000011: //JAL
+			*next_pc = (instruction & 0x03FFFFFF) << 2;
+			return link_pc(pc);
+		case 0b000010: //J
+			*next_pc = (instruction & 0x03FFFFFF) << 2;
+			return 0;
+	}
+	return 0;
+}
+
+/************************************************************/
+/* Out-of-order engine                                              */
+/************************************************************/
+//the window of the thread in the globals
+OOOCore *ooo_context()
+{
+	return &OOO_CORES[CURRENT_CORE][NUM_THREADS > 1 ? THREADS[CURRENT_CORE].current : 0];
+}
+
+//empty every window, stats included: each starts again from its CURRENT_STATE
+void ooo_reset()
+{
+	memset(OOO_CORES, 0, sizeof(OOO_CORES));
+}
+
+//an empty window on the committed state: every register mapped to itself
+void ooo_start(OOOCore *ooo)
+{
+	uint32_t r;
+	ooo->active = 1;
+	ooo->fetch_pc = CURRENT_STATE.PC;
+	ooo->delay_pc = CURRENT_STATE.delay_pc;
+	ooo->fetch_stall = 0;
+	ooo->head = ooo->count = 0;
+	ooo->iq_count = ooo->lsq_count = 0;
+	ooo->port_free = ooo->commit_free = 0;
+	for(r = 0; r < OOO_ARCH_REGS; r++)
+	{
+		ooo->rat[r] = r;
+		ooo->value[r] = r == OOO_HI ? CURRENT_STATE.HI : r == OOO_LO ? CURRENT_STATE.LO : CURRENT_STATE.REGS[r];
+		ooo->ready[r] = 0;
+	}
+	ooo->free_count = 0;
+	for(r = OOO_PHYS_REGS - 1; r >= OOO_ARCH_REGS; r--)
+		ooo->free_list[ooo->free_count++] = r;
+	memset(ooo->bht, 1, sizeof(ooo->bht)); //weakly not taken
+	ooo->ras_top = 0;
+}
+
+//one cycle of the out-of-order core, the oldest work first like handle_pipeline()
+void ooo_step()
+{
+	OOOCore *ooo = ooo_context();
+	NEXT_STATE = CURRENT_STATE;
+	if(!ooo->active)
+		ooo_start(ooo);
+	ooo_resolve(ooo);
+	ooo_commit(ooo);
+	if(RUN_FLAG == FALSE)
+		return;
+	ooo_issue(ooo);
+	ooo_dispatch(ooo);
+	ooo->stats.cycles++;
+	ooo->stats.rob_occupancy += ooo->count;
+}
+
+//a mispredicted branch that has executed squashes everything behind it: the
+//ROB is walked back from the youngest, each entry giving its registers back
+//to the rename table and the free list, and fetch restarts on the real path.
+//With DELAY_SLOT a branch keeps its delay slot, after which fetch takes the real path.
+void ooo_resolve(OOOCore *ooo)
+{
+	int i, d, keep;
+	uint32_t delay;
+	for(i = 0; i < ooo->count; i++)
+	{
+		if(ooo->rob[(ooo->head + i) % MAX_ROB].mispredicted == 1)
 			break;
+	}
+	if(i == ooo->count)
+		return;
+	ROBEntry *branch = &ooo->rob[(ooo->head + i) % MAX_ROB];
+	if(branch->done > CYCLE_COUNT)
+		return; //anything younger is on its wrong path anyway
+	delay = DELAY_SLOT ? delay_redirect(branch->pc, branch->instruction, branch->next_pc) : 0;
+	keep = DELAY_SLOT && reg_jump(branch->instruction >> 26, branch->instruction & 0x3F) && ooo->count > i + 1; //its slot
+	while(ooo->count > i + 1 + keep)
+	{
+		ROBEntry *entry = &ooo->rob[(ooo->head + ooo->count - 1) % MAX_ROB];
+		for(d = entry->dests - 1; d >= 0; d--)
+		{
+			ooo->rat[entry->dest[d]] = entry->old_phys[d];
+			ooo->free_list[ooo->free_count++] = entry->phys[d];
 		}
-		case 0b001100: { //ANDI
-			return ID_EX.A & ID_EX.imm;
+		if(!entry->issued)
+			ooo->iq_count--;
+		if(entry->memory)
+			ooo->lsq_count--;
+		ooo->count--;
+		ooo->stats.squashed++;
+	}
+	branch->mispredicted = 2; //recovered, counted at commit
+	ooo->ras_top = branch->ras_top;
+	ooo->fetch_stall = 0; //a serializing instruction is always the youngest, so it went too
+	ooo->fetch_pc = branch->next_pc;
+	if(keep) //fetch goes on after the slot, its own branch (if one) still predicted
+	{
+		ROBEntry *slot = &ooo->rob[(ooo->head + i + 1) % MAX_ROB];
+		slot->slot_next = delay;
+		ooo->fetch_pc = delay ? delay : slot->pc + 4;
+		ooo->delay_pc = delay_redirect(slot->pc, slot->instruction, slot->predicted);
+		ooo->ras_top = slot->ras_top;
+		ooo->fetch_stall = slot->serial;
+	}
+	else if(DELAY_SLOT) //a store, or a branch whose slot is still to be fetched
+	{
+		ooo->fetch_pc = branch->slot_next ? branch->slot_next : branch->pc + 4;
+		ooo->delay_pc = delay;
+	}
+}
+
+//retire up to width finished instructions from the head, in order, into
+//NEXT_STATE; stores write the cache now, the only point they are certain
+void ooo_commit(OOOCore *ooo)
+{
+	int n, d;
+	if(ooo->commit_free > CYCLE_COUNT)
+		return;
+	for(n = 0; n < ISSUE_WIDTH && ooo->count > 0; n++)
+	{
+		ROBEntry *entry = &ooo->rob[ooo->head];
+		uint32_t opcode = entry->instruction >> 26;
+		if(!entry->issued || entry->done > CYCLE_COUNT)
+		{
+			if(n == 0 && entry->issued && entry->miss_cycles > 0)
+				ooo->stats.exposed_cycles++; //the window could not hide this cycle of the miss
 			break;
 		}
-		case 0b001101: { //ORI
-			return ID_EX.A | ID_EX.imm;
-			break;
+		if(entry->memory == 2 && opcode != OP_SC)
+		{
+			if(ooo->port_free > CYCLE_COUNT)
+				break;
+			DATA_READY = 0;
+			data_store(entry->pc, opcode, entry->addr, entry->value);
+			ooo_latency(ooo, CYCLE_COUNT + 1);
+			ooo->commit_free = ooo->port_free; //a blocking cache holds commit too
 		}
-		case 0b001110: { //XORI
-			return ID_EX.A ^ ID_EX.imm;
+		for(d = 0; d < entry->dests; d++)
+		{
+			uint32_t reg = entry->dest[d], value = ooo->value[entry->phys[d]];
+			if(reg == OOO_HI)
+				NEXT_STATE.HI = value;
+			else if(reg == OOO_LO)
+				NEXT_STATE.LO = value;
+			else
+				NEXT_STATE.REGS[reg] = value;
+			ooo->free_list[ooo->free_count++] = entry->old_phys[d];
+		}
+		NEXT_STATE.PC = entry->next_pc;
+		if(DELAY_SLOT) //a branch takes effect after the next instruction, see delay_redirect()
+		{
+			NEXT_STATE.PC = entry->slot_next ? entry->slot_next : entry->pc + 4;
+			NEXT_STATE.delay_pc = delay_redirect(entry->pc, entry->instruction, entry->next_pc);
+			if(reg_jump(opcode, entry->instruction & 0x3F))
+				delay_slot_count(entry->pc, NEXT_STATE.delay_pc);
+		}
+		if(!QUIET_FLAG)
+		{
+			printf("[0x%08X]\t", entry->pc);
+			print_instruction(entry->instruction);
+		}
+		if(opcode == 0 && (entry->instruction & 0x3F) == 0b001100 && NEXT_STATE.REGS[2] == 0xA) //SYSCALL exit
+			RUN_FLAG = FALSE;
+		if(entry->serial)
+			ooo->fetch_stall = 0;
+		if(opcode == 0b000100 || opcode == 0b000101 || opcode == 0b000110 || opcode == 0b000111 || opcode == 0b000001)
+		{
+			uint8_t *counter = &ooo->bht[(entry->pc >> 2) % OOO_BHT];
+			if(entry->next_pc != entry->pc + (DELAY_SLOT ? 8 : 4))
+				*counter += *counter < 3;
+			else
+				*counter -= *counter > 0;
+		}
+		if(entry->mispredicted && entry->memory == 2)
+			ooo->stats.replays++; //a store that squashed a load behind it
+		else if(entry->mispredicted)
+			ooo->stats.mispredicts++;
+		if(opcode == 0b000100 || opcode == 0b000101 || opcode == 0b000110 || opcode == 0b000111 || opcode == 0b000001
+			|| opcode == 0b000010 || opcode == 0b000011 || (opcode == 0 && ((entry->instruction & 0x3F) == 0b001000 || (entry->instruction & 0x3F) == 0b001001)))
+			ooo->stats.branches++;
+		if(entry->memory == 1)
+		{
+			ooo->stats.loads++;
+			ooo->stats.forwarded += entry->forwarded == 2;
+			ooo->stats.partial += entry->forwarded == 1;
+			if(entry->miss_cycles > 0)
+			{
+				ooo->stats.load_misses++;
+				ooo->stats.miss_cycles += entry->miss_cycles;
+			}
+		}
+		if(entry->memory)
+			ooo->lsq_count--;
+		ooo->head = (ooo->head + 1) % MAX_ROB;
+		ooo->count--;
+		ooo->stats.committed++;
+		INSTRUCTION_COUNT++;
+		if(RUN_FLAG == FALSE || ooo->commit_free > CYCLE_COUNT)
 			break;
+	}
+	NEXT_STATE.REGS[0] = 0;
+}
+
+//oldest first, every instruction whose operands are ready and whose unit is
+//free: alus ALUs (branches and store address/data too), the multiplier or
+//the divider (see muldiv_start), and the memory port for loads, LL, SC and SYNC
+void ooo_issue(OOOCore *ooo)
+{
+	int i, alus = 0, port = ooo->port_free > CYCLE_COUNT;
+	for(i = 0; i < ooo->count && ooo->iq_count > 0; i++)
+	{
+		ROBEntry *entry = &ooo->rob[(ooo->head + i) % MAX_ROB];
+		uint32_t opcode = entry->instruction >> 26, funct = entry->instruction & 0x3F;
+		if(entry->issued || (entry->serial && i > 0))
+			continue;
+		if(ooo->ready[entry->src[0]] > CYCLE_COUNT || ooo->ready[entry->src[1]] > CYCLE_COUNT
+			|| ooo->ready[entry->src[2]] > CYCLE_COUNT || ooo->ready[entry->src[3]] > CYCLE_COUNT)
+			continue;
+		int uses_port = entry->memory == 1 || opcode == OP_SC || (opcode == 0 && funct == FUNCT_SYNC);
+		int uses_muldiv = opcode == 0 && funct >= 0b011000 && funct <= 0b011011;
+		if(uses_port ? port : uses_muldiv ? (funct & 0b10 ? DIV_FREE : MULT_FREE) > CYCLE_COUNT : alus == NUM_ALUS)
+			continue;
+		if(!ooo_execute(ooo, entry, i))
+			continue;
+		if(uses_port)
+			port = 1;
+		else if(!uses_muldiv)
+			alus++;
+		entry->issued = 1;
+		ooo->iq_count--;
+	}
+}
+
+//execute the i-th oldest instruction of the window, writing its result to
+//its physical registers with the cycle it is ready. Returns 0 for a load
+//that has to wait for an older store's address.
+int ooo_execute(OOOCore *ooo, ROBEntry *entry, int index)
+{
+	uint32_t instruction = entry->instruction;
+	uint32_t opcode = instruction >> 26;
+	uint32_t funct = instruction & 0x3F;
+	uint32_t imm = instruction & 0x0000FFFF;
+	uint32_t simm = imm & 0x8000 ? imm | 0xFFFF0000 : imm; //sign extended
+	uint32_t A = ooo->value[entry->src[0]], B = ooo->value[entry->src[1]];
+	uint32_t hi = ooo->value[entry->src[2]], lo = ooo->value[entry->src[3]];
+	uint32_t addr = A + simm, result = 0, done = CYCLE_COUNT + 1;
+	int d, replay = 0;
+
+	entry->next_pc = entry->pc + 4;
+	if(entry->memory == 1)
+	{
+		uint32_t word = 0;
+		int bytes = ooo_forward(ooo, index, opcode, addr, &word);
+		if(bytes < 0)
+		{
+			ooo->stats.address_waits++;
+			return 0;
 		}
-		case 0b001010: { //SLTI
-			if((int32_t) ID_EX.A < (int16_t) ID_EX.imm) {
-				return 1;
-			} 
-			else {
-				return 0;
+		entry->addr = addr;
+		entry->miss_cycles = 0;
+		entry->forwarded = bytes == 0 ? 0 : (uint32_t) bytes == access_bytes(opcode, addr) ? 2 : 1;
+		if(entry->forwarded == 2) //from the queue, in the time of a hit
+		{
+			result = load_extract(opcode, addr, word);
+			done = CYCLE_COUNT + 2;
+		}
+		else
+		{
+			DATA_READY = 0;
+			result = data_load(entry->pc, opcode, addr);
+			done = ooo_latency(ooo, CYCLE_COUNT + 2); //address, then the cache
+			entry->miss_cycles = done - (CYCLE_COUNT + 2);
+			if(entry->forwarded) //memory's word with the stores' bytes over it
+				result = load_extract(opcode, addr, (mem_read_32(addr & ~3) & ~lane_mask(bytes)) | word);
+		}
+	}
+	else if(opcode == OP_SC)
+	{
+		DATA_READY = 0;
+		result = sync_store_conditional(entry->pc, addr, B);
+		done = ooo_latency(ooo, CYCLE_COUNT + 2);
+	}
+	else if(entry->memory == 2)
+	{
+		entry->addr = addr;
+		entry->value = B;
+		replay = LSQ_SPECULATE && ooo_violation(ooo, index, opcode, addr);
+	}
+	else if(opcode == 0 && funct == FUNCT_SYNC)
+	{
+		DATA_READY = 0;
+		sync_wait();
+		done = ooo_latency(ooo, CYCLE_COUNT + 1);
+	}
+	else if(!(opcode == 0 && funct == 0b001100)) //SYSCALL acts at commit
+	{
+		result = execute(instruction, entry->pc, A, B, &hi, &lo, &entry->next_pc);
+		if(opcode == 0 && funct >= 0b011000 && funct <= 0b011011) //MULT/MULTU/DIV/DIVU
+		{
+			muldiv_start(funct);
+			done = CYCLE_COUNT + (funct & 0b10 ? DIV_LATENCY : MULT_LATENCY);
+		}
+	}
+	for(d = 0; d < entry->dests; d++)
+	{
+		uint32_t reg = entry->dest[d];
+		ooo->value[entry->phys[d]] = reg == OOO_HI ? hi : reg == OOO_LO ? lo : result;
+		ooo->ready[entry->phys[d]] = done;
+	}
+	entry->done = done;
+	entry->mispredicted = entry->next_pc != entry->predicted || replay; //a replay refetches from pc + 4
+	return 1;
+}
+
+//when the data of the cache access just made is there, earliest for a hit.
+//A blocking cache's miss (or one waiting for an MSHR) holds the memory port
+//for its cycles instead of freezing the core as it does the pipeline.
+uint32_t ooo_latency(OOOCore *ooo, uint32_t earliest)
+{
+	ooo->port_free = CYCLE_COUNT + 1;
+	if(CACHE_MISS_FLAG == 1)
+	{
+		earliest += CACHE_STALL_COUNT;
+		ooo->port_free += CACHE_STALL_COUNT;
+		CACHE_MISS_FLAG = 0;
+		CACHE_STALL_COUNT = 0;
+	}
+	if(NUM_MSHRS > 0 && DATA_READY > earliest)
+		earliest = DATA_READY;
+	return earliest;
+}
+
+//the bytes of its word a load or store at addr touches, bit i for byte i
+uint32_t access_bytes(uint32_t opcode, uint32_t addr)
+{
+	if(opcode == 0b100000 || opcode == 0b101000) //LB, SB
+		return 1 << (addr & 3);
+	if(opcode == 0b100001 || opcode == 0b101001) //LH, SH
+		return 3 << (addr & 2);
+	return 0xF;
+}
+
+//a byte mask from access_bytes() as a mask of the word's bits
+uint32_t lane_mask(uint32_t bytes)
+{
+	uint32_t mask = 0;
+	int i;
+	for(i = 0; i < 4; i++)
+		mask |= bytes & (1 << i) ? 0xFFu << (i << 3) : 0;
+	return mask;
+}
+
+//store-to-load forwarding for the load that is the index-th oldest entry:
+//every byte it reads that an older store still in the window writes is
+//taken from the youngest such store and placed in *word. A store that has
+//not issued has its address once its base register is ready, so a load
+//only waits on stores to its bytes whose data is not there yet, and on
+//those whose address is not known, unless lsq_speculate lets it go past.
+//Returns the bytes covered (0 if none, access_bytes() if all), or -1 to wait.
+int ooo_forward(OOOCore *ooo, int index, uint32_t opcode, uint32_t addr, uint32_t *word)
+{
+	uint32_t wanted = access_bytes(opcode, addr), covered = 0;
+	int i;
+	for(i = index - 1; i >= 0 && covered != wanted; i--)
+	{
+		ROBEntry *older = &ooo->rob[(ooo->head + i) % MAX_ROB];
+		uint32_t store_op = older->instruction >> 26, store_addr = older->addr;
+		if(older->memory != 2 || store_op == OP_SC) //SC stores as it executes
+			continue;
+		if(!older->issued)
+		{
+			uint32_t imm = older->instruction & 0x0000FFFF;
+			if(ooo->ready[older->src[0]] > CYCLE_COUNT)
+			{
+				if(LSQ_SPECULATE)
+					continue;
+				return -1;
 			}
+			store_addr = ooo->value[older->src[0]] + (imm & 0x8000 ? imm | 0xFFFF0000 : imm);
 		}
-		default:
-			return 0;
+		if((store_addr & ~3) != (addr & ~3))
+			continue;
+		uint32_t bytes = access_bytes(store_op, store_addr) & wanted & ~covered;
+		if(bytes == 0)
+			continue;
+		if(!older->issued)
+			return -1;
+		uint32_t shift = (store_op == 0b101000 ? store_addr & 3 : store_op == 0b101001 ? store_addr & 2 : 0) << 3;
+		*word |= (older->value << shift) & lane_mask(bytes);
+		covered |= bytes;
+	}
+	return covered;
+}
+
+//a store at the index-th oldest entry has just got its address: did a
+//younger load already issue that reads one of its bytes without a store
+//in between having written it? Then that load read a stale value.
+int ooo_violation(OOOCore *ooo, int index, uint32_t opcode, uint32_t addr)
+{
+	uint32_t stored = access_bytes(opcode, addr);
+	int i;
+	for(i = index + 1; i < ooo->count && stored != 0; i++)
+	{
+		ROBEntry *younger = &ooo->rob[(ooo->head + i) % MAX_ROB];
+		uint32_t younger_op = younger->instruction >> 26;
+		if(!younger->issued || younger->memory == 0 || (younger->addr & ~3) != (addr & ~3))
+			continue;
+		if(younger->memory == 2)
+			stored &= ~access_bytes(younger_op, younger->addr); //later loads read that store's bytes
+		else if(stored & access_bytes(younger_op, younger->addr))
+			return 1;
 	}
 	return 0;
 }
 
-uint32_t ALUOperationR() {
-	switch(ID_EX.IR & 0x0000003F) {
-		case 0b100000: { //ADD
-			return ID_EX.A + ID_EX.B;
-			break;
-		}
-		case 0b100001: { //ADDU
-			return ID_EX.A + ID_EX.B;
+//fetch, decode and rename up to width instructions down the predicted path
+void ooo_dispatch(OOOCore *ooo)
+{
+	int n, d, uses_rs, uses_rt;
+	for(n = 0; n < ISSUE_WIDTH; n++)
+	{
+		if(ooo->fetch_stall)
+		{
+			ooo->stats.serial_cycles += n == 0;
 			break;
 		}
-		case 0b100010: { //SUB
-			return ID_EX.A - ID_EX.B;
+		if(ooo->count == ROB_SIZE)
+		{
+			ooo->stats.rob_full++;
 			break;
 		}
-		case 0b100011: { //SUBU
-			return ID_EX.A - ID_EX.B;
+		if(ooo->iq_count == IQ_SIZE)
+		{
+			ooo->stats.iq_full++;
 			break;
 		}
-		case 0b100100: { //AND
-			return ID_EX.A & ID_EX.B;
+		uint32_t pc = ooo->fetch_pc;
+		uint32_t instruction = mem_read_32(pc);
+		uint32_t opcode = instruction >> 26, funct = instruction & 0x3F;
+		int memory = load_store(opcode, 0);
+		if(memory && ooo->lsq_count == LSQ_SIZE)
+		{
+			ooo->stats.lsq_full++;
 			break;
 		}
-		case 0b100101: { //OR
-			return ID_EX.A | ID_EX.B;
-			break;
+		if(TRACE_OUT != NULL)
+			trace_record(TRACE_FETCH, pc, pc, 4);
+		profile_fetch(pc);
+
+		ROBEntry *entry = &ooo->rob[(ooo->head + ooo->count) % MAX_ROB];
+		entry->pc = pc;
+		entry->instruction = instruction;
+		entry->memory = memory;
+		entry->serial = opcode == OP_LL || opcode == OP_SC || (opcode == 0 && (funct == 0b001100 || funct == FUNCT_SYNC));
+		entry->issued = 0;
+		entry->mispredicted = 0;
+		entry->miss_cycles = 0;
+
+		//sources not read rename to $0's register, always ready; DIV/DIVU
+		//read HI/LO too, which a zero divisor leaves as they were
+		int muldiv = opcode == 0 && funct >= 0b011000 && funct <= 0b011011;
+		int divide = opcode == 0 && (funct == 0b011010 || funct == 0b011011);
+		source_regs(instruction, &uses_rs, &uses_rt);
+		entry->src[0] = uses_rs ? ooo->rat[(instruction >> 21) & 0x1F] : 0;
+		entry->src[1] = uses_rt ? ooo->rat[(instruction >> 16) & 0x1F] : 0;
+		entry->src[2] = divide || (opcode == 0 && funct == 0b010000) ? ooo->rat[OOO_HI] : 0; //MFHI
+		entry->src[3] = divide || (opcode == 0 && funct == 0b010010) ? ooo->rat[OOO_LO] : 0; //MFLO
+
+		entry->dests = 0;
+		if(instruction_dest(instruction) != 0)
+			entry->dest[entry->dests++] = instruction_dest(instruction);
+		if(muldiv || (opcode == 0 && funct == 0b010001)) //MTHI
+			entry->dest[entry->dests++] = OOO_HI;
+		if(muldiv || (opcode == 0 && funct == 0b010011)) //MTLO
+			entry->dest[entry->dests++] = OOO_LO;
+		for(d = 0; d < entry->dests; d++)
+		{
+			uint32_t phys = ooo->free_list[--ooo->free_count];
+			entry->old_phys[d] = ooo->rat[entry->dest[d]];
+			entry->phys[d] = phys;
+			ooo->rat[entry->dest[d]] = phys;
+			ooo->ready[phys] = OOO_NOT_READY;
 		}
-		case 0b100110: { //XOR
-			return ID_EX.A ^ ID_EX.B;
-			break;
+
+		entry->predicted = ooo_predict(ooo, pc, instruction);
+		entry->ras_top = ooo->ras_top;
+		entry->slot_next = 0;
+		ooo->fetch_pc = entry->predicted;
+		if(DELAY_SLOT) //on to an older branch's target if this is its slot, else on to this one's slot
+		{
+			entry->slot_next = ooo->delay_pc;
+			ooo->fetch_pc = entry->slot_next ? entry->slot_next : pc + 4;
+			ooo->delay_pc = delay_redirect(pc, instruction, entry->predicted);
 		}
-		case 0b100111: { //NOR
-			return ~(ID_EX.A | ID_EX.B);
+		ooo->count++;
+		ooo->iq_count++;
+		if(memory)
+			ooo->lsq_count++;
+		ooo->stats.dispatched++;
+		if(entry->serial)
+		{
+			ooo->fetch_stall = 1;
 			break;
 		}
-		case 0b101010: { //SLT
-			if((int32_t) ID_EX.A < (int32_t) ID_EX.B) {
-				return 1;
-			} else {
-				return 0;
-			}
-		}
-		case 0b011000: { //MULT
-			if(EX_MEM.A >> 31)
-			{
-				EX_MEM.A = 0xFFFFFFFF00000000 | EX_MEM.A; //sign extend with 1's
-			}
-			if(EX_MEM.B >> 31)
-			{
-				EX_MEM.B = 0xFFFFFFFF00000000 | EX_MEM.B; //sign extend with 1's
-			}
-			int64_t result = EX_MEM.A * EX_MEM.B;
-			EX_MEM.LO = result;
-			EX_MEM.HI = (result) >> 32;
-			return;
-		}
-		case 0b011001: { //MULTU
-			uint64_t result = (uint32_t) EX_MEM.A * (uint32_t) EX_MEM.B;
-			EX_MEM.LO = result;
-			EX_MEM.HI = (result) >> 32;
-			return;
-		}
-		case 0b011010: { //DIV
-			EX_MEM.LO = EX_MEM.A / EX_MEM.B;
-			EX_MEM.HI = EX_MEM.A % EX_MEM.B;
-			//EX_MEM.ALUOutputLow = (int32_t) ID_EX.A / (int32_t) ID_EX.B;
-			return;
-		}
-		case 0b011011: { //DIVU
-			EX_MEM.LO = EX_MEM.A / EX_MEM.B;
-			EX_MEM.HI = EX_MEM.A % EX_MEM.B;
-			return 0;
-		}
-		case 0b000000: { //SLL
-			return ID_EX.B << ID_EX.sham_t;
-		}
-		case 0b000010: { //SRL
-			return ID_EX.B >> ID_EX.sham_t;
-		}
-		case 0b000011: { //SRA
-			return (ID_EX.B >> ID_EX.sham_t) | (ID_EX.B & 0x80000000);
-		}
-		case 0b001000: { //JR
-			FLUSH_FLAG = 1;
-			CURRENT_STATE.PC = CURRENT_STATE.REGS[31];
-			return ID_EX.A;
-		}
-		case 0b001001: { //JALR
-			FLUSH_FLAG = 1;
-			EX_MEM.LMD = CURRENT_STATE.PC + 4;
-			return ID_EX.A;
-		}
-		case 0b010000: { //MFHI
-			break;			
-		}
-		case 0b010010: { //MFLO
-			break;			
-		}
-		case 0b010011: {
-			EX_MEM.ALUOutput = EX_MEM.A;	
+	}
+}
+
+//where fetch goes after instruction: conditional branches by their 2-bit
+//counter, J/JAL to their target, JR $ra to the top of the return address
+//stack, anything else (JR/JALR through another register too) on to PC + 4,
+//or past the delay slot for a branch or jump with DELAY_SLOT
+uint32_t ooo_predict(OOOCore *ooo, uint32_t pc, uint32_t instruction)
+{
+	uint32_t opcode = instruction >> 26, funct = instruction & 0x3F;
+	uint32_t imm = instruction & 0x0000FFFF;
+	uint32_t simm = imm & 0x8000 ? imm | 0xFFFF0000 : imm; //sign extended
+	uint32_t after = DELAY_SLOT && reg_jump(opcode, funct) ? pc + 8 : pc + 4;
+	if(opcode == 0b000100 || opcode == 0b000101 || opcode == 0b000110 || opcode == 0b000111 || opcode == 0b000001)
+		return ooo->bht[(pc >> 2) % OOO_BHT] >= 2 ? branch_pc(pc) + (simm << 2) : after;
+	if(opcode == 0b000011 || (opcode == 0 && funct == 0b001001)) //JAL, JALR
+		ooo->ras[ooo->ras_top++ % OOO_RAS] = link_pc(pc);
+	if(opcode == 0b000010 || opcode == 0b000011) //J, JAL
+		return (instruction & 0x03FFFFFF) << 2;
+	if(opcode == 0 && funct == 0b001000 && ((instruction >> 21) & 0x1F) == 31 && ooo->ras_top > 0) //JR $ra
+		return ooo->ras[--ooo->ras_top % OOO_RAS];
+	return after;
+}
+
+//per window: IPC, how full it ran, branch prediction, and how much of the
+//load miss latency it hid (the cycles a missing load held up commit at the
+//head of the ROB are the ones it did not)
+void ooo_print()
+{
+	int i, t;
+	printf("Out-of-order: width %d, ROB %u, IQ %u, LSQ %u, %u ALUs\n", ISSUE_WIDTH, ROB_SIZE, IQ_SIZE, LSQ_SIZE, NUM_ALUS);
+	printf("Core\tThread\tInstrs\tIPC\tROB avg\tMispred\tSquashed\tROB/IQ/LSQ full\tLoad misses\tMiss cycles\tExposed\tHidden %%\n");
+	for(i = 0; i < NUM_CORES; i++)
+	{
+		for(t = 0; t < NUM_THREADS; t++)
+		{
+			OOOStats *stats = &OOO_CORES[i][t].stats;
+			printf("%d\t%d\t%u\t%0.3f\t%0.1f\t%u/%u\t%u\t%u/%u/%u\t%u/%u\t%llu\t%llu\t%0.2f\n", i, t, stats->committed,
+				stats->cycles ? (double) stats->committed / stats->cycles : 0.0,
+				stats->cycles ? (double) stats->rob_occupancy / stats->cycles : 0.0,
+				stats->mispredicts, stats->branches, stats->squashed,
+				stats->rob_full, stats->iq_full, stats->lsq_full, stats->load_misses, stats->loads,
+				(unsigned long long) stats->miss_cycles, (unsigned long long) stats->exposed_cycles,
+				stats->miss_cycles ? 100.0 * (1.0 - (double) stats->exposed_cycles / stats->miss_cycles) : 0.0);
 		}
-		default: {
-			return 0;
+	}
+	printf("Load/store queue: loads %s stores with unknown addresses\n", LSQ_SPECULATE ? "go past (replayed if wrong)" : "wait for");
+	printf("Core\tThread\tLoads\tForwarded\tPartial\tFwd %%\tAddr waits\tReplays\n");
+	for(i = 0; i < NUM_CORES; i++)
+	{
+		for(t = 0; t < NUM_THREADS; t++)
+		{
+			OOOStats *stats = &OOO_CORES[i][t].stats;
+			printf("%d\t%d\t%u\t%u\t\t%u\t%0.2f\t%u\t\t%u\n", i, t, stats->loads, stats->forwarded, stats->partial,
+				stats->loads ? 100.0 * (stats->forwarded + stats->partial) / stats->loads : 0.0,
+				stats->address_waits, stats->replays);
 		}
 	}
-	return 0;
+	printf("-------------------------------------\n");
 }
 
-//returns 1 for load 2 for store 3 if accessing HI or LO registers and 0 if niether
-int load_store(uint32_t opcode, uint32_t regreg) {
-	switch(opcode) {
-		case 0b100011:
-		case 0b100000:
-		case 0b100001:
-		case 0b001111:
-			return 1;
-		case 0b101011:
-		case 0b101000: //store byte
-		case 0b101001:
-			return 2;
-		case 0b000000: {
-			switch(regreg) {
-				case 0b010000:
-				case 0b010001:
-				case 0b010010:
-				case 0b010011:
-					return 3;
-				default:
-					return 0;
-			}
-		}
-		default:
-			return 0;
+/************************************************************/
+/* Memory traces: recording                                          */
+/************************************************************/
+int trace_open(char *filename)
+{
+	size_t length = strlen(filename);
+	TRACE_DIN = length > 4 && strcmp(filename + length - 4, ".din") == 0;
+	TRACE_OUT = fopen(filename, TRACE_DIN ? "w" : "wb");
+	if(TRACE_OUT == NULL)
+	{
+		printf("Error: Can't open trace file %s\n", filename);
+		return 0;
+	}
+	if(!TRACE_DIN)
+	{
+		uint32_t version = TRACE_VERSION;
+		fwrite(TRACE_MAGIC, 1, 4, TRACE_OUT);
+		fwrite(&version, sizeof(version), 1, TRACE_OUT);
 	}
+	return 1;
 }
 
-//brnach and jump instrucions function
-int branch_jump(uint32_t opcode)
+void trace_close()
 {
-	printf("%d\n", opcode);
-	switch(opcode) {
-		case 0b000100: {//BEQ
-			if(EX_MEM.A == EX_MEM.B) //branch is taken
-			{
-				/*if(EX_MEM.imm >> 15) //negative immediate so sign extend
-				{
-					   EX_MEM.imm = 0xFFFF0000 | EX_MEM.imm;
-				}*/
-				
-				int32_t offset = EX_MEM.imm << 2;
-				EX_MEM.ALUOutput = EX_MEM.PC + offset; //finding outcome of branch
-				FLUSH_FLAG = 1; //flush flag enabled
-			}
-			// else
-				//no branch
-			break;
-		}
-		case 0b000101: {//BNE
-			if(EX_MEM.A != EX_MEM.B) //branch is taken
-			{
-				/*if(EX_MEM.imm >> 15) //negative immediate so sign extend
-				{
-					   EX_MEM.imm = 0xFFFF0000 | EX_MEM.imm;
-				}*/
+	if(TRACE_OUT != NULL)
+		fclose(TRACE_OUT);
+	TRACE_OUT = NULL;
+}
 
-				int32_t offset = EX_MEM.imm << 2;
-				EX_MEM.ALUOutput = EX_MEM.PC + offset; //finding outcome of branch
-				FLUSH_FLAG = 1; //flush flag enabled
-			}
-			// else
-				//no branch
-			break;
-		}
-		case 0b000110: {//BLEZ
-			if(EX_MEM.A >> 31 || EX_MEM.A==0) //branch is taken
-			{
-				/*if(EX_MEM.imm >> 15) //negative immediate so sign extend
-				{
-					   EX_MEM.imm = 0xFFFF0000 | EX_MEM.imm;
-				}*/
-				
-				int32_t offset = EX_MEM.imm << 2;
-				EX_MEM.ALUOutput = EX_MEM.PC + offset; //finding outcome of branch
-				FLUSH_FLAG = 1; //flush flag enabled
-			}
-			// else
-				//no branch
-			break;
-		}
-		case 0b000111: {//BGTZ
-			if(!(EX_MEM.A >> 31)) //branch is taken
-			{
-				/*if(EX_MEM.imm >> 15) //negative immediate so sign extend
-				{
-					   EX_MEM.imm = 0xFFFF0000 | EX_MEM.imm;
-				}*/
-				
-				int32_t offset = EX_MEM.imm << 2;
-				EX_MEM.ALUOutput = EX_MEM.PC + offset; //finding outcome of branch
-				FLUSH_FLAG = 1; //flush flag enabled
-			}
-			//else
-				//no branch
-			break;
-		}
-		case 0b000001: { //special branch instructions
-		
-			if(EX_MEM.REG_RT_VALUE == 00001) //BGEZ
+void trace_record(uint32_t type, uint32_t pc, uint32_t addr, uint32_t size)
+{
+	if(TRACE_DIN)
+	{
+		fprintf(TRACE_OUT, "%u %x %u\n", type, addr, size);
+		return;
+	}
+	TraceRecord record = { pc, addr, type, size, 0 };
+	fwrite(&record, sizeof(record), 1, TRACE_OUT);
+}
+
+/************************************************************/
+/* Memory traces: replay through the cache alone, no decode or      */
+/* pipeline. Reads binary traces written by trace_record, anything  */
+/* else is taken as Dinero din text ("label address [size]").       */
+/* L1Cache is the data cache, so fetches are counted but not looked */
+/* up, the same as in the pipeline.                                 */
+/************************************************************/
+void trace_replay(char *filename)
+{
+	FILE * fp;
+	char magic[4];
+	uint32_t version;
+	uint64_t count[TRACE_FLUSH + 1] = { 0 };
+	uint64_t hits[TRACE_FLUSH + 1] = { 0 };
+	uint64_t records = 0;
+	int din;
+
+	fp = fopen(filename, "rb");
+	if(fp == NULL)
+	{
+		printf("Error: Can't open trace file %s\n", filename);
+		return;
+	}
+	din = fread(magic, 1, 4, fp) != 4 || memcmp(magic, TRACE_MAGIC, 4) != 0;
+	if(din)
+		rewind(fp);
+	else if(fread(&version, sizeof(version), 1, fp) != 1 || version != TRACE_VERSION)
+	{
+		printf("Error: Unsupported trace version in %s\n", filename);
+		fclose(fp);
+		return;
+	}
+
+	double start = host_time();
+	if(din)
+	{
+		char line[128];
+		uint32_t type, addr;
+		while(fgets(line, sizeof(line), fp) != NULL)
+		{
+			if(sscanf(line, "%u %x", &type, &addr) != 2 || type > TRACE_FLUSH)
+				continue;
+			records++;
+			count[type]++;
+			if(type == TRACE_FLUSH)
 			{
-				//printf("Called BGEZ\n");
-				if(!(EX_MEM.A >> 15) || EX_MEM.A == 0) //taking branch
-				{
-					/*if(EX_MEM.imm >> 15) //negative immediate so sign extend
-					{
-					   EX_MEM.imm = 0xFFFF0000 | EX_MEM.imm;
-					}*/
-				
-					int32_t offset = EX_MEM.imm << 2;
-					EX_MEM.ALUOutput = EX_MEM.PC + offset; //finding outcome of branch
-					FLUSH_FLAG = 1; //flush flag enabled
-				}
-				// else
-					//no branch
-				//break; 
+				int level;
+				for(level = 0; level < MAX_CACHE_LEVELS; level++)
+					cache_flush(cache_level(level));
 			}
-			if(EX_MEM.REG_RT_VALUE == 00000) //BLTZ
+			else if(type == TRACE_READ || type == TRACE_WRITE)
 			{
-				if((EX_MEM.A >> 15)) //taking branch
-				{
-					/*if(EX_MEM.imm >> 15) //negative immediate so sign extend
-					{
-					   EX_MEM.imm = 0xFFFF0000 | EX_MEM.imm;
-					}*/
-					
-					int32_t offset = EX_MEM.imm << 2;
-					EX_MEM.ALUOutput = EX_MEM.PC + offset; //finding outcome of branch
-					FLUSH_FLAG = 1; //flush flag enabled
-				}
-				//else
-					//no branch
-				//break; 
+				CYCLE_COUNT++; //one access per cycle paces the prefetch port
+				if(CACHE_MODEL != CACHE_MODEL_NONE)
+					hits[type] += cache_access(addr) == 0;
+				profile_access(addr);
 			}
-			break;
-		}
-		case 0b000010: { //J
-			FLUSH_FLAG = 1;
-			EX_MEM.ALUOutput = ((EX_MEM.IR) & 0x03FFFFFF)<<2;
-			break;
-		}
-		case 0b000011: { //JAL
-			FLUSH_FLAG = 1;
-			//printf("EX_MEM IR = %X\n EX_MEM.imm = %X\n", ((EX_MEM.IR) & 0x03FFFFFF<< 2), EX_MEM.imm << 2);
-			EX_MEM.ALUOutput = (((EX_MEM.IR) & 0x03FFFFFF) << 2);
-			break;
 		}
-		case 0b000000: { 
-			switch(EX_MEM.IR & 0x3F) {
-				case 0b001000: { //JR
-					FLUSH_FLAG = 1;
-					EX_MEM.ALUOutput = ID_EX.A;
-					//NEXT_STATE.PC = EX_MEM.A;
-					break;
-				}
-				case 0b001001: { //JALR
-					FLUSH_FLAG = 1;
-					EX_MEM.ALUOutput = NEXT_STATE.REGS[EX_MEM.REG_RS_VALUE];
-					EX_MEM.ALUOutput = ID_EX.A;
-					EX_MEM.LMD = CURRENT_STATE.PC + 4;
-					printf("Forwarding Type: %d\n", EX_MEM.Forwarding_Type);
-					printf("EX_MEM.A: 0x%x\n", EX_MEM.A);
-					printf("EX_MEM.B: 0x%x\n", EX_MEM.B);
-					printf("EX_MEM.REG_RT_VALUE: 0x%x\n", EX_MEM.REG_RT_VALUE);
-					printf("EX_MEM.REG_RS_VALUE: 0x%x\n", EX_MEM.REG_RS_VALUE);
-					printf("EX_MEM.REG_RD_VALUE: 0x%x\n", EX_MEM.REG_RD_VALUE);
-					printf("EX_MEM.CorrectValue: 0x%x\n", NEXT_STATE.REGS[EX_MEM.REG_RS_VALUE]);
-					printf("EX_MEM.ALUOutput: 0x%x\n", EX_MEM.ALUOutput);
-					//printf("EX_MEM IR = %X\n EX_MEM.imm = %X\n", ((EX_MEM.IR) & 0x03FFFFFF<< 2), EX_MEM.imm << 2);
-					break;
+	}
+	else
+	{
+		TraceRecord buffer[TRACE_BUFFER];
+		size_t n, i;
+		while((n = fread(buffer, sizeof(TraceRecord), TRACE_BUFFER, fp)) > 0)
+		{
+			records += n;
+			for(i = 0; i < n; i++)
+			{
+				uint32_t type = buffer[i].type;
+				if(type > TRACE_FLUSH)
+					continue;
+				count[type]++;
+				if(type == TRACE_FETCH)
+				{
+					profile_fetch(buffer[i].addr);
+					continue;
 				}
+				ACCESS_PC = buffer[i].pc;
+				CYCLE_COUNT++;
+				if(CACHE_MODEL != CACHE_MODEL_NONE)
+					hits[type] += cache_access(buffer[i].addr) == 0;
+				profile_access(buffer[i].addr);
 			}
 		}
 	}
-	//printf("Test\n");
-	return 0;
-}
+	HOST_SECONDS = host_time() - start;
+	fclose(fp);
 
-int reg_imm(uint32_t opcode) {
-	switch(opcode) {
-		case 0b001000:
-		case 0b001001:
-		case 0b001100:
-		case 0b001101:
-		case 0b001110:
-		case 0b001010:
-			return 1;
-		default:
-			return 0;
+	uint64_t accesses = count[TRACE_READ] + count[TRACE_WRITE];
+	uint64_t hit = hits[TRACE_READ] + hits[TRACE_WRITE];
+	printf("-------------------------------------\n");
+	printf("Trace Replay (%s)\n", din ? "din" : "binary");
+	printf("-------------------------------------\n");
+	printf("Records: %lu\n", (unsigned long) records);
+	printf("Fetches: %lu\n", (unsigned long) count[TRACE_FETCH]);
+	printf("Reads: %lu\t(hits %lu)\n", (unsigned long) count[TRACE_READ], (unsigned long) hits[TRACE_READ]);
+	printf("Writes: %lu\t(hits %lu)\n", (unsigned long) count[TRACE_WRITE], (unsigned long) hits[TRACE_WRITE]);
+	if(din)
+		printf("Flushes: %lu\n", (unsigned long) count[TRACE_FLUSH]);
+	printf("Number of Cache hits: %lu\n", (unsigned long) hit);
+	printf("Number of Cache misses: %lu\n", (unsigned long) (accesses - hit));
+	printf("Cache miss rate: %0.2f\n", accesses ? 100.0 * (accesses - hit) / accesses : 0.0);
+	printf("Host time: %0.9f s\tRecords/s: %0.0f\n", HOST_SECONDS, HOST_SECONDS > 0 ? records / HOST_SECONDS : 0.0);
+	printf("-------------------------------------\n");
+	if(DRAM_ENABLED)
+		dram_print();
+	if(THREEC_ENABLED)
+	{
+		int level;
+		for(level = 0; level < MAX_CACHE_LEVELS; level++)
+		{
+			if(cache_level(level)->sets == 0)
+				continue;
+			printf("%s misses: %u\n", cache_level(level)->name, cache_level(level)->misses);
+			threec_print(level);
+		}
+		printf("-------------------------------------\n");
 	}
+	if(VICTIM_BLOCKS > 0)
+		victim_print();
+	if(PREFETCHER != PREFETCH_NONE)
+		prefetch_print();
+	if(STACK_DIST.enabled)
+		stackdist_print();
+	if(REUSE_ENABLED)
+		reuse_print();
+	if(BATCH.enabled)
+		batch_print();
 }
 
-int reg_jump(uint32_t opcode, uint32_t instruction) {
-	switch(opcode) {
-		case 0b000100:
-		case 0b000101:
-		case 0b000110:
-		case 0b000111:
-		case 0b000001:
-		case 0b000010:
-		case 0b000011:
-			return 1;
-		case 0b000000:
-			switch(instruction) {
-				case(0b001000):
-				case(0b001001):
-					return 2;
-			    default:
-					return 0;
-			}
-		default:
-			return 0;
-	}
+//every instruction fetch, for the reuse profiler
+void profile_fetch(uint32_t pc)
+{
+	if(REUSE_ENABLED)
+		reuse_access(&REUSE_FETCH, pc / L1Cache.block_bytes);
 }
 
-int reg_reg(uint32_t opcode, uint32_t instruction) {
-	if(opcode == 0b000000) {
-		switch(instruction) {
-			case 0b100000:
-			case 0b100001:
-			case 0b100010:
-			case 0b100011:
-			case 0b011000:
-			case 0b011001:
-			case 0b011010:
-			case 0b011011:
-			case 0b100100:
-			case 0b100101:
-			case 0b100110:
-			case 0b100111:
-			case 0b101010:
-			case 0b000000:
-			case 0b000010:
-			case 0b000011:
-				return 1;
-			default:
-				return 0;
-		}
-	}
-	return 0;
+//every data access made by the program, for the profilers that watch the
+//stream whatever cache is modelled
+void profile_access(uint32_t addr)
+{
+	if(REUSE_ENABLED)
+		reuse_access(&REUSE_DATA, addr / L1Cache.block_bytes);
+	if(STACK_DIST.enabled)
+		stackdist_access(addr);
+	if(BATCH.enabled)
+		batch_access(addr);
 }
 
-//This is where the instruction is actually determined by the bit fields
 /************************************************************/
-/* instruction decode (ID) pipeline stage:                                                         */ 
+/* Stack distance profile: the LRU stack distance of an access is   */
+/* the number of distinct blocks touched since the last access to   */
+/* its block (in the same set). A cache with A ways hits exactly    */
+/* the accesses with distance < A, so one histogram per set count   */
+/* gives the miss ratio of every associativity.                     */
 /************************************************************/
-void ID()
-{		
-	if(STALL_COUNT > 0)
+void stackdist_reset()
+{
+	int k;
+	reuse_reset(&STACK_DIST.full, 0);
+	for(k = 0; k <= SD_MAX_SET_BITS; k++)
+		free(STACK_DIST.stacks[k]);
+	memset(&STACK_DIST, 0, sizeof(STACK_DIST));
+}
+
+//distance histogram bucket: 0 for distance 0, b for distances in [2^(b-1), 2^b)
+int stackdist_bucket(uint32_t distance)
+{
+	int bucket = 0;
+	while(distance > 0)
 	{
-		//ID stage stalled for jump/branch outcome to be found first
-		ID_EX.stage_stalled = 1;
-		IF_ID.IR = ID_EX.IR;
-		printf("ID stalling\n");
-		return;
+		distance >>= 1;
+		bucket++;
 	}
-	if(STALL_COUNT == 0)
+	return bucket;
+}
+
+void reuse_reset(ReuseProfile *profile, uint32_t window)
+{
+	free(profile->tree);
+	free(profile->hash_block);
+	free(profile->hash_time);
+	free(profile->windows);
+	memset(profile, 0, sizeof(ReuseProfile));
+	profile->window = window;
+}
+
+void reuse_tree_add(ReuseProfile *profile, uint32_t time, int delta)
+{
+	for(; time < profile->tree_size; time += time & -time)
+		profile->tree[time] += delta;
+}
+
+uint32_t reuse_tree_sum(ReuseProfile *profile, uint32_t time)
+{
+	uint32_t sum = 0;
+	for(; time > 0; time -= time & -time)
+		sum += profile->tree[time];
+	return sum;
+}
+
+//slot of block in the hash, or the empty slot where it goes
+uint32_t reuse_slot(ReuseProfile *profile, uint32_t block)
+{
+	uint32_t slot = (block * 2654435761u) & (profile->hash_size - 1);
+	while(profile->hash_block[slot] != 0 && profile->hash_block[slot] != block + 1)
+		slot = (slot + 1) & (profile->hash_size - 1);
+	return slot;
+}
+
+//double the hash and the time range of the tree, then re-mark every block's latest access
+void reuse_grow(ReuseProfile *profile)
+{
+	uint32_t *old_block = profile->hash_block;
+	uint32_t *old_time = profile->hash_time;
+	uint32_t old_size = profile->hash_size;
+	uint32_t i;
+
+	if(profile->hash_used * 2 >= profile->hash_size)
 	{
-		ID_EX.PC = IF_ID.PC;
-		ID_EX.IR = IF_ID.IR; //transfering instruction
-		ID_EX.imm = IF_ID.IR & 0x00008000 ? IF_ID.IR | 0xFFFF0000 : IF_ID.IR & 0x0000FFFF; //immediate
-		ID_EX.A = CURRENT_STATE.REGS[(IF_ID.IR>>21) & 0x1F]; //rs reg
-		ID_EX.B = CURRENT_STATE.REGS[(IF_ID.IR>>16) & 0x1F]; //rt reg
-		ID_EX.PC = IF_ID.PC; //pc transfer
-		ID_EX.REG_RS_VALUE = (IF_ID.IR>>21) & 0x1F;
-		ID_EX.REG_RT_VALUE = (IF_ID.IR>>16) & 0x1F;
-		ID_EX.REG_RD_VALUE = (IF_ID.IR>>11) & 0x1F;
-		ID_EX.sham_t = (IF_ID.IR>>6) & 0x1F;
-		ID_EX.stage_stalled = 0;
-		ID_EX.Forwarding_Type = 0;
-		if(STALL_COUNT==0)
-		{
-			dataHazardDetection();
-			
-			uint8_t opcode = (IF_ID.IR & 0xFC000000) >> 26;
-			
-			if(opcode == 0)
+		profile->hash_size = old_size ? old_size * 2 : 1024;
+		profile->hash_block = calloc(profile->hash_size, sizeof(uint32_t));
+		profile->hash_time = calloc(profile->hash_size, sizeof(uint32_t));
+		for(i = 0; i < old_size; i++)
+		{
+			if(old_block[i] != 0)
 			{
-				opcode = IF_ID.IR & 0x0000003F; //funct field
-				
-				switch(opcode)	
-				{
-					case 0b001000: { //jr
-						ID_EX.A = NEXT_STATE.REGS[(IF_ID.IR & 0x03E00000) >> 21];
-						
-						IF_ID.stage_stalled = 1;
-						break;
-					}
-					case 0b001001: { //jalr
-						ID_EX.A = NEXT_STATE.REGS[(IF_ID.IR & 0x03E00000) >> 21];
-						//ID_EX.REG_RD_VALUE = rd
-						IF_ID.stage_stalled = 1;
-					}
-				}
+				uint32_t slot = reuse_slot(profile, old_block[i] - 1);
+				profile->hash_block[slot] = old_block[i];
+				profile->hash_time[slot] = old_time[i];
 			}
 		}
-		if(STALL_COUNT > 0)
+		free(old_block);
+		free(old_time);
+	}
+	if(profile->accesses + 1 >= profile->tree_size)
+	{
+		profile->tree_size = profile->tree_size ? profile->tree_size * 2 : 4096;
+		free(profile->tree);
+		profile->tree = calloc(profile->tree_size, sizeof(uint32_t));
+		for(i = 0; i < profile->hash_size; i++)
 		{
-			ID_EX.stage_stalled = 1;
-			ID_EX.IR = 0xFFFFFFFF;
-			ID_EX.REG_RD_VALUE = -1;
-			ID_EX.REG_RT_VALUE = -1;
-			ID_EX.REG_RS_VALUE = -1;
-			printf("Stall at ID stage at %x\n", CURRENT_STATE.PC);
-			return;
+			if(profile->hash_block[i] != 0)
+				reuse_tree_add(profile, profile->hash_time[i], 1);
 		}
-		if(STALL_COUNT != 0)
+	}
+}
+
+//reuse distance of an access to block, REUSE_FIRST on its first touch
+uint32_t reuse_access(ReuseProfile *profile, uint32_t block)
+{
+	uint32_t time, slot, last = 0, distance = REUSE_FIRST;
+
+	if(profile->hash_used * 2 >= profile->hash_size || profile->accesses + 1 >= profile->tree_size)
+		reuse_grow(profile);
+	time = ++profile->accesses;
+
+	slot = reuse_slot(profile, block);
+	if(profile->hash_block[slot] == 0)
+	{
+		profile->hash_block[slot] = block + 1;
+		profile->hash_used++;
+		profile->histogram[SD_BUCKETS - 1]++;
+	}
+	else
+	{
+		last = profile->hash_time[slot];
+		distance = reuse_tree_sum(profile, time - 1) - reuse_tree_sum(profile, last);
+		profile->histogram[stackdist_bucket(distance)]++;
+		reuse_tree_add(profile, last, -1);
+	}
+	profile->hash_time[slot] = time;
+	reuse_tree_add(profile, time, 1);
+
+	if(profile->window > 0)
+	{
+		if(distance == REUSE_FIRST || last <= profile->window_start)
+			profile->window_blocks++;
+		if(time - profile->window_start == profile->window)
 		{
-			printf("data hazard in ID, so stalled\n");
-			ID_EX.stage_stalled = 1;
+			if(profile->window_count == profile->window_capacity)
+			{
+				profile->window_capacity = profile->window_capacity ? profile->window_capacity * 2 : 64;
+				profile->windows = realloc(profile->windows, profile->window_capacity * sizeof(uint32_t));
+			}
+			profile->windows[profile->window_count++] = profile->window_blocks;
+			profile->window_blocks = 0;
+			profile->window_start = time;
 		}
 	}
+	return distance;
 }
 
-//function to detect data hazard in pipeline
-void dataHazardDetection()
+void stackdist_access(uint32_t addr)
 {
-	int enabled_forwarding = ENABLE_FORWARDING;
-	// //if accessing memory in exe to mem or mem to wb, turn off forwarding
-	// if(EX_MEM.MEM_ACCESS_FLAG == 1 || MEM_WB.MEM_ACCESS_FLAG == 1)
-	// 	enabled_forwarding = 0; //turn off enable forwarding
-	if (reg_jump(ID_EX.IR>>26, ID_EX.IR & 0x0000003F)==2){
-		return;
-	} 
-	else if(reg_imm(EX_MEM.IR>>26) && (EX_MEM.REG_RT_VALUE == ID_EX.REG_RS_VALUE) && (MEM_WB.REG_RD_VALUE != 0) && (MEM_WB.REG_RD_VALUE == ID_EX.REG_RT_VALUE))
+	uint32_t block = addr / L1Cache.block_bytes;
+	int k, way;
+
+	//fully associative
+	reuse_access(&STACK_DIST.full, block);
+
+	//set-associative, one move-to-front stack per set
+	for(k = 0; k <= SD_MAX_SET_BITS; k++)
 	{
-		if(enabled_forwarding == 1)
-			ID_EX.Forwarding_Type = 11;
+		uint32_t *stack;
+		if(STACK_DIST.stacks[k] == NULL)
+			STACK_DIST.stacks[k] = calloc((size_t) SD_WAYS << k, sizeof(uint32_t));
+		stack = STACK_DIST.stacks[k] + (block & ((1u << k) - 1)) * SD_WAYS;
+		for(way = 0; way < SD_WAYS - 1 && stack[way] != block + 1 && stack[way] != 0; way++)
+			;
+		if(stack[way] == block + 1)
+			STACK_DIST.sets[k][stackdist_bucket(way)]++;
 		else
-			STALL_COUNT = 2;
+			STACK_DIST.sets[k][SD_MAX_WAY_BITS + 1]++;
+		memmove(stack + 1, stack, way * sizeof(uint32_t));
+		stack[0] = block + 1;
 	}
-	else if(reg_imm(EX_MEM.IR>>26) && (EX_MEM.REG_RT_VALUE == ID_EX.REG_RS_VALUE))
+}
+
+//smallest fully associative LRU cache, in blocks, holding the given share of a stream's reuses
+uint32_t reuse_needed(ReuseProfile *profile, double share)
+{
+	uint64_t reuses = profile->accesses - profile->histogram[SD_BUCKETS - 1];
+	uint64_t hits = 0;
+	int b;
+	for(b = 0; b < SD_BUCKETS - 1; b++)
 	{
-		if(enabled_forwarding == 1)
-			ID_EX.Forwarding_Type = 5;
-		else
-			STALL_COUNT = 2;
+		hits += profile->histogram[b];
+		if(hits >= share * reuses)
+			break;
 	}
-	else if(reg_imm(EX_MEM.IR>>26) && (EX_MEM.REG_RT_VALUE == ID_EX.REG_RT_VALUE) && ((MEM_WB.REG_RD_VALUE != 0)) && (MEM_WB.REG_RD_VALUE == ID_EX.REG_RS_VALUE))
+	return 1u << b;
+}
+
+//working set of one stream: min/avg/max over the windows, then up to 32
+//points of the series (the largest window of each group)
+void reuse_windows(const char *name, ReuseProfile *profile)
+{
+	uint32_t i, min = 0xFFFFFFFF, max = 0, group;
+	uint64_t sum = 0;
+	if(profile->window_count == 0)
 	{
-		if(enabled_forwarding == 1)
-			ID_EX.Forwarding_Type = 13;
-		else
-			STALL_COUNT = 2;
+		printf("%s: fewer than %u accesses\n", name, profile->window);
+		return;
 	}
-	else if(load_store(ID_EX.IR>>26, ID_EX.IR & 0x0000003F) && (ID_EX.REG_RT_VALUE == EX_MEM.REG_RT_VALUE) && (ID_EX.REG_RS_VALUE == MEM_WB.REG_RT_VALUE)) {
-		if(enabled_forwarding == 1)
-			ID_EX.Forwarding_Type = 14;
-		else
-			STALL_COUNT = 2;
+	for(i = 0; i < profile->window_count; i++)
+	{
+		sum += profile->windows[i];
+		if(profile->windows[i] < min)
+			min = profile->windows[i];
+		if(profile->windows[i] > max)
+			max = profile->windows[i];
 	}
-	else if(reg_imm(EX_MEM.IR>>26) && (EX_MEM.REG_RT_VALUE == ID_EX.REG_RT_VALUE))
+	printf("%s: min %u\tavg %0.1f\tmax %u blocks (%u bytes) over %u windows\n", name, min,
+		(double) sum / profile->window_count, max, max * L1Cache.block_bytes, profile->window_count);
+	group = (profile->window_count + 31) / 32;
+	printf("%s series:", name);
+	for(i = 0; i < profile->window_count; i += group)
 	{
-		if(enabled_forwarding == 1)
-			ID_EX.Forwarding_Type = 6;
-		else
-			STALL_COUNT = 2;
+		uint32_t k, peak = 0;
+		for(k = i; k < i + group && k < profile->window_count; k++)
+			peak = profile->windows[k] > peak ? profile->windows[k] : peak;
+		printf(" %u", peak);
 	}
-	else if(load_store(EX_MEM.IR>>26, EX_MEM.IR & 0x0000003F) && (EX_MEM.REG_RT_VALUE == ID_EX.REG_RS_VALUE))
+	printf("\n");
+}
+
+void reuse_print()
+{
+	int b, last = 0;
+	uint64_t data_reuses = REUSE_DATA.accesses - REUSE_DATA.histogram[SD_BUCKETS - 1];
+	uint64_t fetch_reuses = REUSE_FETCH.accesses - REUSE_FETCH.histogram[SD_BUCKETS - 1];
+	uint64_t data_sum = 0, fetch_sum = 0;
+
+	printf("-------------------------------------\n");
+	printf("Reuse Distances (%u-byte blocks, %lu data accesses, %lu fetches)\n", L1Cache.block_bytes,
+		(unsigned long) REUSE_DATA.accesses, (unsigned long) REUSE_FETCH.accesses);
+	printf("-------------------------------------\n");
+	if(REUSE_DATA.accesses + REUSE_FETCH.accesses == 0)
 	{
-		if(enabled_forwarding == 1)
-			ID_EX.Forwarding_Type = 7;
-		else
-			STALL_COUNT = 2;
+		printf("No accesses profiled, turn on with \"set reuse 1\"\n");
+		return;
 	}
-	else if(load_store(EX_MEM.IR>>26, EX_MEM.IR & 0x0000003F) && (EX_MEM.REG_RT_VALUE == ID_EX.REG_RT_VALUE) && load_store(MEM_WB.IR>>26, MEM_WB.IR & 0x0000003F) && (MEM_WB.REG_RT_VALUE == ID_EX.REG_RS_VALUE))
+	for(b = 0; b < SD_BUCKETS - 1; b++)
 	{
-		if(enabled_forwarding == 1)
-			ID_EX.Forwarding_Type = 12;
-		else
-			STALL_COUNT = 2;
+		if(REUSE_DATA.histogram[b] || REUSE_FETCH.histogram[b])
+			last = b;
 	}
-	else if(load_store(EX_MEM.IR>>26, EX_MEM.IR & 0x0000003F) && (EX_MEM.REG_RT_VALUE == ID_EX.REG_RT_VALUE))
+	printf("Distance\tData\tcum %%\tFetch\tcum %%\n");
+	for(b = 0; b <= last; b++)
 	{
-		if(enabled_forwarding == 1)
-			ID_EX.Forwarding_Type = 8;
+		data_sum += REUSE_DATA.histogram[b];
+		fetch_sum += REUSE_FETCH.histogram[b];
+		if(b < 2)
+			printf("%d\t", b);
 		else
-			STALL_COUNT = 2;
+			printf("%u-%u\t", 1u << (b - 1), (1u << b) - 1);
+		printf("\t%lu\t%0.2f\t%lu\t%0.2f\n", (unsigned long) REUSE_DATA.histogram[b], data_reuses ? 100.0 * data_sum / data_reuses : 0.0,
+			(unsigned long) REUSE_FETCH.histogram[b], fetch_reuses ? 100.0 * fetch_sum / fetch_reuses : 0.0);
 	}
-	else if(load_store(MEM_WB.IR>>26, MEM_WB.IR & 0x0000003F) == 3 && MEM_WB.REG_RD_VALUE != 0 && MEM_WB.REG_RD_VALUE == ID_EX.REG_RS_VALUE) {
-		if(enabled_forwarding == 1)
-		{
-			ID_EX.Forwarding_Type = 10;
-		}
+	printf("first touch\t%lu\t\t%lu\n", (unsigned long) REUSE_DATA.histogram[SD_BUCKETS - 1], (unsigned long) REUSE_FETCH.histogram[SD_BUCKETS - 1]);
+	printf("-------------------------------------\n");
+	printf("Fully associative LRU cache holding 50/90/99%% of reuses:\n");
+	printf("Data: %u / %u / %u bytes\n", reuse_needed(&REUSE_DATA, 0.5) * L1Cache.block_bytes,
+		reuse_needed(&REUSE_DATA, 0.9) * L1Cache.block_bytes, reuse_needed(&REUSE_DATA, 0.99) * L1Cache.block_bytes);
+	printf("Fetch: %u / %u / %u bytes\n", reuse_needed(&REUSE_FETCH, 0.5) * L1Cache.block_bytes,
+		reuse_needed(&REUSE_FETCH, 0.9) * L1Cache.block_bytes, reuse_needed(&REUSE_FETCH, 0.99) * L1Cache.block_bytes);
+	printf("-------------------------------------\n");
+	printf("Working set (distinct blocks per %u accesses)\n", REUSE_DATA.window);
+	reuse_windows("Data", &REUSE_DATA);
+	reuse_windows("Fetch", &REUSE_FETCH);
+	printf("-------------------------------------\n");
+}
+
+//miss ratio curves: one row per cache size, one column per associativity
+void stackdist_print()
+{
+	int size_bits, way_bits, b;
+	uint64_t accesses = STACK_DIST.full.accesses;
+
+	printf("-------------------------------------\n");
+	printf("Miss-Ratio Curves (%u-byte blocks, LRU, %lu accesses)\n", L1Cache.block_bytes, (unsigned long) accesses);
+	printf("-------------------------------------\n");
+	if(accesses == 0)
+	{
+		printf("No accesses profiled, turn on with \"set stackdist 1\"\n");
+		return;
 	}
-	else if(((EX_MEM.REG_RD_VALUE != 0)) && (EX_MEM.REG_RD_VALUE == ID_EX.REG_RS_VALUE) && (reg_imm(MEM_WB.IR>>26) && (MEM_WB.REG_RT_VALUE == ID_EX.REG_RT_VALUE)))
+	printf("Size\t");
+	for(way_bits = 0; way_bits <= SD_MAX_WAY_BITS; way_bits++)
+		printf("%d-way\t", 1 << way_bits);
+	printf("full\n");
+	for(size_bits = 0; size_bits <= SD_MAX_SET_BITS + SD_MAX_WAY_BITS; size_bits++)
 	{
-		if(enabled_forwarding == 1)
+		uint32_t bytes = L1Cache.block_bytes << size_bits;
+		uint64_t hits = 0;
+		if(bytes >= 1024)
+			printf("%uK\t", bytes / 1024);
+		else
+			printf("%u\t", bytes);
+		for(way_bits = 0; way_bits <= SD_MAX_WAY_BITS; way_bits++)
 		{
-			ID_EX.Forwarding_Type = 9;
+			int set_bits = size_bits - way_bits;
+			if(set_bits < 0 || set_bits > SD_MAX_SET_BITS)
+			{
+				printf("-\t");
+				continue;
+			}
+			hits = 0;
+			for(b = 0; b <= way_bits; b++)
+				hits += STACK_DIST.sets[set_bits][b];
+			printf("%0.4f\t", 1.0 - (double) hits / accesses);
 		}
-		else
-			STALL_COUNT = 2;
+		hits = 0;
+		for(b = 0; b <= size_bits; b++)
+			hits += STACK_DIST.full.histogram[b];
+		printf("%0.4f\n", 1.0 - (double) hits / accesses);
 	}
-	else if(((EX_MEM.REG_RD_VALUE != 0)) && (EX_MEM.REG_RD_VALUE == ID_EX.REG_RS_VALUE))
+	printf("-------------------------------------\n");
+}
+
+/************************************************************/
+/* Batched caches: lane l is a direct-mapped cache of 2^(l + 2)     */
+/* sets of L1Cache's block size, so with the default 16-byte blocks */
+/* one run sweeps 64 B to 8 KB and lane 2 is the default L1Cache.   */
+/* cache_init resets them, so they follow an l1= change.            */
+/************************************************************/
+void batch_reset()
+{
+	int lane, enabled = BATCH.enabled;
+	memset(&BATCH, 0, sizeof(BATCH));
+	BATCH.enabled = enabled;
+	for(lane = 0; lane < BATCH_LANES; lane++)
 	{
-		if(enabled_forwarding == 1)
-		{
-			ID_EX.Forwarding_Type = 1;
-		}
-		else
-			STALL_COUNT = 2;
+		BATCH.offset_bits[lane] = __builtin_ctz(L1Cache.block_bytes);
+		BATCH.index_bits[lane] = lane + 2;
 	}
-	else if(((EX_MEM.REG_RD_VALUE != 0)) && (EX_MEM.REG_RD_VALUE == ID_EX.REG_RT_VALUE))
+}
+
+void batch_access(uint32_t addr)
+{
+	int lane;
+	BATCH.accesses++;
+#ifdef __AVX2__
+	uint32_t index[BATCH_LANES], tag[BATCH_LANES];
+	__m256i offset_bits = _mm256_loadu_si256((__m256i *) BATCH.offset_bits);
+	__m256i index_bits = _mm256_loadu_si256((__m256i *) BATCH.index_bits);
+	__m256i one = _mm256_set1_epi32(1);
+	__m256i block = _mm256_srlv_epi32(_mm256_set1_epi32(addr), offset_bits);
+	__m256i index_v = _mm256_and_si256(block, _mm256_sub_epi32(_mm256_sllv_epi32(one, index_bits), one));
+	__m256i tag_v = _mm256_add_epi32(_mm256_srlv_epi32(block, index_bits), one);
+	_mm256_storeu_si256((__m256i *) index, index_v);
+	__m256i stored = _mm256_setr_epi32(BATCH.tags[0][index[0]], BATCH.tags[1][index[1]], BATCH.tags[2][index[2]], BATCH.tags[3][index[3]],
+		BATCH.tags[4][index[4]], BATCH.tags[5][index[5]], BATCH.tags[6][index[6]], BATCH.tags[7][index[7]]);
+	__m256i hit = _mm256_cmpeq_epi32(stored, tag_v);
+	__m256i hits = _mm256_loadu_si256((__m256i *) BATCH.hits);
+	_mm256_storeu_si256((__m256i *) BATCH.hits, _mm256_sub_epi32(hits, hit)); //hit lanes are all ones, -1
+	if(_mm256_movemask_ps(_mm256_castsi256_ps(hit)) == 0xFF)
+		return;
+	//no scatter in AVX2: write every lane's tag back, a no-op where it hit,
+	//which keeps the per-lane miss pattern out of the branch predictor
+	_mm256_storeu_si256((__m256i *) tag, tag_v);
+	for(lane = 0; lane < BATCH_LANES; lane++)
+		BATCH.tags[lane][index[lane]] = tag[lane];
+#elif defined(__SSE2__)
+	//no per-lane shifts before AVX2: index and tag are worked out lane by
+	//lane, the compare and hit counts go four lanes at a time
+	uint32_t index[BATCH_LANES], tag[BATCH_LANES], stored[BATCH_LANES];
+	int all_hit = 1;
+	for(lane = 0; lane < BATCH_LANES; lane++)
 	{
-		if(enabled_forwarding == 1)
-			ID_EX.Forwarding_Type = 2;
-		else
-			STALL_COUNT = 2;
+		uint32_t block = addr >> BATCH.offset_bits[lane];
+		index[lane] = block & ((1u << BATCH.index_bits[lane]) - 1);
+		tag[lane] = (block >> BATCH.index_bits[lane]) + 1;
+		stored[lane] = BATCH.tags[lane][index[lane]];
 	}
-	else if(((MEM_WB.REG_RD_VALUE != 0)) && (MEM_WB.REG_RD_VALUE == ID_EX.REG_RS_VALUE))
+	for(lane = 0; lane < BATCH_LANES; lane += 4)
 	{
-		if(enabled_forwarding == 1)
-		{
-			ID_EX.Forwarding_Type = 3;
-		}
-		else
-			STALL_COUNT = 1;
+		__m128i hit = _mm_cmpeq_epi32(_mm_loadu_si128((__m128i *) (stored + lane)), _mm_loadu_si128((__m128i *) (tag + lane)));
+		__m128i hits = _mm_loadu_si128((__m128i *) (BATCH.hits + lane));
+		_mm_storeu_si128((__m128i *) (BATCH.hits + lane), _mm_sub_epi32(hits, hit));
+		all_hit &= _mm_movemask_ps(_mm_castsi128_ps(hit)) == 0xF;
 	}
-	else if(((MEM_WB.REG_RD_VALUE != 0)) && (MEM_WB.REG_RD_VALUE == ID_EX.REG_RT_VALUE))
+	if(all_hit)
+		return;
+	for(lane = 0; lane < BATCH_LANES; lane++)
+		BATCH.tags[lane][index[lane]] = tag[lane];
+#else
+	for(lane = 0; lane < BATCH_LANES; lane++)
 	{
-		if(enabled_forwarding == 1)
-			ID_EX.Forwarding_Type = 4;
+		uint32_t block = addr >> BATCH.offset_bits[lane];
+		uint32_t index = block & ((1u << BATCH.index_bits[lane]) - 1);
+		uint32_t tag = (block >> BATCH.index_bits[lane]) + 1;
+		if(BATCH.tags[lane][index] == tag)
+			BATCH.hits[lane]++;
 		else
-			STALL_COUNT = 1;
+			BATCH.tags[lane][index] = tag;
 	}
-	
-	if(EX_MEM.JUMP_BRANCH_FLAG == 1)
-		STALL_COUNT = 1;
-		
-		
-	//for debugging
-	// printf("%d\n", reg_imm(EX_MEM.IR>>26));
-	// printf("%d|%d|%d\n", ID_EX.REG_RS_VALUE, ID_EX.REG_RT_VALUE, ID_EX.REG_RD_VALUE);
-	// printf("%d|%d|%d\n", EX_MEM.REG_RS_VALUE, EX_MEM.REG_RT_VALUE, EX_MEM.REG_RD_VALUE);			
+#endif
 }
 
-/************************************************************/
-/* instruction fetch (IF) pipeline stage:                                                              */ 
-/************************************************************/
-void IF()
+void batch_print()
 {
-	if(STALL_COUNT == 0)
+	int lane;
+	printf("-------------------------------------\n");
+	printf("Batched Caches (direct-mapped, %u accesses, %s)\n", BATCH.accesses,
+#if defined(__AVX2__)
+		"AVX2");
+#elif defined(__SSE2__)
+		"SSE2");
+#else
+		"scalar");
+#endif
+	printf("-------------------------------------\n");
+	printf("Lane\tSets\tBlock\tSize\tHits\tMisses\tMiss rate\n");
+	for(lane = 0; lane < BATCH_LANES; lane++)
 	{
-		if(IF_ID.IR == 0x0000000C)
-			return; 
-		IF_ID.IR = mem_read_32(CURRENT_STATE.PC);
-		IF_ID.PC = CURRENT_STATE.PC;
-		NEXT_STATE.PC = CURRENT_STATE.PC + sizeof(uint32_t); //incrementing program counter by four for next state
+		uint32_t sets = 1u << BATCH.index_bits[lane];
+		uint32_t block = 1u << BATCH.offset_bits[lane];
+		printf("%d\t%u\t%u\t%u\t%u\t%u\t%0.2f\n", lane, sets, block, sets * block, BATCH.hits[lane],
+			BATCH.accesses - BATCH.hits[lane], BATCH.accesses ? 100.0 * (BATCH.accesses - BATCH.hits[lane]) / BATCH.accesses : 0.0);
 	}
-	else
-		printf("Stalling at IF stage\n");
+	printf("-------------------------------------\n");
 }
 
-
 /************************************************************/
 /* Initialize Memory                                                                                                    */ 
 /************************************************************/
 void initialize() { 
-	cache_misses = 0;
-	cache_hits = 0;
+	cache_init();
 	init_memory();
 	CURRENT_STATE.PC = MEM_TEXT_BEGIN;
+	CURRENT_STATE.delay_pc = 0;
 	NEXT_STATE = CURRENT_STATE;
 	RUN_FLAG = TRUE;
+	reset_pipeline();
+	core_init();
 }
 
 /************************************************************/
@@ -1494,13 +6071,15 @@ void initialize() {
 //from lab one
 void print_program(){
 	/*IMPLEMENT THIS*/
-	uint32_t instr;
+	uint32_t instr = 0;
 	uint32_t address;
 	
 	for(int i = 0; i < PROGRAM_SIZE; i++)
 	{
 			address = MEM_TEXT_BEGIN + (i*4);
 			printf("[0x%08X]\t", address);
+			if(DELAY_SLOT && reg_jump(instr >> 26, instr & 0x3F)) //instr is still the one before
+				printf("  (delay slot) ");
 			instr = (mem_read_32(address)); //reading in address from mem
 			print_instruction(instr);
 	}
@@ -1515,6 +6094,12 @@ void show_pipeline(){
 	//ID_RF part of the lab
 	printf("Current PC: %08X\n\n", CURRENT_STATE.PC); //may need to be one the one from the pipeline regs
 	
+	//the extra front-end stages, youngest first
+	int k;
+	for(k = 0; k < front_stages(); k++)
+	{
+		printf("Front %d %08X ", k, FRONT_PIPE[k].IR); print_instruction(FRONT_PIPE[k].IR);
+	}
 	printf("IF/ID %08X ", IF_ID.IR); print_instruction(IF_ID.IR);
 	printf("IF/ID.PC %08X\n\n", IF_ID.PC);
 	
@@ -1529,12 +6114,27 @@ void show_pipeline(){
 	printf("EX/MEM.A %08X\n", EX_MEM.A);
 	printf("EX/MEM.B %08X\n", EX_MEM.B);
 	printf("EX/MEM.ALUOutput %08X\n\n", EX_MEM.ALUOutput);
+	for(k = 0; k < memory_stages(); k++)
+	{
+		printf("MEM%d.IR %08X ", k + 2, MEM_PIPE[k].IR); print_instruction(MEM_PIPE[k].IR);
+	}
 	
 	//WB
 	printf("MEM/WB.IR %08X ", MEM_WB.IR);  print_instruction(MEM_WB.IR);
 	printf("MEM/WB.ALUOutput %08X\n", MEM_WB.ALUOutput);
 	printf("MEM/WB.LMD %08X\n\n", MEM_WB.LMD);
-	
+
+	//the other slots of a superscalar pipeline, instructions only
+	int s;
+	for(s = 1; s < ISSUE_WIDTH; s++)
+	{
+		printf("Slot %d\n", s);
+		printf("IF/ID %08X ", SLOTS[s][LATCH_IF_ID].IR); print_instruction(SLOTS[s][LATCH_IF_ID].IR);
+		printf("ID/EX.IR %08X ", SLOTS[s][LATCH_ID_EX].IR); print_instruction(SLOTS[s][LATCH_ID_EX].IR);
+		printf("EX/MEM.IR %08X ", SLOTS[s][LATCH_EX_MEM].IR); print_instruction(SLOTS[s][LATCH_EX_MEM].IR);
+		printf("MEM/WB.IR %08X ", SLOTS[s][LATCH_MEM_WB].IR); print_instruction(SLOTS[s][LATCH_MEM_WB].IR);
+		printf("\n");
+	}
 }
 
 unsigned createMask(int start, int end) {
@@ -1556,7 +6156,7 @@ void print_instruction(uint32_t instr)
 	
 	if(instruction == 0)
 	{
-		printf("No instruction yet\n");
+		printf(DELAY_SLOT ? "NOP\n" : "No instruction yet\n"); //SLL $0, $0, 0 filling a delay slot
 		return;
 	}
 	
@@ -1655,6 +6255,18 @@ void print_instruction(uint32_t instr)
 			printf("$%X 0x%04X\n", rt, immediate); 
 			break;
 		}
+		case 0xC0000000: //LL Load Linked
+		{
+			printf("LL ");
+			printf("$%X, %X($%X)\n", rt, offset, base); 
+			break;
+		}
+		case 0xE0000000: //SC Store Conditional
+		{
+			printf("SC ");
+			printf("$%X %X($%X)\n", rt, offset, base); 
+			break;
+		}
 		case 0xAC000000: //SW Store Word
 		{
 			printf("SW ");
@@ -1877,6 +6489,11 @@ void print_instruction(uint32_t instr)
 					printf("SYSCALL\n");
 					break;
 				}
+				case 0x0F: //SYNC
+				{
+					printf("SYNC\n");
+					break;
+				}
 				default:
 					printf("ERROR2\n");
 			}
@@ -1896,23 +6513,51 @@ void print_instruction(uint32_t instr)
 	
 /***************************************************************/
 /* main                                                                                                                                   */
+/* left out when the simulator is built into mu-microbench.c        */
 /***************************************************************/
+#ifndef MU_MIPS_NO_MAIN
 int main(int argc, char *argv[]) {                              
 	printf("\n**************************\n");
 	printf("Welcome to MU-MIPS SIM...\n");
 	printf("**************************\n\n");
 	
-	if (argc != 2) {
-		printf("Error: You should provide input file.\nUsage: %s <input program> \n\n",  argv[0]);
+	int arg;
+	char *replay = NULL;
+	for (arg = 1; arg < argc; arg++) {
+		if (strcmp(argv[arg], "-q") == 0) {
+			QUIET_FLAG = 1; //quiet mode for timing runs
+		} else if (strcmp(argv[arg], "-o") == 0 && arg + 1 < argc) {
+			if (!parse_option(argv[++arg])) {
+				printf("Error: Unknown option %s\n", argv[arg]);
+				exit(1);
+			}
+		} else if (strcmp(argv[arg], "-t") == 0 && arg + 1 < argc) {
+			replay = argv[++arg]; //trace-driven mode, no program
+		} else {
+			break;
+		}
+	}
+	if (replay != NULL && arg == argc) {
+		init_memory(); //blank image for the data words cache fills copy
+		cache_init();
+		trace_replay(replay);
+		exit(0);
+	}
+	if (replay != NULL || arg != argc - 1) {
+		printf("Error: You should provide input file.\nUsage: %s [-q] [-o option=value]... <input program> \n", argv[0]);
+		printf("       %s [-o option=value]... -t <trace file>\n\n", argv[0]);
 		exit(1);
 	}
 
-	strcpy(prog_file, argv[1]);
+	strncpy(prog_file, argv[arg], sizeof(prog_file) - 1);
 	initialize();
 	load_program();
-	help();
+	if (!QUIET_FLAG) {
+		help();
+	}
 	while (1){
 		handle_command();
 	}
 	return 0;
 }
+#endif
@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <time.h>
 
 #define FALSE 0
 #define TRUE  1
@@ -43,6 +44,7 @@ typedef struct CPU_State_Struct {
   uint32_t PC;		                   /* program counter */
   uint32_t REGS[MIPS_REGS]; /* register file. */
   uint32_t HI, LO;                          /* special regs for mult/div. */
+  uint32_t delay_pc;                        /* with DELAY_SLOT, where a branch goes once its slot has run, else 0 */
 } CPU_State;
 
 typedef struct CPU_Pipeline_Reg_Struct{
@@ -56,7 +58,6 @@ typedef struct CPU_Pipeline_Reg_Struct{
 	uint32_t ALUOutputLow;
 	uint32_t LMD;
 	int stage_stalled; //1 for bubble, 0 for standard
-	uint32_t Forwarding_Type;
 	int MEM_ACCESS_FLAG; //is there a memory access in this command?
 	int REG_WRITE_FLAG; //is there writing back to a reg during this command that could cause a data hazard?
 	uint32_t REG_RD_VALUE; //for checking for data hazards
@@ -68,40 +69,143 @@ typedef struct CPU_Pipeline_Reg_Struct{
 
 } CPU_Pipeline_Reg;
 
+/* state of the core being stepped: one copy per host thread, so that
+   with "-o parallel=1" every simulated core can run on its own thread */
+#define CORE_LOCAL __thread
+
 /***************************************************************/
 /* CPU State info.                                                                                                               */
 /***************************************************************/
 
-CPU_State CURRENT_STATE, NEXT_STATE;
-int RUN_FLAG;	/* run flag*/
-uint32_t INSTRUCTION_COUNT=-3;
-uint32_t CYCLE_COUNT;
+CORE_LOCAL CPU_State CURRENT_STATE, NEXT_STATE;
+CORE_LOCAL int RUN_FLAG;	/* run flag*/
+CORE_LOCAL uint32_t INSTRUCTION_COUNT;
+CORE_LOCAL uint32_t CYCLE_COUNT;
 uint32_t PROGRAM_SIZE; /*in words*/
 
 
 /***************************************************************/
 /* Pipeline Registers.                                                                                                        */
 /***************************************************************/
-CPU_Pipeline_Reg IF_ID;
-CPU_Pipeline_Reg ID_EX;
-CPU_Pipeline_Reg EX_MEM;
-CPU_Pipeline_Reg MEM_WB;
+CORE_LOCAL CPU_Pipeline_Reg IF_ID;
+CORE_LOCAL CPU_Pipeline_Reg ID_EX;
+CORE_LOCAL CPU_Pipeline_Reg EX_MEM;
+CORE_LOCAL CPU_Pipeline_Reg MEM_WB;
+
+/* "-o width=<n>": an in-order superscalar pipeline with n slots per stage.
+   The stages work on the four registers above, so the registers of the
+   slot being stepped are swapped in; between cycles that is slot 0 and
+   SLOTS holds the others. In one cycle a slot only issues behind the
+   older slots of its group if it does not read what they write and they
+   hold no other memory access (one memory port). */
+#define MAX_ISSUE_WIDTH 4
+#define LATCH_IF_ID 0
+#define LATCH_ID_EX 1
+#define LATCH_EX_MEM 2
+#define LATCH_MEM_WB 3
+
+typedef struct IssueStats_Struct {
+
+  uint32_t cycles; //cycles the pipeline stepped
+  uint32_t issued[MAX_ISSUE_WIDTH + 1]; //cycles ID issued 0 .. width instructions
+  uint32_t dependency; //groups split by a slot reading what an older one writes
+  uint32_t memory_port; //groups split by a second memory access
+  uint32_t muldiv_unit; //groups split by a second MULT/DIV
+  uint32_t hazard; //groups split by a stall on an older group (load-use, a missing load, no forwarding)
+  uint32_t squashed; //slots behind a taken branch in EX
+
+} IssueStats;
+
+int ISSUE_WIDTH = 1; //"-o width=<n>", set before running
+CORE_LOCAL int CURRENT_SLOT; //slot whose registers are in IF_ID .. MEM_WB
+CORE_LOCAL CPU_Pipeline_Reg SLOTS[MAX_ISSUE_WIDTH][4]; //[slot][LATCH_*], CURRENT_SLOT's are stale
+
+/* MULT/MULTU and DIV/DIVU hand their operands to a multiplier and a divider
+   that have HI/LO ready "-o mult_latency=<cycles>" / "-o div_latency=<cycles>"
+   after EX, taking a new operation every cycle or only once done
+   ("-o mult_pipelined=0|1", "-o div_pipelined=0|1"). Anything reading or
+   writing HI/LO waits in ID for the last result, and a MULT or DIV for its
+   unit. The defaults are the old single-cycle EX. */
+typedef struct MulDivStats_Struct {
+
+  uint32_t mults, divs;
+  uint32_t hi_lo_stalls; //cycles an instruction waited in ID for HI/LO
+  uint32_t unit_stalls; //cycles a MULT/DIV waited in ID for its unit
+
+} MulDivStats;
+
+uint32_t MULT_LATENCY = 1;
+uint32_t DIV_LATENCY = 1;
+int MULT_PIPELINED = 1;
+int DIV_PIPELINED = 0;
+CORE_LOCAL uint32_t HI_LO_READY; //first cycle an instruction using HI/LO can be in EX
+CORE_LOCAL uint32_t MULT_FREE, DIV_FREE; //first cycle each unit takes a new operation
 
-char prog_file[32];
+/* Deeper scalar pipelines: "-o fetch_stages=<n>" and "-o decode_stages=<n>"
+   put n - 1 more latches in front of the ID that reads registers and checks
+   hazards, and "-o mem_stages=<n>" n - 1 more between MEM and WB (MEM
+   itself being the first memory stage, the access made there). They are
+   chains of the same pipeline registers, advanced by pipe_advance(), and
+   hazard detection and forwarding look down them, so a taken branch costs
+   fetch_stages + decode_stages - 1 cycles and a load's user waits
+   mem_stages cycles. The width 1 pipeline only. */
+#define MAX_PIPE_STAGES 5 //per kind, so up to MAX_PIPE_STAGES - 1 extra latches
+
+typedef struct DepthStats_Struct {
+
+  uint32_t flushes; //taken branches and jumps
+  uint32_t squashed; //wrong-path instructions they dropped from the front end
+  uint32_t load_use; //cycles ID waited on a load still in a memory stage
+
+} DepthStats;
+
+int FETCH_STAGES = 1;
+int DECODE_STAGES = 1;
+int MEMORY_STAGES = 1;
+CORE_LOCAL CPU_Pipeline_Reg FRONT_PIPE[2 * (MAX_PIPE_STAGES - 1)]; //IF .. ID, youngest first: [0] holds what IF fetched
+CORE_LOCAL CPU_Pipeline_Reg MEM_PIPE[MAX_PIPE_STAGES - 1]; //MEM .. WB, youngest first: [k] is k + 1 memory stages done
+
+/* "-o delay_slot=1": the architected MIPS branch delay slot. The instruction
+   after a branch or jump always runs before the branch takes effect, branch
+   targets are relative to it (PC + 4 + offset << 2) and JAL/JALR link PC + 8,
+   as compiler output expects. The default 0 is the simulator's own
+   convention: targets PC + offset << 2, and what follows a taken branch is
+   flushed. A slot of SLL $0, $0, 0 (0x00000000) counts as a NOP. */
+typedef struct DelaySlotStats_Struct {
+
+  uint32_t branches; //branches and jumps executed
+  uint32_t taken;
+  uint32_t filled; //their slots doing useful work
+  uint32_t nops;
+
+} DelaySlotStats;
+
+int DELAY_SLOT = 0;
+
+char prog_file[256];
 
 int ENABLE_FORWARDING = 1; //forwarding enable flag
-int STALL_COUNT = 0; //flag for stalling
-int FORWARDING_TYPE; //one for reg to alu output, two for 
-int FLUSH_FLAG = 0; //flag for if flushing instruction or not
-//uint32_t CACHE_MISS_COUNT = 0; //counting cache misses
-//uint32_t CACHE_HIT_COUNT = 0; //counting cache hits
-uint32_t CACHE_MISS_FLAG = 0; //if cache miss then stall for 100 cycles, because you know, locality
+CORE_LOCAL int STALL_COUNT = 0; //flag for stalling
+CORE_LOCAL int FLUSH_FLAG = 0; //flag for if flushing instruction or not
+CORE_LOCAL uint32_t CACHE_MISS_FLAG = 0; //if cache miss then stall until the block arrives, because you know, locality
+CORE_LOCAL uint32_t CACHE_STALL_COUNT = 0; //cycles left before the missing block arrives from L2/L3/memory
+#define ENGINE_PIPELINE 0
+#define ENGINE_FUNCTIONAL 1
+#define ENGINE_OOO 2
+int ENGINE = ENGINE_PIPELINE; //what cycle() steps: the 5-stage pipeline, one whole instruction, or the out-of-order core
+int QUIET_FLAG = 0; //set by -q, suppresses the per-stage tracing so long runs can be timed
+double HOST_SECONDS = 0; //host wall time spent in the last sim command
+
+/* per-stage tracing, compiled in but skipped in quiet mode */
+#define sim_print(...) do { if(!QUIET_FLAG) printf(__VA_ARGS__); } while(0)
 
 
 /***************************************************************/
 /* Function Declerations.                                                                                                */
 /***************************************************************/
 void help();
+uint32_t mem_word_load(uint8_t *word);
+void mem_word_store(uint8_t *word, uint32_t value);
 uint32_t mem_read_32(uint32_t address);
 void mem_write_32(uint32_t address, uint32_t value);
 void cycle();
@@ -133,4 +237,39 @@ unsigned createMask(int start, int end);
 unsigned applyMask(unsigned mask, uint instruction);
 void dataHazardDetection();
 int reg_jump(uint32_t opcode, uint32_t instruction);
-int branch_jump(uint32_t opcode);
\ No newline at end of file
+int branch_jump(uint32_t opcode);
+uint32_t dest_reg(CPU_Pipeline_Reg *reg);
+uint32_t instruction_dest(uint32_t instruction);
+uint32_t result_value(CPU_Pipeline_Reg *reg);
+uint32_t forward_operand(uint32_t reg, uint32_t value);
+uint32_t forward_hi_lo(int hi);
+int writes_hi_lo(CPU_Pipeline_Reg *reg);
+void source_regs(uint32_t instruction, int *uses_rs, int *uses_rt);
+void reset_pipeline();
+void handle_superscalar();
+void slot_switch(int s);
+CPU_Pipeline_Reg *slot_reg(int s, int latch);
+int issue_conflict(uint32_t rs, uint32_t rt, int reads_hi_lo);
+void superscalar_fetch(int held);
+void superscalar_print();
+void muldiv_start(uint32_t funct);
+int muldiv_wait(uint32_t instruction, uint32_t cycle);
+void muldiv_print();
+int front_stages();
+int memory_stages();
+void pipe_advance(CPU_Pipeline_Reg *in, CPU_Pipeline_Reg *pipe, int n);
+void depth_print();
+uint32_t branch_pc(uint32_t pc);
+uint32_t link_pc(uint32_t pc);
+uint32_t delay_redirect(uint32_t pc, uint32_t instruction, uint32_t next_pc);
+void delay_slot_count(uint32_t pc, int taken);
+void delay_slot_print();
+void verify(char *filename);
+int set_option(char *key, char *value);
+int parse_option(char *option);
+void functional_step();
+uint32_t execute(uint32_t instruction, uint32_t pc, uint32_t A, uint32_t B, uint32_t *hi, uint32_t *lo, uint32_t *next_pc);
+uint32_t data_load(uint32_t pc, uint32_t opcode, uint32_t addr);
+uint32_t load_extract(uint32_t opcode, uint32_t addr, uint32_t word);
+void data_store(uint32_t pc, uint32_t opcode, uint32_t addr, uint32_t value);
+double host_time();
\ No newline at end of file
@@ -0,0 +1,112 @@
+/******************************************************************************/
+/* OUT-OF-ORDER ENGINE                                                        */
+/* "-o engine=ooo" steps an out-of-order core instead of the 5-stage          */
+/* pipeline. Each cycle up to width instructions are fetched down the         */
+/* predicted path, renamed onto a physical register file and entered in the   */
+/* reorder buffer and issue queue. They issue to the functional units (alus   */
+/* ALUs, one multiplier/divider, one memory port) oldest first as soon as     */
+/* their operands are ready, and commit in order into CURRENT_STATE, which so */
+/* always holds the precise state. A mispredicted branch squashes everything  */
+/* behind it, walking the ROB back to restore the rename table. Stores write  */
+/* the cache at commit; until then the load/store queue forwards their bytes */
+/* to younger loads (see ooo_forward). LL, SC, SYNC and SYSCALL stop fetching */
+/* and execute alone at the head of the ROB. Every core (and every thread of  */
+/* one) has its own window; the caches behind it are the in-order ones.      */
+/******************************************************************************/
+#define MAX_ROB 256
+#define OOO_HI 32 //renamed like $0 .. $31
+#define OOO_LO 33
+#define OOO_ARCH_REGS 34
+#define OOO_PHYS_REGS (OOO_ARCH_REGS + 2 * MAX_ROB) //never runs out: MULT/DIV rename both HI and LO
+#define OOO_NOT_READY 0xFFFFFFFF
+#define OOO_BHT 1024 //2-bit counters, by PC
+#define OOO_RAS 16
+
+typedef struct ROBEntry_Struct {
+
+  uint32_t pc, instruction;
+  uint32_t predicted; //PC fetch went on with
+  uint32_t next_pc; //the real one, once executed
+  int dests;
+  uint32_t dest[2]; //architectural registers written
+  uint32_t phys[2], old_phys[2]; //their new and previous mappings
+  uint32_t src[4]; //physical registers read: rs, rt, HI, LO as used
+  int memory; //1 load, 2 store (LL and SC included)
+  int serial; //LL, SC, SYNC, SYSCALL
+  int issued;
+  int mispredicted; //found out at execution, acted on once done
+  uint32_t slot_next; //with delay slots, a slot's: the target its branch sends fetch to after it, else 0
+  uint32_t done; //cycle the result is ready, once issued
+  uint32_t addr, value; //a load's address; a store's, and its data for commit
+  uint32_t miss_cycles; //a load's latency past a hit
+  int forwarded; //a load's bytes from older stores: 1 some, 2 all
+  uint32_t ras_top; //return address stack after this instruction
+
+} ROBEntry;
+
+typedef struct OOOStats_Struct {
+
+  uint32_t cycles;
+  uint32_t committed;
+  uint32_t dispatched; //including the squashed
+  uint32_t squashed;
+  uint32_t branches, mispredicts; //committed
+  uint64_t rob_occupancy; //summed every cycle
+  uint32_t rob_full, iq_full, lsq_full; //cycles dispatch stopped for a full structure
+  uint32_t serial_cycles; //cycles fetch waited for LL/SC/SYNC/SYSCALL to commit
+  uint32_t loads, load_misses; //committed
+  uint64_t miss_cycles; //latency past a hit of the committed loads that missed
+  uint64_t exposed_cycles; //cycles commit waited on such a load at the ROB head
+  uint32_t forwarded, partial; //committed loads with all / some of their bytes from older stores
+  uint32_t address_waits; //cycles a ready load waited for an older store's address or data
+  uint32_t replays; //stores that found a younger load had read past them
+
+} OOOStats;
+
+/* one out-of-order window: everything the engine keeps between cycles */
+typedef struct OOOCore_Struct {
+
+  int active; //started from CURRENT_STATE, see ooo_start()
+  uint32_t fetch_pc;
+  uint32_t delay_pc; //with delay slots: where fetch goes after the next instruction it fetches, else 0
+  int fetch_stall; //a serializing instruction is in the window
+  uint32_t rat[OOO_ARCH_REGS]; //rename table
+  uint32_t value[OOO_PHYS_REGS];
+  uint32_t ready[OOO_PHYS_REGS]; //cycle the value can be read, OOO_NOT_READY until it is known
+  uint32_t free_list[OOO_PHYS_REGS];
+  int free_count;
+  ROBEntry rob[MAX_ROB]; //circular, oldest at head
+  int head, count;
+  int iq_count, lsq_count; //not yet issued; memory accesses not yet committed
+  uint32_t port_free; //cycle the memory port (or a blocking cache) takes the next access
+  uint32_t commit_free; //cycle commit goes on after a store or SYNC waited on the cache
+  uint8_t bht[OOO_BHT];
+  uint32_t ras[OOO_RAS];
+  uint32_t ras_top;
+  OOOStats stats;
+
+} OOOCore;
+
+uint32_t ROB_SIZE = 64; //"-o rob=<entries>"
+uint32_t IQ_SIZE = 32; //"-o iq=<entries>"
+uint32_t LSQ_SIZE = 16; //"-o lsq=<entries>"
+uint32_t NUM_ALUS = 2; //"-o alus=<n>"
+int LSQ_SPECULATE = 0; //"-o lsq_speculate=1": loads go past stores with unknown addresses, replayed if wrong
+OOOCore OOO_CORES[MAX_CORES][MAX_THREADS];
+
+OOOCore *ooo_context();
+void ooo_reset();
+void ooo_start(OOOCore *ooo);
+void ooo_step();
+void ooo_resolve(OOOCore *ooo);
+void ooo_commit(OOOCore *ooo);
+void ooo_issue(OOOCore *ooo);
+int ooo_execute(OOOCore *ooo, ROBEntry *entry, int index);
+uint32_t ooo_latency(OOOCore *ooo, uint32_t earliest);
+uint32_t access_bytes(uint32_t opcode, uint32_t addr);
+uint32_t lane_mask(uint32_t bytes);
+int ooo_forward(OOOCore *ooo, int index, uint32_t opcode, uint32_t addr, uint32_t *word);
+int ooo_violation(OOOCore *ooo, int index, uint32_t opcode, uint32_t addr);
+void ooo_dispatch(OOOCore *ooo);
+uint32_t ooo_predict(OOOCore *ooo, uint32_t pc, uint32_t instruction);
+void ooo_print();
@@ -0,0 +1,36 @@
+/******************************************************************************/
+/* MEMORY TRACES                                                              */
+/* A run can record every fetch, load and store it makes, and a recorded     */
+/* trace (or a Dinero "din" trace) can be replayed through the cache alone.  */
+/******************************************************************************/
+#define TRACE_READ 0 //access types use the Dinero din labels
+#define TRACE_WRITE 1
+#define TRACE_FETCH 2
+#define TRACE_ESCAPE 3 //din only: ignored
+#define TRACE_FLUSH 4 //din only: invalidates the cache
+
+#define TRACE_MAGIC "MUTR" //first 4 bytes of a binary trace, followed by the version
+#define TRACE_VERSION 1
+#define TRACE_BUFFER 4096 //records read per fread during replay
+
+typedef struct TraceRecord_Struct {
+
+  uint32_t pc; //instruction making the access
+  uint32_t addr; //byte address accessed
+  uint8_t type; //TRACE_READ, TRACE_WRITE or TRACE_FETCH
+  uint8_t size; //bytes accessed: 1, 2 or 4
+  uint16_t pad;
+
+} TraceRecord;
+
+
+/***************************************************************/
+/* TRACE RECORDING                                             */
+/***************************************************************/
+FILE *TRACE_OUT = NULL; //open while recording, set with "-o trace=<file>" or "set trace <file>"
+int TRACE_DIN = 0; //record din text instead of binary records (file name ends in .din)
+
+int trace_open(char *filename);
+void trace_close();
+void trace_record(uint32_t type, uint32_t pc, uint32_t addr, uint32_t size);
+void trace_replay(char *filename);